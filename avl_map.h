@@ -0,0 +1,315 @@
+#ifndef AVL_MAP_H_
+#define AVL_MAP_H_
+
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <utility>
+
+#include "avl_tree.h"
+
+namespace tree {
+
+struct KeyNotFound : public std::exception {
+    const char *what() const noexcept override {
+        return "KeyNotFound";
+    }
+};
+
+// The element of an AvlMap: a key and its value. The value stays mutable
+// through the map's const iterators, like the second of a std::map pair.
+template <typename Key, typename Value, bool COLD_VALUE = false>
+class MapEntry {
+  public:
+    template <typename K, typename... Args>
+    explicit MapEntry(K &&key, Args &&...args) : key_(std::forward<K>(key)), value_(std::forward<Args>(args)...) {}
+
+    const Key &key() const noexcept {
+        return key_;
+    }
+
+    Value &value() const noexcept {
+        return value_;
+    }
+
+  private:
+    Key key_;
+    mutable Value value_;
+};
+
+// Cold layout: the node keeps the key and a pointer, the value lives in an
+// allocation of its own, so searches only pull compact key nodes into the
+// cache.
+template <typename Key, typename Value>
+class MapEntry<Key, Value, true> {
+  public:
+    template <typename K, typename... Args>
+    explicit MapEntry(K &&key, Args &&...args)
+    : key_(std::forward<K>(key))
+    , value_(new Value(std::forward<Args>(args)...))
+    {}
+
+    MapEntry(const MapEntry &other) : key_(other.key_), value_(new Value(*other.value_)) {}
+
+    MapEntry(MapEntry &&other) = default;
+
+    const Key &key() const noexcept {
+        return key_;
+    }
+
+    Value &value() const noexcept {
+        return *value_;
+    }
+
+  private:
+    Key key_;
+    std::unique_ptr<Value> value_;
+};
+
+template <typename Key, typename Value, bool COLD_VALUE>
+std::ostream &operator<<(std::ostream &os, const MapEntry<Key, Value, COLD_VALUE> &e) {
+    return os << e.key() << ": " << e.value();
+}
+
+// Orders entries by key. It is transparent, so the tree can be searched by
+// bare keys, and by anything Compare accepts next to a key.
+template <typename Key, typename Compare>
+class MapCompare {
+    // declared first, the return type of operator() refers to them
+    template <typename Value, bool COLD_VALUE>
+    static const Key &key_of(const MapEntry<Key, Value, COLD_VALUE> &e) noexcept {
+        return e.key();
+    }
+
+    template <typename T>
+    static const T &key_of(const T &key) noexcept {
+        return key;
+    }
+
+  public:
+    using is_transparent = void;
+
+    MapCompare() : comp_() {}
+
+    explicit MapCompare(const Compare &comp) : comp_(comp) {}
+
+    template <typename A, typename B>
+    auto operator()(const A &a, const B &b) const
+        -> decltype(std::declval<const Compare &>()(key_of(a), key_of(b))) {
+        return comp_(key_of(a), key_of(b));
+    }
+
+    const Compare &get() const noexcept {
+        return comp_;
+    }
+
+  private:
+    Compare comp_;
+};
+
+// Ordered map on top of AvlTree. Values are built in place in their node
+// and never move: rebalancing and remove relink nodes, and a node can be
+// extracted and inserted again, into this map or another one with an
+// equal allocator, without touching its key or value. A map whose
+// allocator differs moves the entry into a node of its own instead.
+//
+// COLD_VALUE keeps large values out of line (see MapEntry).
+template <typename Key, typename Value, typename Compare = std::less<Key>,
+          typename Allocator = std::allocator<std::pair<const Key, Value>>, bool COLD_VALUE = false>
+class AvlMap : public AvlTree<MapEntry<Key, Value, COLD_VALUE>, 1, Allocator, NoAugment, MapCompare<Key, Compare>> {
+    using Entry = MapEntry<Key, Value, COLD_VALUE>;
+    using Base = AvlTree<Entry, 1, Allocator, NoAugment, MapCompare<Key, Compare>>;
+    using AvlNode = typename Base::AvlNode;
+    using NodeAlloc = typename Base::NodeAlloc;
+    using NodeTraits = typename Base::NodeTraits;
+
+  public:
+    using key_type = Key;
+    using mapped_type = Value;
+    using value_type = Entry;
+
+    // Owns a node taken out of a map by extract().
+    class node_type {
+      public:
+        node_type() : node_(nullptr) {}
+
+        node_type(node_type &&other) : alloc_(std::move(other.alloc_)), node_(other.node_) {
+            other.node_ = nullptr;
+        }
+
+        node_type &operator=(node_type &&other) {
+            if (this != &other) {
+                reset();
+                alloc_ = std::move(other.alloc_);
+                node_ = other.node_;
+                other.node_ = nullptr;
+            }
+
+            return *this;
+        }
+
+        ~node_type() {
+            reset();
+        }
+
+        bool empty() const noexcept {
+            return node_ == nullptr;
+        }
+
+        explicit operator bool() const noexcept {
+            return node_ != nullptr;
+        }
+
+        const Key &key() const noexcept {
+            return node_->element_.key();
+        }
+
+        Value &value() const noexcept {
+            return node_->element_.value();
+        }
+
+      private:
+        friend class AvlMap;
+
+        NodeAlloc alloc_;
+        AvlNode *node_;
+
+        node_type(const NodeAlloc &alloc, AvlNode *node) : alloc_(alloc), node_(node) {}
+
+        void reset() {
+            if (node_) {
+                NodeTraits::destroy(alloc_, node_);
+                NodeTraits::deallocate(alloc_, node_, 1);
+                node_ = nullptr;
+            }
+        }
+    };
+
+    AvlMap() = default;
+
+    explicit AvlMap(const Allocator &alloc) : Base(alloc) {}
+
+    explicit AvlMap(const Compare &comp, const Allocator &alloc = Allocator())
+    : Base(MapCompare<Key, Compare>(comp), alloc)
+    {}
+
+    using Base::contains;
+
+    // Constructs Value(args...) in a new node if key is absent. Returns
+    // the value stored under key and whether it was inserted.
+    template <typename K, typename... Args>
+    std::pair<Value *, bool> try_emplace(K &&key, Args &&...args) {
+        bool inserted = false;
+        auto make = [&] {
+            inserted = true;
+            return this->create_node(std::piecewise_construct, std::forward<K>(key), std::forward<Args>(args)...);
+        };
+        AvlNode *found;
+        this->insert_with(this->root_, key, make, found);
+        return std::make_pair(&found->element_.value(), inserted);
+    }
+
+    template <typename K, typename M>
+    std::pair<Value *, bool> insert_or_assign(K &&key, M &&value) {
+        auto result = try_emplace(std::forward<K>(key), std::forward<M>(value));
+        if (!result.second) {
+            *result.first = std::forward<M>(value);
+        }
+
+        return result;
+    }
+
+    Value &operator[](const Key &key) {
+        return *try_emplace(key).first;
+    }
+
+    // The value stored under key, or nullptr.
+    template <typename K>
+    Value *find(const K &key) {
+        auto node = this->find_node(key);
+        return node ? &node->element_.value() : nullptr;
+    }
+
+    template <typename K>
+    const Value *find(const K &key) const {
+        auto node = this->find_node(key);
+        return node ? &node->element_.value() : nullptr;
+    }
+
+    template <typename K>
+    Value &at(const K &key) {
+        auto value = find(key);
+        if (!value) {
+            throw KeyNotFound();
+        }
+
+        return *value;
+    }
+
+    template <typename K>
+    const Value &at(const K &key) const {
+        auto value = find(key);
+        if (!value) {
+            throw KeyNotFound();
+        }
+
+        return *value;
+    }
+
+    template <typename K>
+    void remove(const K &key) {
+        AvlNode *removed = nullptr;
+        this->unlink(this->root_, key, removed);
+        if (removed) {
+            this->destroy_node(removed);
+        }
+    }
+
+    // Takes the node of key out of the map; the handle is empty if there
+    // is none.
+    template <typename K>
+    node_type extract(const K &key) {
+        AvlNode *removed = nullptr;
+        this->unlink(this->root_, key, removed);
+        return node_type(this->alloc_, removed);
+    }
+
+    // Links an extracted node back in. If its key is taken the handle
+    // keeps the node and false is returned. A node whose allocator can't
+    // be freed through ours is rebuilt in ours, and the handle frees the
+    // old one.
+    bool insert(node_type &&handle) {
+        if (!handle.node_) {
+            return false;
+        }
+
+        auto node = handle.node_;
+        bool foreign = !(handle.alloc_ == this->alloc_);
+        bool inserted = false;
+        auto make = [&] {
+            inserted = true;
+            return foreign ? this->create_node(std::move(node->element_)) : node;
+        };
+        AvlNode *found;
+        this->insert_with(this->root_, node->element_.key(), make, found);
+        if (!inserted) {
+            return false;
+        }
+
+        if (foreign) {
+            handle.reset();
+        } else {
+            handle.node_ = nullptr;
+        }
+        return true;
+    }
+};
+
+template <typename Key, typename Value, typename Compare = std::less<Key>,
+          typename Allocator = std::allocator<std::pair<const Key, Value>>>
+using ColdAvlMap = AvlMap<Key, Value, Compare, Allocator, true>;
+
+}
+
+#endif // AVL_MAP_H_
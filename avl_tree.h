@@ -2,10 +2,31 @@
 #define AVL_TREE_H_
 
 #include <type_traits>
+#include <cstdint>
+#include <cstring>
 #include <exception>
 #include <iostream>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
 #include <cassert>
 
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#endif
+
+#include "batch_lookup.h"
+#include "bulk_build.h"
+#include "node_pool.h"
+#include "thread_pool.h"
+#include "tree_augment.h"
+#include "tree_compare.h"
+#include "tree_iterator.h"
+#include "tree_serialize.h"
+#include "tree_shape.h"
+#include "tree_stats.h"
+
 namespace tree {
 
 struct NullTree : public std::exception {
@@ -27,20 +48,58 @@ enum HelperInfo : unsigned char {
     HEIGHT_NO_CHANGE,
 };
 
-template <typename Comparable, int ALLOWED_IMBALANCE = 1>
+// Stats is told about searches, rotations and allocations, see tree_stats.h.
+template <typename Comparable, int ALLOWED_IMBALANCE = 1, typename Allocator = std::allocator<Comparable>,
+          typename Augment = NoAugment, typename Compare = std::less<Comparable>, typename Stats = NoStats>
 class AvlTree {
+  protected:
+    struct AvlNode;
+
   public:
+    using allocator_type = Allocator;
+    using key_compare = Compare;
+    using const_iterator = PathIterator<AvlNode, Comparable>;
+    using iterator = const_iterator;
+
     AvlTree() : root_(nullptr) {}
 
+    explicit AvlTree(const Allocator &alloc) : alloc_(alloc), root_(nullptr) {}
+
+    explicit AvlTree(const Compare &comp, const Allocator &alloc = Allocator())
+    : comp_(comp)
+    , alloc_(alloc)
+    , root_(nullptr)
+    {}
+
     AvlTree(const AvlTree &other)
-    : root_(nullptr)
+    : comp_(other.comp_)
+    , alloc_(NodeTraits::select_on_container_copy_construction(other.alloc_))
+    , root_(nullptr)
+    {
+        if (other.root_) {
+            root_ = clone(other.root_);
+        }
+    }
+
+    AvlTree(const AvlTree &other, const Allocator &alloc)
+    : comp_(other.comp_)
+    , alloc_(alloc)
+    , root_(nullptr)
     {
         if (other.root_) {
             root_ = clone(other.root_);
         }
     }
 
-    AvlTree(AvlTree &&other) : root_(other.root_) {
+    template <typename InputIt, typename = require_input_iterator<InputIt>>
+    AvlTree(InputIt first, InputIt last, const Allocator &alloc = Allocator())
+    : alloc_(alloc)
+    , root_(nullptr)
+    {
+        assign(first, last);
+    }
+
+    AvlTree(AvlTree &&other) : comp_(other.comp_), alloc_(other.alloc_), root_(other.root_) {
         other.root_ = nullptr;
     }
 
@@ -64,29 +123,216 @@ class AvlTree {
         return findMin(root_);
     }
 
-    bool contains(const Comparable &e) const noexcept {
+    bool contains(const Comparable &e) const {
+        Stats::count(LOOKUPS);
+        return find_node(e) != nullptr;
+    }
+
+    // Heterogeneous lookup, for transparent comparators only.
+    template <typename Key, typename C = Compare, typename = enable_if_t<is_transparent<C>>>
+    bool contains(const Key &e) const {
+        Stats::count(LOOKUPS);
+        return find_node(e) != nullptr;
+    }
+
+    Allocator get_allocator() const {
+        return Allocator(alloc_);
+    }
+
+    Compare key_comp() const {
+        return comp_.get();
+    }
+
+    const_iterator begin() const {
+        return const_iterator::first(root_);
+    }
+
+    const_iterator end() const noexcept {
+        return const_iterator(root_);
+    }
+
+    const_iterator find(const Comparable &e) const {
+        return find_key(e);
+    }
+
+    const_iterator lower_bound(const Comparable &e) const {
+        return const_iterator::lower_bound(root_, e, comp_);
+    }
+
+    const_iterator upper_bound(const Comparable &e) const {
+        return const_iterator::upper_bound(root_, e, comp_);
+    }
+
+    std::pair<const_iterator, const_iterator> equal_range(const Comparable &e) const {
+        return std::make_pair(lower_bound(e), upper_bound(e));
+    }
+
+    template <typename Key, typename C = Compare, typename = enable_if_t<is_transparent<C>>>
+    const_iterator find(const Key &e) const {
+        return find_key(e);
+    }
+
+    template <typename Key, typename C = Compare, typename = enable_if_t<is_transparent<C>>>
+    const_iterator lower_bound(const Key &e) const {
+        return const_iterator::lower_bound(root_, e, comp_);
+    }
+
+    template <typename Key, typename C = Compare, typename = enable_if_t<is_transparent<C>>>
+    const_iterator upper_bound(const Key &e) const {
+        return const_iterator::upper_bound(root_, e, comp_);
+    }
+
+    template <typename Key, typename C = Compare, typename = enable_if_t<is_transparent<C>>>
+    std::pair<const_iterator, const_iterator> equal_range(const Key &e) const {
+        return std::make_pair(lower_bound(e), upper_bound(e));
+    }
+
+    bool isEmpty() const noexcept {
+        return root_ == nullptr;
+    }
+
+    // Looks up keys[0, n) interleaved so that their cache misses overlap.
+    // Bit i of out_bitmap, which must hold (n + 63) / 64 words, is set if
+    // keys[i] is in the tree.
+    void contains_many(const Comparable *keys, std::size_t n, std::uint64_t *out_bitmap) const {
+        std::memset(out_bitmap, 0, (n + 63) / 64 * sizeof(std::uint64_t));
+        interleaved_search(root_, keys, n, comp_, [out_bitmap](std::size_t i, const AvlNode *) {
+            out_bitmap[i / 64] |= std::uint64_t(1) << (i % 64);
+        });
+    }
+
+    // Like contains_many(), but out[i] points at the stored element equal
+    // to keys[i], or is nullptr.
+    void find_many(const Comparable *keys, std::size_t n, const Comparable **out) const {
+        for (std::size_t i = 0; i < n; ++i) {
+            out[i] = nullptr;
+        }
+        interleaved_search(root_, keys, n, comp_, [out](std::size_t i, const AvlNode *node) {
+            out[i] = &node->element_;
+        });
+    }
+
+    void printTree(std::ostream &os = std::cout) const noexcept {
+        if (root_) {
+            printTree(os, root_);
+        }
+    }
+
+    // Shape and memory of the tree, see tree_shape.h: O(n) and read-only,
+    // so it may run on a background thread as long as no one writes.
+    TreeShape stats() const {
+        auto child = [](const AvlNode *node, bool right) {
+            return right ? node->right_ : node->left_;
+        };
+        return measure_shape(root_, child, AllocationFootprint<NodeAlloc>::bytes(sizeof(AvlNode), alignof(AvlNode)));
+    }
+
+    // The order statistics below need an OrderStatistics tree.
+
+    std::size_t size() const noexcept {
+        static_assert(std::is_same<Augment, OrderStatistics>::value, "size() needs OrderStatistics");
+        return size_of(root_);
+    }
+
+    // Number of elements less than e.
+    std::size_t rank(const Comparable &e) const noexcept {
+        static_assert(std::is_same<Augment, OrderStatistics>::value, "rank() needs OrderStatistics");
+        std::size_t result = 0;
         auto node = root_;
         while (node) {
-            if (node->element_ < e) {
+            if (comp_(node->element_, e)) {
+                result += size_of(node->left_) + 1;
                 node = node->right_;
-            } else if (e < node->element_) {
-                node = node->left_;
             } else {
-                return true;
+                node = node->left_;
             }
         }
 
-        return false;
+        return result;
     }
 
-    bool isEmpty() const noexcept {
-        return root_ == nullptr;
+    // The k-th smallest element, counting from 0.
+    const Comparable &select(std::size_t k) const {
+        static_assert(std::is_same<Augment, OrderStatistics>::value, "select() needs OrderStatistics");
+        if (k >= size_of(root_)) {
+            throw IndexOutOfRange();
+        }
+
+        auto node = root_;
+        while (true) {
+            auto left_size = size_of(node->left_);
+            if (k < left_size) {
+                node = node->left_;
+            } else if (k == left_size) {
+                return node->element_;
+            } else {
+                k -= left_size + 1;
+                node = node->right_;
+            }
+        }
     }
 
-    void printTree(std::ostream &os = std::cout) const noexcept {
-        if (root_) {
-            printTree(os, root_);
+    // Number of elements in [lo, hi].
+    std::size_t count_range(const Comparable &lo, const Comparable &hi) const noexcept {
+        static_assert(std::is_same<Augment, OrderStatistics>::value, "count_range() needs OrderStatistics");
+        if (comp_(hi, lo)) {
+            return 0;
         }
+
+        std::size_t not_greater = 0;
+        auto node = root_;
+        while (node) {
+            if (comp_(hi, node->element_)) {
+                node = node->left_;
+            } else {
+                not_greater += size_of(node->left_) + 1;
+                node = node->right_;
+            }
+        }
+
+        return not_greater - rank(lo);
+    }
+
+    // Combines the summaries of every element in [lo, hi], in order, in
+    // O(log n): whole subtrees inside the range contribute their stored
+    // summary, only the two boundary paths are walked.
+    template <typename A = Augment>
+    typename A::value_type reduce(const Comparable &lo, const Comparable &hi) const {
+        auto result = Augment::identity();
+        if (comp_(hi, lo)) {
+            return result;
+        }
+
+        // the first node inside the range splits it into two boundary paths
+        auto node = root_;
+        while (node && (comp_(node->element_, lo) || comp_(hi, node->element_))) {
+            node = comp_(node->element_, lo) ? node->right_ : node->left_;
+        }
+        if (!node) {
+            return result;
+        }
+
+        for (auto left = node->left_; left;) {
+            if (comp_(left->element_, lo)) {
+                left = left->right_;
+            } else {
+                result = Augment::combine(Augment::combine(Augment::lift(left->element_), summary_of(left->right_)), result);
+                left = left->left_;
+            }
+        }
+
+        result = Augment::combine(result, Augment::lift(node->element_));
+
+        for (auto right = node->right_; right;) {
+            if (comp_(hi, right->element_)) {
+                right = right->left_;
+            } else {
+                result = Augment::combine(result, Augment::combine(summary_of(right->left_), Augment::lift(right->element_)));
+                right = right->right_;
+            }
+        }
+
+        return result;
     }
 
     void makeEmpty() {
@@ -94,17 +340,137 @@ class AvlTree {
             return;
         }
 
-        makeEmpty(root_);
+        if (!release_all()) {
+            makeEmpty(root_);
+        }
         root_ = nullptr;
     }
 
+    // Replaces the contents with [first, last), which may be unsorted and
+    // contain duplicates. threads > 1 sorts in parallel, 0 uses all cores.
+    template <typename InputIt, typename = require_input_iterator<InputIt>>
+    void assign(InputIt first, InputIt last, unsigned threads = 1) {
+        std::vector<Comparable> elements(first, last);
+        sort_unique(elements, threads, comp_);
+        assign_sorted(std::make_move_iterator(elements.begin()), std::make_move_iterator(elements.end()));
+    }
+
+    // Replaces the contents with an ascending range in O(n), no rotations.
+    // Of several equivalent elements only the first is kept.
+    template <typename ForwardIt>
+    void assign_sorted(ForwardIt first, ForwardIt last) {
+        makeEmpty();
+        auto n = count_unique_sorted(first, last, comp_);
+        root_ = build_sorted(first, last, n);
+    }
+
+    // Writes the elements in ascending order in the tree_serialize.h
+    // snapshot format. deserialize() rebuilds a balanced tree from one in a
+    // single streaming pass, no rotations; on BadSnapshot the tree is left
+    // empty or partly loaded.
+    void serialize(std::ostream &os) const {
+        StreamSink sink(os);
+        write_snapshot<Comparable>(begin(), end(), std::distance(begin(), end()), sink);
+    }
+
+    void deserialize(std::istream &is) {
+        StreamSource source(is);
+        load_snapshot(source);
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    void serialize(int fd) const {
+        FdSink sink(fd);
+        write_snapshot<Comparable>(begin(), end(), std::distance(begin(), end()), sink);
+    }
+
+    void deserialize(int fd) {
+        FdSource source(fd);
+        load_snapshot(source);
+    }
+#endif
+
     template <typename T, typename = enable_if_t<std::is_convertible<T, Comparable>>>
     void insert(T &&e) {
-        insert(root_, std::forward<T>(e));
+        Stats::count(INSERTS);
+        auto make = [this, &e] {
+            return create_node(std::forward<T>(e));
+        };
+        AvlNode *found;
+        insert_with(root_, e, make, found);
     }
 
     void remove(const Comparable &e) {
-        remove(root_, e);
+        Stats::count(REMOVES);
+        AvlNode *removed = nullptr;
+        unlink(root_, e, removed);
+        if (removed) {
+            destroy_node(removed);
+        }
+    }
+
+    // Makes this tree left, key, right in O(|height difference| + 1).
+    // Every element of left must be less than key, and key less than every
+    // element of right; both end up empty. Nodes change hands where the
+    // allocators are equal and are copied otherwise.
+    template <typename T, typename = enable_if_t<std::is_convertible<T, Comparable>>>
+    void join(AvlTree &left, T &&key, AvlTree &right) {
+        AvlTree l(*this, Sibling());
+        AvlTree r(*this, Sibling());
+        l.root_ = adopt(left);
+        r.root_ = adopt(right);
+        auto node = create_node(std::forward<T>(key));
+        makeEmpty();
+        root_ = join_nodes(l.root_, node, r.root_);
+        l.root_ = r.root_ = nullptr;
+    }
+
+    // Moves the elements less than key into left and the greater ones into
+    // right in O(log n), leaving this tree empty, and tells whether key was
+    // in it. What left and right held before is dropped.
+    bool split(const Comparable &key, AvlTree &left, AvlTree &right) {
+        AvlTree l(*this, Sibling());
+        AvlTree r(*this, Sibling());
+        auto root = root_;
+        root_ = nullptr;
+        auto found = split_nodes(root, key, l.root_, r.root_);
+        if (found) {
+            destroy_node(found);
+        }
+
+        left = std::move(l);
+        right = std::move(r);
+        return found != nullptr;
+    }
+
+    // Set operations in O(m log(n / m + 1)) for trees of m <= n elements:
+    // the root of the lower tree splits the other one, the two halves
+    // recurse, in parallel on pool if given, and join puts the results
+    // together. The nodes of other move over (they are copied if its
+    // allocator differs) and other ends up empty; pass a copy to keep it.
+    // Of two equivalent elements this tree's stays.
+    void union_with(AvlTree &&other) {
+        set_operation(other, nullptr, &AvlTree::union_nodes);
+    }
+
+    void union_with(AvlTree &&other, ThreadPool &pool) {
+        set_operation(other, &pool, &AvlTree::union_nodes);
+    }
+
+    void intersect_with(AvlTree &&other) {
+        set_operation(other, nullptr, &AvlTree::intersect_nodes);
+    }
+
+    void intersect_with(AvlTree &&other, ThreadPool &pool) {
+        set_operation(other, &pool, &AvlTree::intersect_nodes);
+    }
+
+    void difference_with(AvlTree &&other) {
+        set_operation(other, nullptr, &AvlTree::difference_nodes);
+    }
+
+    void difference_with(AvlTree &&other, ThreadPool &pool) {
+        set_operation(other, &pool, &AvlTree::difference_nodes);
     }
 
     AvlTree &operator=(const AvlTree &other) {
@@ -112,29 +478,22 @@ class AvlTree {
             return *this;
         }
 
-        if (root_) {
-            makeEmpty(root_);
-        }
-
+        makeEmpty();
+        comp_ = other.comp_;
         if (other.root_) {
             root_ = clone(other.root_);
-        } else {
-            root_ = nullptr;
         }
 
         return *this;
     }
 
-    AvlTree &operator==(AvlTree &&other) {
-        auto temp = root_;
-        root_ = other.root_;
-        other.root_ = temp;
-
+    AvlTree &operator=(AvlTree &&other) {
+        move_assign(other, typename NodeTraits::propagate_on_container_move_assignment());
         return *this;
     }
 
-  private:
-    struct AvlNode {
+  protected:
+    struct AvlNode : AugmentedNode<Augment> {
         Comparable element_;
         AvlNode *left_;
         AvlNode *right_;
@@ -149,10 +508,103 @@ class AvlTree {
         , height_(0)
         , balance_(SAME_HEIGHT)
         {}
+
+        template <typename... Args>
+        AvlNode(std::piecewise_construct_t, Args &&...args)
+        : element_(std::forward<Args>(args)...)
+        , left_(nullptr)
+        , right_(nullptr)
+        , height_(0)
+        , balance_(SAME_HEIGHT)
+        {}
     };
 
+    using NodeAlloc = typename std::allocator_traits<Allocator>::template rebind_alloc<AvlNode>;
+    using NodeTraits = std::allocator_traits<NodeAlloc>;
+
+    KeyCompare<Compare> comp_;
+    NodeAlloc alloc_;
     AvlNode *root_;
 
+    template <typename... Args>
+    AvlNode *create_node(Args &&...args) {
+        Stats::count(ALLOCATIONS);
+        AvlNode *node = NodeTraits::allocate(alloc_, 1);
+        try {
+            NodeTraits::construct(alloc_, node, std::forward<Args>(args)...);
+        } catch (...) {
+            NodeTraits::deallocate(alloc_, node, 1);
+            throw;
+        }
+
+        return node;
+    }
+
+    void destroy_node(AvlNode *node) {
+        Stats::count(DEALLOCATIONS);
+        NodeTraits::destroy(alloc_, node);
+        NodeTraits::deallocate(alloc_, node, 1);
+    }
+
+    void move_assign(AvlTree &other, std::true_type) {
+        using std::swap;
+        swap(comp_, other.comp_);
+        swap(alloc_, other.alloc_);
+        swap(root_, other.root_);
+    }
+
+    void move_assign(AvlTree &other, std::false_type) {
+        if (alloc_ == other.alloc_) {
+            std::swap(comp_, other.comp_);
+            std::swap(root_, other.root_);
+        } else {
+            // nodes can't change hands, copy them into our own allocator
+            *this = other;
+            other.makeEmpty();
+        }
+    }
+
+    // Trivially destructible nodes from a pool that only this tree uses can
+    // be dropped slab by slab instead of node by node.
+    template <typename A = NodeAlloc>
+    typename std::enable_if<has_try_release<A>::value, bool>::type release_all() {
+        return std::is_trivially_destructible<Comparable>::value && alloc_.try_release();
+    }
+
+    template <typename A = NodeAlloc>
+    typename std::enable_if<!has_try_release<A>::value, bool>::type release_all() {
+        return false;
+    }
+
+    template <typename Key>
+    const AvlNode *find_node(const Key &e) const {
+        auto node = root_;
+        while (node) {
+            Stats::count(STEPS);
+            Stats::count(COMPARISONS);
+            auto order = comp_.compare(e, node->element_);
+            if (order > 0) {
+                node = node->right_;
+            } else if (order < 0) {
+                node = node->left_;
+            } else {
+                return node;
+            }
+        }
+
+        return nullptr;
+    }
+
+    template <typename Key>
+    const_iterator find_key(const Key &e) const {
+        auto it = lower_bound(e);
+        if (it != end() && comp_(e, *it)) {
+            return end();
+        }
+
+        return it;
+    }
+
     const Comparable &findMax(const AvlNode *node) const noexcept {
         while (node->right_) {
             node = node->right_;
@@ -190,142 +642,130 @@ class AvlTree {
             makeEmpty(node->right_);
         }
 
-        delete node;
+        destroy_node(node);
     }
 
-    template <typename T, typename = enable_if_t<std::is_convertible<T, Comparable>>>
-    HelperInfo insert(AvlNode *&node, T &&e) {
+    // Hangs the node returned by make() where key belongs, unless an
+    // equivalent element is already there; make() only runs in the first
+    // case. found ends up at the node holding key either way.
+    template <typename Key, typename Make>
+    HelperInfo insert_with(AvlNode *&node, const Key &key, Make &make, AvlNode *&found) {
         if (!node) {
-            node = new AvlNode(std::forward<T>(e));
+            node = make();
+            node->left_ = node->right_ = nullptr;
+            node->height_ = 0;
+            node->balance_ = SAME_HEIGHT;
+            augment(node);
+            found = node;
             return HEIGHT_INCREASE;
         }
 
-        if (node->element_ < e) {
-            if (HEIGHT_INCREASE == insert(node->right_, std::forward<T>(e))) {
-                if (RIGHT_HIGHER == node->balance_) {
-                    // maybe unbalance
-                    // if (node->)
-                    auto delta_height = node->right_->height_ - (node->left_ ? node->left_->height_ : -1);
-                    if (delta_height > ALLOWED_IMBALANCE) {
-                        balance_right(node);
-                    } else {
-                        ++node->height_;
-                        return HEIGHT_INCREASE;
-                    }
-                } else if (SAME_HEIGHT == node->balance_) {
-                    ++node->height_;
-                    node->balance_ = RIGHT_HIGHER;
-                    return HEIGHT_INCREASE;
-                } else {
-                    if (node->right_->height_ + 1 == node->left_->height_) {
-                        node->balance_ = SAME_HEIGHT;
-                    }
-                }
+        Stats::count(STEPS);
+        Stats::count(COMPARISONS);
+        auto order = comp_.compare(key, node->element_);
+        if (order > 0) {
+            if (HEIGHT_INCREASE == insert_with(node->right_, key, make, found)) {
+                return rebalance(node);
             }
-        } else if (e < node->element_) {
-            if (HEIGHT_INCREASE == insert(node->left_, std::forward<T>(e))) {
-                if (LEFT_HIGHER == node->balance_) {
-                    // maybe unbalance
-                    auto delta_height = node->left_->height_ - (node->right_ ? node->right_->height_ : -1);
-                    if (delta_height > ALLOWED_IMBALANCE) {
-                        balance_left(node);
-                    } else {
-                        ++node->height_;
-                        return HEIGHT_INCREASE;
-                    }
-                } else if (SAME_HEIGHT == node->balance_) {
-                    ++node->height_;
-                    node->balance_ = LEFT_HIGHER;
-                    return HEIGHT_INCREASE;
-                } else {
-                    if (node->left_->height_ + 1 == node->right_->height_) {
-                        node->balance_ = SAME_HEIGHT;
-                    }
-                }
+        } else if (order < 0) {
+            if (HEIGHT_INCREASE == insert_with(node->left_, key, make, found)) {
+                return rebalance(node);
             }
+        } else {
+            found = node;
         }
 
+        augment(node);
         return HEIGHT_NO_CHANGE;
     }
 
-    HelperInfo remove(AvlNode *&node, const Comparable &e) {
+    // Takes the node holding key out of the tree into removed, which stays
+    // nullptr if there is none. Nodes are relinked rather than elements
+    // copied, so every other element stays in its node.
+    template <typename Key>
+    HelperInfo unlink(AvlNode *&node, const Key &key, AvlNode *&removed) {
         if (!node) {
             return HEIGHT_NO_CHANGE;
         }
 
-        if (e < node->element_) {
-            if (HEIGHT_DECREASE == remove(node->left_, e)) {
-                if (RIGHT_HIGHER == node->balance_) {
-                    auto delta_height = node->right_->height_ - (node->left_ ? node->left_->height_ : -1);
-                    if (delta_height > ALLOWED_IMBALANCE) {
-                        balance_right(node);
-                        return HEIGHT_DECREASE;
-                    }
-                } else if (SAME_HEIGHT == node->balance_) {
-                    node->balance_ = RIGHT_HIGHER;
-                } else {
-                    --node->height_;
-                    if (!node->left_ || (node->right_ && (node->right_->height_ + 1 == node->left_->height_))) {
-                        node->balance_ = SAME_HEIGHT;
-                    }
-
-                    return HEIGHT_DECREASE;
-                }
+        Stats::count(STEPS);
+        Stats::count(COMPARISONS);
+        auto order = comp_.compare(key, node->element_);
+        if (order < 0) {
+            if (HEIGHT_DECREASE == unlink(node->left_, key, removed)) {
+                return rebalance(node);
             }
-        } else if (node->element_ < e) {
-            if (HEIGHT_DECREASE == remove(node->right_, e)) {
-                if (LEFT_HIGHER == node->balance_) {
-                    auto delta_height = node->left_->height_ - (node->right_ ? node->right_->height_ : -1);
-                    if (delta_height > ALLOWED_IMBALANCE) {
-                        balance_left(node);
-                        return HEIGHT_DECREASE;
-                    }
-                } else if (SAME_HEIGHT == node->balance_) {
-                    node->balance_ = LEFT_HIGHER;
-                } else {
-                    --node->height_;
-                    if (!node->right_ || (node->left_ && (node->left_->height_ + 1 == node->right_->height_))) {
-                        node->balance_ = SAME_HEIGHT;
-                    }
-
-                    return HEIGHT_DECREASE;
-                }
+        } else if (order > 0) {
+            if (HEIGHT_DECREASE == unlink(node->right_, key, removed)) {
+                return rebalance(node);
             }
         } else {
+            removed = node;
             if (node->left_ && node->right_) {
-                node->element_ = findMin(node->right_);
-                if (HEIGHT_DECREASE == remove(node->right_, node->element_)) {
-                    if (LEFT_HIGHER == node->balance_) {
-                        auto delta_height = node->left_->height_ - (node->right_ ? node->right_->height_ : -1);
-                        if (delta_height > ALLOWED_IMBALANCE) {
-                            balance_left(node);
-                            return HEIGHT_DECREASE;
-                        }
-                    } else if (SAME_HEIGHT == node->balance_) {
-                        node->balance_ = LEFT_HIGHER;
-                    } else {
-                        --node->height_;
-                        if (!node->right_ || (node->left_ && (node->left_->height_ + 1 == node->right_->height_))) {
-                            node->balance_ = SAME_HEIGHT;
-                        }
-
-                        return HEIGHT_DECREASE;
-                    }
+                // the successor takes over node's place, links and height
+                AvlNode *successor;
+                auto info = unlink_min(node->right_, successor);
+                successor->left_ = node->left_;
+                successor->right_ = node->right_;
+                successor->height_ = node->height_;
+                successor->balance_ = node->balance_;
+                node = successor;
+                if (HEIGHT_DECREASE == info) {
+                    return rebalance(node);
                 }
             } else {
-                auto delete_node = node;
                 node = node->left_ ? node->left_ : node->right_;
-                delete delete_node;
                 return HEIGHT_DECREASE;
             }
         }
 
+        augment(node);
+        return HEIGHT_NO_CHANGE;
+    }
+
+    HelperInfo unlink_min(AvlNode *&node, AvlNode *&min) {
+        Stats::count(STEPS);
+        if (!node->left_) {
+            min = node;
+            node = node->right_;
+            return HEIGHT_DECREASE;
+        }
+
+        if (HEIGHT_DECREASE == unlink_min(node->left_, min)) {
+            return rebalance(node);
+        }
+
+        augment(node);
+        return HEIGHT_NO_CHANGE;
+    }
+
+    // Restores the AVL property at node after one of its subtrees changed
+    // height, and reports how the height of the whole subtree changed.
+    HelperInfo rebalance(AvlNode *&node) {
+        auto old_height = node->height_;
+        auto height_left = node->left_ ? node->left_->height_ : -1;
+        auto height_right = node->right_ ? node->right_->height_ : -1;
+
+        if (height_left - height_right > ALLOWED_IMBALANCE) {
+            balance_left(node);
+        } else if (height_right - height_left > ALLOWED_IMBALANCE) {
+            balance_right(node);
+        } else {
+            change_height_and_balance(node);
+        }
+
+        if (node->height_ > old_height) {
+            return HEIGHT_INCREASE;
+        } else if (node->height_ < old_height) {
+            return HEIGHT_DECREASE;
+        }
+
         return HEIGHT_NO_CHANGE;
     }
 
     void balance_right(AvlNode *&node) {
-        assert(node->right_->balance_ != SAME_HEIGHT && "Already unbalanced before this node!!!");
-        if (RIGHT_HIGHER == node->right_->balance_) {
+        // a same-height child only shows up after a removal, single rotation fits
+        if (LEFT_HIGHER != node->right_->balance_) {
             single_rorate_right_child(node);
         } else {
             double_rorate_right_child(node);
@@ -333,8 +773,7 @@ class AvlTree {
     }
 
     void balance_left(AvlNode *&node) {
-        assert(node->left_->balance_ != SAME_HEIGHT && "Already unbalanced before this node!!!");
-        if (LEFT_HIGHER == node->left_->balance_) {
+        if (RIGHT_HIGHER != node->left_->balance_) {
             single_rorate_left_child(node);
         } else {
             double_rorate_left_child(node);
@@ -342,42 +781,31 @@ class AvlTree {
     }
 
     void single_rorate_right_child(AvlNode *&node) {
+        Stats::count(SINGLE_ROTATIONS);
         auto temp = node;
         node = node->right_;
         temp->right_ = node->left_;
         node->left_ = temp;
 
-        // adjust height
-        temp->height_ = temp->right_ ? temp->right_->height_ + 1 : 0;
-
-        //adjust balance
-        if (!temp->right_ || (temp->left_ && (temp->right_->height_ == temp->left_->height_))) {
-            temp->balance_ = SAME_HEIGHT;
-        }
-        if (node->right_->height_ == node->left_->height_) {
-            node->balance_ = SAME_HEIGHT;
-        }
+        // adjust height and balance
+        change_height_and_balance(temp);
+        change_height_and_balance(node);
     }
 
     void single_rorate_left_child(AvlNode *&node) {
+        Stats::count(SINGLE_ROTATIONS);
         auto temp = node;
         node = node->left_;
         temp->left_ = node->right_;
         node->right_ = temp;
 
-        // adjust height
-        temp->height_ = temp->left_ ? temp->left_->height_ + 1 : 0;
-
-        //adjust balance
-        if (!temp->left_ || (temp->right_ && (temp->right_->height_ == temp->left_->height_))) {
-            temp->balance_ = SAME_HEIGHT;
-        }
-        if (node->right_->height_ == node->left_->height_) {
-            node->balance_ = SAME_HEIGHT;
-        }
+        // adjust height and balance
+        change_height_and_balance(temp);
+        change_height_and_balance(node);
     }
 
     void double_rorate_right_child(AvlNode *&node) {
+        Stats::count(DOUBLE_ROTATIONS);
         auto result_left = node;
         auto result_right = node->right_;
         node = result_right->left_;
@@ -394,6 +822,7 @@ class AvlTree {
     }
 
     void double_rorate_left_child(AvlNode *&node) {
+        Stats::count(DOUBLE_ROTATIONS);
         auto result_left = node->left_;
         auto result_right = node;
         node = result_left->right_;
@@ -423,9 +852,352 @@ class AvlTree {
             node->height_ = height_right + 1;
             node->balance_ = RIGHT_HIGHER;
         }
+
+        augment(node);
     }
 
-    AvlNode *clone(const AvlNode *node) const {
+    // Tags the constructor of an empty tree on another tree's allocator,
+    // whose nodes can move between the two.
+    struct Sibling {};
+
+    AvlTree(const AvlTree &other, Sibling) : comp_(other.comp_), alloc_(other.alloc_), root_(nullptr) {}
+
+    // Takes the nodes of other, copied into our allocator unless it is
+    // other's too, and leaves other empty.
+    AvlNode *adopt(AvlTree &other) {
+        AvlNode *root = nullptr;
+        if (alloc_ == other.alloc_) {
+            std::swap(root, other.root_);
+        } else if (other.root_) {
+            root = clone(other.root_);
+            other.makeEmpty();
+        }
+
+        return root;
+    }
+
+    static int height_of(const AvlNode *node) noexcept {
+        return node ? node->height_ : -1;
+    }
+
+    // Joins left < node < right into one tree: node goes down the spine of
+    // the higher side to where the lower side fits, then rebalance()
+    // repairs the way back up, one rotation per level at most.
+    AvlNode *join_nodes(AvlNode *left, AvlNode *node, AvlNode *right) {
+        if (height_of(left) > height_of(right) + ALLOWED_IMBALANCE) {
+            left->right_ = join_nodes(left->right_, node, right);
+            rebalance(left);
+            return left;
+        }
+
+        if (height_of(right) > height_of(left) + ALLOWED_IMBALANCE) {
+            right->left_ = join_nodes(left, node, right->left_);
+            rebalance(right);
+            return right;
+        }
+
+        node->left_ = left;
+        node->right_ = right;
+        change_height_and_balance(node);
+        return node;
+    }
+
+    // Joins left < right, the minimum of right goes in between.
+    AvlNode *join_nodes(AvlNode *left, AvlNode *right) {
+        if (!left) {
+            return right;
+        }
+        if (!right) {
+            return left;
+        }
+
+        AvlNode *min;
+        unlink_min(right, min);
+        return join_nodes(left, min, right);
+    }
+
+    // Splits the tree at node into the elements less than key and greater
+    // than key, and returns the unlinked node holding key, or nullptr.
+    template <typename Key>
+    AvlNode *split_nodes(AvlNode *node, const Key &key, AvlNode *&left, AvlNode *&right) {
+        if (!node) {
+            left = right = nullptr;
+            return nullptr;
+        }
+
+        auto l = node->left_;
+        auto r = node->right_;
+        auto order = comp_.compare(key, node->element_);
+        if (order < 0) {
+            auto found = split_nodes(l, key, left, right);
+            right = join_nodes(right, node, r);
+            return found;
+        } else if (order > 0) {
+            auto found = split_nodes(r, key, left, right);
+            left = join_nodes(l, node, left);
+            return found;
+        }
+
+        left = l;
+        right = r;
+        node->left_ = node->right_ = nullptr;
+        return node;
+    }
+
+    // Nodes a set operation drops, linked through left_. They are freed
+    // after the parallel part, so the allocator need not be thread safe.
+    struct NodeList {
+        AvlNode *head_ = nullptr;
+        AvlNode *tail_ = nullptr;
+
+        void push(AvlNode *node) noexcept {
+            node->left_ = head_;
+            head_ = node;
+            if (!tail_) {
+                tail_ = node;
+            }
+        }
+
+        void push_tree(AvlNode *node) noexcept {
+            if (node) {
+                auto right = node->right_;
+                push_tree(node->left_);
+                push_tree(right);
+                push(node);
+            }
+        }
+
+        void splice(NodeList &other) noexcept {
+            if (other.head_) {
+                other.tail_->left_ = head_;
+                head_ = other.head_;
+                if (!tail_) {
+                    tail_ = other.tail_;
+                }
+                other.head_ = other.tail_ = nullptr;
+            }
+        }
+    };
+
+    using SetNodes = AvlNode *(AvlTree::*)(AvlNode *, AvlNode *, ThreadPool *, int, NodeList &);
+
+    void set_operation(AvlTree &other, ThreadPool *pool, SetNodes op) {
+        // fork the top levels only, about 8 tasks per thread
+        int depth = 0;
+        if (pool) {
+            for (auto n = pool->size(); n > 1; n /= 2) {
+                ++depth;
+            }
+            depth = depth ? depth + 3 : 0;
+        }
+
+        auto theirs = adopt(other);
+        auto mine = root_;
+        root_ = nullptr;
+
+        NodeList dropped;
+        root_ = (this->*op)(mine, theirs, pool, depth, dropped);
+        while (auto node = dropped.head_) {
+            dropped.head_ = node->left_;
+            destroy_node(node);
+        }
+    }
+
+    template <typename A, typename B>
+    static void fork(ThreadPool *pool, int depth, A &&a, B &&b) {
+        if (pool && depth > 0) {
+            pool->fork_join(a, b);
+        } else {
+            a();
+            b();
+        }
+    }
+
+    // The set operations split the higher of mine and theirs by the root
+    // of the other, called the pivot, and recurse on both halves.
+    // split_mine tells whether mine is the one being split, dup is the
+    // element equivalent to the pivot from the split tree, if any.
+
+    AvlNode *union_nodes(AvlNode *mine, AvlNode *theirs, ThreadPool *pool, int depth, NodeList &dropped) {
+        if (!mine) {
+            return theirs;
+        }
+        if (!theirs) {
+            return mine;
+        }
+
+        auto split_mine = height_of(mine) >= height_of(theirs);
+        auto pivot = split_mine ? theirs : mine;
+        auto pivot_left = pivot->left_;
+        auto pivot_right = pivot->right_;
+        AvlNode *left, *right;
+        auto dup = split_nodes(split_mine ? mine : theirs, pivot->element_, left, right);
+        if (dup) {
+            // keep mine
+            if (split_mine) {
+                std::swap(pivot, dup);
+            }
+            dropped.push(dup);
+        }
+
+        NodeList dropped_right;
+        fork(pool, depth,
+             [&] {
+                 left = split_mine ? union_nodes(left, pivot_left, pool, depth - 1, dropped)
+                                   : union_nodes(pivot_left, left, pool, depth - 1, dropped);
+             },
+             [&] {
+                 right = split_mine ? union_nodes(right, pivot_right, pool, depth - 1, dropped_right)
+                                    : union_nodes(pivot_right, right, pool, depth - 1, dropped_right);
+             });
+        dropped.splice(dropped_right);
+
+        return join_nodes(left, pivot, right);
+    }
+
+    AvlNode *intersect_nodes(AvlNode *mine, AvlNode *theirs, ThreadPool *pool, int depth, NodeList &dropped) {
+        if (!mine || !theirs) {
+            dropped.push_tree(mine);
+            dropped.push_tree(theirs);
+            return nullptr;
+        }
+
+        auto split_mine = height_of(mine) >= height_of(theirs);
+        auto pivot = split_mine ? theirs : mine;
+        auto pivot_left = pivot->left_;
+        auto pivot_right = pivot->right_;
+        AvlNode *left, *right;
+        auto dup = split_nodes(split_mine ? mine : theirs, pivot->element_, left, right);
+        if (dup && split_mine) {
+            std::swap(pivot, dup);
+        }
+
+        NodeList dropped_right;
+        fork(pool, depth,
+             [&] {
+                 left = split_mine ? intersect_nodes(left, pivot_left, pool, depth - 1, dropped)
+                                   : intersect_nodes(pivot_left, left, pool, depth - 1, dropped);
+             },
+             [&] {
+                 right = split_mine ? intersect_nodes(right, pivot_right, pool, depth - 1, dropped_right)
+                                    : intersect_nodes(pivot_right, right, pool, depth - 1, dropped_right);
+             });
+        dropped.splice(dropped_right);
+
+        if (dup) {
+            dropped.push(dup);
+            return join_nodes(left, pivot, right);
+        }
+
+        dropped.push(pivot);
+        return join_nodes(left, right);
+    }
+
+    AvlNode *difference_nodes(AvlNode *mine, AvlNode *theirs, ThreadPool *pool, int depth, NodeList &dropped) {
+        if (!mine || !theirs) {
+            dropped.push_tree(theirs);
+            return mine;
+        }
+
+        auto split_mine = height_of(mine) >= height_of(theirs);
+        auto pivot = split_mine ? theirs : mine;
+        auto pivot_left = pivot->left_;
+        auto pivot_right = pivot->right_;
+        AvlNode *left, *right;
+        auto dup = split_nodes(split_mine ? mine : theirs, pivot->element_, left, right);
+
+        NodeList dropped_right;
+        fork(pool, depth,
+             [&] {
+                 left = split_mine ? difference_nodes(left, pivot_left, pool, depth - 1, dropped)
+                                   : difference_nodes(pivot_left, left, pool, depth - 1, dropped);
+             },
+             [&] {
+                 right = split_mine ? difference_nodes(right, pivot_right, pool, depth - 1, dropped_right)
+                                    : difference_nodes(pivot_right, right, pool, depth - 1, dropped_right);
+             });
+        dropped.splice(dropped_right);
+
+        if (dup) {
+            dropped.push(dup);
+        }
+        if (!split_mine && !dup) {
+            // mine's pivot isn't in theirs, it stays
+            return join_nodes(left, pivot, right);
+        }
+
+        dropped.push(pivot);
+        return join_nodes(left, right);
+    }
+
+    // Recomputes the subtree summary of node from its children.
+    void augment(AvlNode *node) {
+        augment(node, std::is_same<Augment, NoAugment>());
+    }
+
+    void augment(AvlNode *, std::true_type) noexcept {}
+
+    void augment(AvlNode *node, std::false_type) {
+        auto summary = Augment::lift(node->element_);
+        if (node->left_) {
+            summary = Augment::combine(node->left_->summary_, summary);
+        }
+        if (node->right_) {
+            summary = Augment::combine(summary, node->right_->summary_);
+        }
+        node->summary_ = summary;
+    }
+
+    static std::size_t size_of(const AvlNode *node) noexcept {
+        return node ? node->summary_ : 0;
+    }
+
+    template <typename A = Augment>
+    static typename A::value_type summary_of(const AvlNode *node) {
+        return node ? node->summary_ : Augment::identity();
+    }
+
+    template <typename Source>
+    void load_snapshot(Source &source) {
+        SnapshotReader<Comparable, Source> reader(source);
+        makeEmpty();
+        auto first = reader.begin();
+        root_ = build_sorted(first, reader.end(), reader.count());
+    }
+
+    // Builds a perfectly balanced tree from the next n distinct elements.
+    template <typename ForwardIt>
+    AvlNode *build_sorted(ForwardIt &it, ForwardIt last, std::size_t n) {
+        if (0 == n) {
+            return nullptr;
+        }
+
+        auto left = build_sorted(it, last, n / 2);
+        AvlNode *node;
+        try {
+            node = create_node(*it, left);
+        } catch (...) {
+            if (left) {
+                makeEmpty(left);
+            }
+            throw;
+        }
+
+        try {
+            // a snapshot reader may throw here too
+            while (++it != last && !comp_(node->element_, *it)) {
+            }
+            node->right_ = build_sorted(it, last, n - n / 2 - 1);
+        } catch (...) {
+            makeEmpty(node);
+            throw;
+        }
+
+        change_height_and_balance(node);
+        return node;
+    }
+
+    AvlNode *clone(const AvlNode *node) {
         // clone()
         AvlNode *left = nullptr, *right = nullptr;
         if (node->left_) {
@@ -436,10 +1208,25 @@ class AvlTree {
             right = clone(node->right_);
         }
 
-        return new AvlNode(node->element_, left, right);
+        auto result = create_node(node->element_, left, right);
+        change_height_and_balance(result);
+        return result;
     }
 };
 
+template <typename Comparable, typename Allocator = std::allocator<Comparable>, typename Compare = std::less<Comparable>>
+using OrderStatisticTree = AvlTree<Comparable, 1, Allocator, OrderStatistics, Compare>;
+
+#if __cplusplus >= 201703L
+namespace pmr {
+
+template <typename Comparable, int ALLOWED_IMBALANCE = 1, typename Augment = NoAugment,
+          typename Compare = std::less<Comparable>>
+using AvlTree = tree::AvlTree<Comparable, ALLOWED_IMBALANCE, std::pmr::polymorphic_allocator<Comparable>, Augment, Compare>;
+
+}
+#endif
+
 }
 
 #endif
\ No newline at end of file
@@ -1,12 +1,33 @@
 #ifndef AVL_TREE_IMPL1_H_
 #define AVL_TREE_IMPL1_H_
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <exception>
 #include <iostream>
+#include <functional>
+#include <memory>
 #include <type_traits>
 #include <utility>
+#include <vector>
 #include <cassert>
 
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#endif
+#if __cplusplus > 201703L && __has_include(<span>)
+#include <span>
+#endif
+
+#include "batch_lookup.h"
+#include "bulk_build.h"
+#include "node_pool.h"
+#include "tree_compare.h"
+#include "tree_iterator.h"
+#include "tree_shape.h"
+#include "tree_stats.h"
+
 namespace tree {
 
 struct EmptyTree : public std::exception {
@@ -18,9 +39,19 @@ struct EmptyTree : public std::exception {
 template <typename T>
 using enable_if_t = typename std::enable_if<T::value>::type;
 
-template <typename Comparable, char ALLOWED_IMBALANCE = 1>
+// Stats is told about searches, rotations and allocations, see tree_stats.h.
+template <typename Comparable, char ALLOWED_IMBALANCE = 1, typename Allocator = std::allocator<Comparable>,
+          typename Compare = std::less<Comparable>, typename Stats = NoStats>
 class AvlTree {
+  public:
+    using allocator_type = Allocator;
+    using key_compare = Compare;
+
   private:
+    // reads the nodes directly, under its own validation
+    template <typename, typename>
+    friend class SeqlockAvlTree;
+
     struct AvlNode {
         Comparable element_;
         AvlNode *left_;
@@ -36,11 +67,150 @@ class AvlTree {
         {}
     };
 
+    using NodeAlloc = typename std::allocator_traits<Allocator>::template rebind_alloc<AvlNode>;
+    using NodeTraits = std::allocator_traits<NodeAlloc>;
+
+    KeyCompare<Compare> comp_;
+    NodeAlloc alloc_;
     AvlNode *root_;
 
   public:
+    using const_iterator = PathIterator<AvlNode, Comparable>;
+    using iterator = const_iterator;
+
     AvlTree() : root_(nullptr) {}
 
+    explicit AvlTree(const Allocator &alloc) : alloc_(alloc), root_(nullptr) {}
+
+    explicit AvlTree(const Compare &comp, const Allocator &alloc = Allocator())
+    : comp_(comp)
+    , alloc_(alloc)
+    , root_(nullptr)
+    {}
+
+    AvlTree(const AvlTree &other)
+    : comp_(other.comp_)
+    , alloc_(NodeTraits::select_on_container_copy_construction(other.alloc_))
+    , root_(nullptr)
+    {
+        if (other.root_) {
+            root_ = clone(other.root_);
+        }
+    }
+
+    AvlTree(const AvlTree &other, const Allocator &alloc)
+    : comp_(other.comp_)
+    , alloc_(alloc)
+    , root_(nullptr)
+    {
+        if (other.root_) {
+            root_ = clone(other.root_);
+        }
+    }
+
+    template <typename InputIt, typename = require_input_iterator<InputIt>>
+    AvlTree(InputIt first, InputIt last, const Allocator &alloc = Allocator())
+    : alloc_(alloc)
+    , root_(nullptr)
+    {
+        assign(first, last);
+    }
+
+    AvlTree(AvlTree &&other) : comp_(other.comp_), alloc_(other.alloc_), root_(other.root_) {
+        other.root_ = nullptr;
+    }
+
+    ~AvlTree() {
+        makeEmpty();
+    }
+
+    AvlTree &operator=(const AvlTree &other) {
+        if (this == &other) {
+            return *this;
+        }
+
+        makeEmpty();
+        comp_ = other.comp_;
+        if (other.root_) {
+            root_ = clone(other.root_);
+        }
+
+        return *this;
+    }
+
+    AvlTree &operator=(AvlTree &&other) {
+        move_assign(other, typename NodeTraits::propagate_on_container_move_assignment());
+        return *this;
+    }
+
+    Allocator get_allocator() const {
+        return Allocator(alloc_);
+    }
+
+    Compare key_comp() const {
+        return comp_.get();
+    }
+
+    const_iterator begin() const {
+        return const_iterator::first(root_);
+    }
+
+    const_iterator end() const noexcept {
+        return const_iterator(root_);
+    }
+
+    const_iterator find(const Comparable &e) const {
+        return find_key(e);
+    }
+
+    const_iterator lower_bound(const Comparable &e) const {
+        return const_iterator::lower_bound(root_, e, comp_);
+    }
+
+    const_iterator upper_bound(const Comparable &e) const {
+        return const_iterator::upper_bound(root_, e, comp_);
+    }
+
+    std::pair<const_iterator, const_iterator> equal_range(const Comparable &e) const {
+        return std::make_pair(lower_bound(e), upper_bound(e));
+    }
+
+    // Heterogeneous lookups, for transparent comparators only.
+    template <typename Key, typename C = Compare, typename = enable_if_t<is_transparent<C>>>
+    const_iterator find(const Key &e) const {
+        return find_key(e);
+    }
+
+    template <typename Key, typename C = Compare, typename = enable_if_t<is_transparent<C>>>
+    const_iterator lower_bound(const Key &e) const {
+        return const_iterator::lower_bound(root_, e, comp_);
+    }
+
+    template <typename Key, typename C = Compare, typename = enable_if_t<is_transparent<C>>>
+    const_iterator upper_bound(const Key &e) const {
+        return const_iterator::upper_bound(root_, e, comp_);
+    }
+
+    template <typename Key, typename C = Compare, typename = enable_if_t<is_transparent<C>>>
+    std::pair<const_iterator, const_iterator> equal_range(const Key &e) const {
+        return std::make_pair(lower_bound(e), upper_bound(e));
+    }
+
+    bool isEmpty() const noexcept {
+        return root_ == nullptr;
+    }
+
+    void makeEmpty() {
+        if (!root_) {
+            return;
+        }
+
+        if (!release_all()) {
+            makeEmpty(root_);
+        }
+        root_ = nullptr;
+    }
+
     const Comparable &findMin() const {
         if (!root_) {
             throw EmptyTree();
@@ -67,19 +237,36 @@ class AvlTree {
         return node->element_;
     }
 
-    bool contains(const Comparable &e) const noexcept {
-        auto node = root_;
-        while (node) {
-            if (e < node->element_) {
-                node = node->left_;
-            } else if (node->element_ < e) {
-                node = node->right_;
-            } else {
-                return true;
-            }
-        }
+    bool contains(const Comparable &e) const {
+        Stats::count(LOOKUPS);
+        return find_node(e) != nullptr;
+    }
 
-        return false;
+    template <typename Key, typename C = Compare, typename = enable_if_t<is_transparent<C>>>
+    bool contains(const Key &e) const {
+        Stats::count(LOOKUPS);
+        return find_node(e) != nullptr;
+    }
+
+    // Looks up keys[0, n) interleaved so that their cache misses overlap.
+    // Bit i of out_bitmap, which must hold (n + 63) / 64 words, is set if
+    // keys[i] is in the tree.
+    void contains_many(const Comparable *keys, std::size_t n, std::uint64_t *out_bitmap) const {
+        std::memset(out_bitmap, 0, (n + 63) / 64 * sizeof(std::uint64_t));
+        interleaved_search(root_, keys, n, comp_, [out_bitmap](std::size_t i, const AvlNode *) {
+            out_bitmap[i / 64] |= std::uint64_t(1) << (i % 64);
+        });
+    }
+
+    // Like contains_many(), but out[i] points at the stored element equal
+    // to keys[i], or is nullptr.
+    void find_many(const Comparable *keys, std::size_t n, const Comparable **out) const {
+        for (std::size_t i = 0; i < n; ++i) {
+            out[i] = nullptr;
+        }
+        interleaved_search(root_, keys, n, comp_, [out](std::size_t i, const AvlNode *node) {
+            out[i] = &node->element_;
+        });
     }
 
     void printTree(std::ostream &os = std::cout) const {
@@ -88,19 +275,50 @@ class AvlTree {
         }
     }
 
+    // Shape and memory of the tree, see tree_shape.h: O(n) and read-only,
+    // so it may run on a background thread as long as no one writes.
+    TreeShape stats() const {
+        auto child = [](const AvlNode *node, bool right) {
+            return right ? node->right_ : node->left_;
+        };
+        return measure_shape(root_, child, AllocationFootprint<NodeAlloc>::bytes(sizeof(AvlNode), alignof(AvlNode)));
+    }
+
+    // Replaces the contents with [first, last), which may be unsorted and
+    // contain duplicates. threads > 1 sorts in parallel, 0 uses all cores.
+    template <typename InputIt, typename = require_input_iterator<InputIt>>
+    void assign(InputIt first, InputIt last, unsigned threads = 1) {
+        std::vector<Comparable> elements(first, last);
+        sort_unique(elements, threads, comp_);
+        assign_sorted(std::make_move_iterator(elements.begin()), std::make_move_iterator(elements.end()));
+    }
+
+    // Replaces the contents with an ascending range in O(n), no rotations.
+    // Of several equivalent elements only the first is kept.
+    template <typename ForwardIt>
+    void assign_sorted(ForwardIt first, ForwardIt last) {
+        makeEmpty();
+        auto n = count_unique_sorted(first, last, comp_);
+        root_ = build_sorted(first, last, n);
+    }
+
     template <typename T, typename = enable_if_t<std::is_convertible<T, Comparable>>>
     void insert(T &&e) {
+        Stats::count(INSERTS);
         std::pair<AvlNode **, int> parents[128];
         parents[0].first = &root_;
 
         int index = 0;
         auto node = root_;
         while (node) {
-            if (node->element_ < e) {
+            Stats::count(STEPS);
+            Stats::count(COMPARISONS);
+            auto order = comp_.compare(e, node->element_);
+            if (order > 0) {
                 parents[index].second = 1;
                 parents[++index].first = &node->right_;
                 node = node->right_;
-            } else if (e < node->element_) {
+            } else if (order < 0) {
                 // parents[index++] = std::make_pair(&node->left_, -1);
                 parents[index].second = -1;
                 parents[++index].first = &node->left_;
@@ -110,7 +328,7 @@ class AvlTree {
             }
         };
 
-        *(parents[index].first) = new AvlNode(std::forward<T>(e));
+        *(parents[index].first) = create_node(std::forward<T>(e));
 
         // find insert place
         for (int i = index - 1; i >= 0; --i) {
@@ -146,6 +364,7 @@ class AvlTree {
     }
 
     void remove(const Comparable &e) {
+        Stats::count(REMOVES);
         std::pair<AvlNode **, int> parents[128];
         parents[0].first = &root_;
 
@@ -153,11 +372,14 @@ class AvlTree {
         auto node = root_;
         
         while (node) {
-            if (node->element_ < e) {
+            Stats::count(STEPS);
+            Stats::count(COMPARISONS);
+            auto order = comp_.compare(e, node->element_);
+            if (order > 0) {
                 parents[index].second = -1;
                 parents[++index].first = &node->right_;
                 node = node->right_;
-            } else if (e < node->element_) {
+            } else if (order < 0) {
                 // parents[index++] = std::make_pair(&node->left_, -1);
                 parents[index].second = 1;
                 parents[++index].first = &node->left_;
@@ -173,6 +395,7 @@ class AvlTree {
                     parents[++index].first = &node->right_;
                     node = node->right_;
                     while (node->left_) {
+                        Stats::count(STEPS);
                         parents[index].second = 1;
                         parents[++index].first = &node->left_;
                         node = node->left_;
@@ -183,7 +406,7 @@ class AvlTree {
 
                 auto delete_node = *(parents[index].first);
                 *(parents[index].first) = delete_node->left_ ? delete_node->left_ : delete_node->right_;
-                delete delete_node;
+                destroy_node(delete_node);
 
                 for (--index; index >= 0; --index) {
                     const auto &p_ref = parents[index];
@@ -199,31 +422,401 @@ class AvlTree {
                         temp->balance_ += p_ref.second;
                         if (temp->balance_ < -ALLOWED_IMBALANCE) {
                             assert((temp->left_->right_ || temp->left_->left_) && "111111111111111111111111111");
-                            if (temp->left_->balance_ <= 0) {
+                            if (0 == temp->left_->balance_) {
+                                // rotating over a balanced child keeps the height
+                                single_rorate_left_child(p_ref.first);
+                                return;
+                            } else if (temp->left_->balance_ < 0) {
                                 single_rorate_left_child(p_ref.first);
                             } else {
                                 double_rorate_left_child(p_ref.first);
                             }
-                            // break;
                         } else if (temp->balance_ > ALLOWED_IMBALANCE) {
                             assert((temp->right_->right_ || temp->right_->left_) && "222222222222222222222222222");
-                            if (temp->right_->balance_ >= 0) {
+                            if (0 == temp->right_->balance_) {
+                                single_rorate_right_child(p_ref.first);
+                                return;
+                            } else if (temp->right_->balance_ > 0) {
                                 single_rorate_right_child(p_ref.first);
                             } else {
                                 double_rorate_right_child(p_ref.first);
                             }
-                            // break;
+                        } else {
+                            // still within the allowed imbalance, height unchanged
+                            return;
                         }
                     }
                 }
+
+                return;
             }
         };
 
         return;
     }
 
+    // Inserts a whole batch in one descent: the sorted batch is split at
+    // every node on the way down, keys that fall off the tree become
+    // balanced subtrees, and every touched node is rebalanced once on the
+    // way back up by joining its two new subtrees.
+    template <typename InputIt, typename = require_input_iterator<InputIt>>
+    void insert_batch(InputIt first, InputIt last) {
+        std::vector<Comparable> batch(first, last);
+        sort_unique(batch, 1, comp_);
+        if (batch.empty()) {
+            return;
+        }
+
+        int height;
+        root_ = insert_batch(root_, height_of(root_), batch.data(), batch.data() + batch.size(), height);
+    }
+
+    template <typename InputIt, typename = require_input_iterator<InputIt>>
+    void erase_batch(InputIt first, InputIt last) {
+        std::vector<Comparable> batch(first, last);
+        sort_unique(batch, 1, comp_);
+        if (batch.empty()) {
+            return;
+        }
+
+        int height;
+        root_ = erase_batch(root_, height_of(root_), batch.data(), batch.data() + batch.size(), height);
+    }
+
+#if __cpp_lib_span >= 202002L
+    void insert_batch(std::span<const Comparable> batch) {
+        insert_batch(batch.begin(), batch.end());
+    }
+
+    void erase_batch(std::span<const Comparable> batch) {
+        erase_batch(batch.begin(), batch.end());
+    }
+#endif
+
   private:
+    template <typename... Args>
+    AvlNode *create_node(Args &&...args) {
+        Stats::count(ALLOCATIONS);
+        AvlNode *node = NodeTraits::allocate(alloc_, 1);
+        try {
+            NodeTraits::construct(alloc_, node, std::forward<Args>(args)...);
+        } catch (...) {
+            NodeTraits::deallocate(alloc_, node, 1);
+            throw;
+        }
+
+        return node;
+    }
+
+    void destroy_node(AvlNode *node) {
+        Stats::count(DEALLOCATIONS);
+        NodeTraits::destroy(alloc_, node);
+        NodeTraits::deallocate(alloc_, node, 1);
+    }
+
+    template <typename Key>
+    const AvlNode *find_node(const Key &e) const {
+        auto node = root_;
+        while (node) {
+            Stats::count(STEPS);
+            Stats::count(COMPARISONS);
+            auto order = comp_.compare(e, node->element_);
+            if (order < 0) {
+                node = node->left_;
+            } else if (order > 0) {
+                node = node->right_;
+            } else {
+                return node;
+            }
+        }
+
+        return nullptr;
+    }
+
+    template <typename Key>
+    const_iterator find_key(const Key &e) const {
+        auto it = lower_bound(e);
+        if (it != end() && comp_(e, *it)) {
+            return end();
+        }
+
+        return it;
+    }
+
+    void move_assign(AvlTree &other, std::true_type) {
+        using std::swap;
+        swap(comp_, other.comp_);
+        swap(alloc_, other.alloc_);
+        swap(root_, other.root_);
+    }
+
+    void move_assign(AvlTree &other, std::false_type) {
+        if (alloc_ == other.alloc_) {
+            std::swap(comp_, other.comp_);
+            std::swap(root_, other.root_);
+        } else {
+            // nodes can't change hands, copy them into our own allocator
+            *this = other;
+            other.makeEmpty();
+        }
+    }
+
+    template <typename A = NodeAlloc>
+    typename std::enable_if<has_try_release<A>::value, bool>::type release_all() {
+        return std::is_trivially_destructible<Comparable>::value && alloc_.try_release();
+    }
+
+    template <typename A = NodeAlloc>
+    typename std::enable_if<!has_try_release<A>::value, bool>::type release_all() {
+        return false;
+    }
+
+    void makeEmpty(AvlNode *node) {
+        if (node->left_) {
+            makeEmpty(node->left_);
+        }
+
+        if (node->right_) {
+            makeEmpty(node->right_);
+        }
+
+        destroy_node(node);
+    }
+
+    // Builds a perfectly balanced tree from the next n distinct elements
+    // and stores its height in height.
+    template <typename ForwardIt>
+    AvlNode *build_sorted(ForwardIt &it, ForwardIt last, std::size_t n, int &height) {
+        if (0 == n) {
+            height = -1;
+            return nullptr;
+        }
+
+        int height_left, height_right;
+        auto left = build_sorted(it, last, n / 2, height_left);
+        AvlNode *node;
+        try {
+            node = create_node(*it, left);
+        } catch (...) {
+            if (left) {
+                makeEmpty(left);
+            }
+            throw;
+        }
+
+        while (++it != last && !comp_(node->element_, *it)) {
+        }
+
+        try {
+            node->right_ = build_sorted(it, last, n - n / 2 - 1, height_right);
+        } catch (...) {
+            makeEmpty(node);
+            throw;
+        }
+
+        node->balance_ = static_cast<char>(height_right - height_left);
+        height = (height_left > height_right ? height_left : height_right) + 1;
+        return node;
+    }
+
+    template <typename ForwardIt>
+    AvlNode *build_sorted(ForwardIt &it, ForwardIt last, std::size_t n) {
+        int height;
+        return build_sorted(it, last, n, height);
+    }
+
+    static int height_of(const AvlNode *node) noexcept {
+        int height = -1;
+        while (node) {
+            ++height;
+            node = node->balance_ >= 0 ? node->right_ : node->left_;
+        }
+
+        return height;
+    }
+
+    static int left_height(const AvlNode *node, int height) noexcept {
+        return height - 1 - (node->balance_ > 0 ? node->balance_ : 0);
+    }
+
+    static int right_height(const AvlNode *node, int height) noexcept {
+        return height - 1 + (node->balance_ < 0 ? node->balance_ : 0);
+    }
+
+    // Joins left < node < right into one AVL subtree for any two heights,
+    // walking down the spine of the taller side. Returns the new root and
+    // its height in height.
+    AvlNode *join(AvlNode *left, int height_left, AvlNode *node, AvlNode *right, int height_right, int &height) {
+        if (height_left - height_right > ALLOWED_IMBALANCE) {
+            auto height_inner = right_height(left, height_left);
+            int height_joined;
+            auto joined = join(left->right_, height_inner, node, right, height_right, height_joined);
+            return attach_right(left, left_height(left, height_left), joined, height_joined, height);
+        } else if (height_right - height_left > ALLOWED_IMBALANCE) {
+            auto height_inner = left_height(right, height_right);
+            int height_joined;
+            auto joined = join(left, height_left, node, right->left_, height_inner, height_joined);
+            return attach_left(right, right_height(right, height_right), joined, height_joined, height);
+        }
+
+        node->left_ = left;
+        node->right_ = right;
+        node->balance_ = static_cast<char>(height_right - height_left);
+        height = (height_left > height_right ? height_left : height_right) + 1;
+        return node;
+    }
+
+    // Makes child the right subtree of node, whose left subtree has height
+    // height_left, rotating if the right side became too tall.
+    AvlNode *attach_right(AvlNode *node, int height_left, AvlNode *child, int height_child, int &height) {
+        node->right_ = child;
+        if (height_child - height_left <= ALLOWED_IMBALANCE) {
+            node->balance_ = static_cast<char>(height_child - height_left);
+            height = (height_left > height_child ? height_left : height_child) + 1;
+            return node;
+        }
+
+        auto height_outer = right_height(child, height_child);
+        auto height_inner = left_height(child, height_child);
+        if (height_outer >= height_inner) {
+            Stats::count(SINGLE_ROTATIONS);
+            int height_node;
+            node = attach_right(node, height_left, child->left_, height_inner, height_node);
+            child->left_ = node;
+            child->balance_ = static_cast<char>(height_outer - height_node);
+            height = (height_node > height_outer ? height_node : height_outer) + 1;
+            return child;
+        }
+
+        Stats::count(DOUBLE_ROTATIONS);
+        auto grand = child->left_;
+        auto height_grand_left = left_height(grand, height_inner);
+        auto height_grand_right = right_height(grand, height_inner);
+        int height_node, height_child_new;
+        node = attach_right(node, height_left, grand->left_, height_grand_left, height_node);
+        child->left_ = grand->right_;
+        child->balance_ = static_cast<char>(height_outer - height_grand_right);
+        height_child_new = (height_grand_right > height_outer ? height_grand_right : height_outer) + 1;
+        grand->left_ = node;
+        grand->right_ = child;
+        grand->balance_ = static_cast<char>(height_child_new - height_node);
+        height = (height_node > height_child_new ? height_node : height_child_new) + 1;
+        return grand;
+    }
+
+    AvlNode *attach_left(AvlNode *node, int height_right, AvlNode *child, int height_child, int &height) {
+        node->left_ = child;
+        if (height_child - height_right <= ALLOWED_IMBALANCE) {
+            node->balance_ = static_cast<char>(height_right - height_child);
+            height = (height_right > height_child ? height_right : height_child) + 1;
+            return node;
+        }
+
+        auto height_outer = left_height(child, height_child);
+        auto height_inner = right_height(child, height_child);
+        if (height_outer >= height_inner) {
+            Stats::count(SINGLE_ROTATIONS);
+            int height_node;
+            node = attach_left(node, height_right, child->right_, height_inner, height_node);
+            child->right_ = node;
+            child->balance_ = static_cast<char>(height_node - height_outer);
+            height = (height_node > height_outer ? height_node : height_outer) + 1;
+            return child;
+        }
+
+        Stats::count(DOUBLE_ROTATIONS);
+        auto grand = child->right_;
+        auto height_grand_left = left_height(grand, height_inner);
+        auto height_grand_right = right_height(grand, height_inner);
+        int height_node, height_child_new;
+        node = attach_left(node, height_right, grand->right_, height_grand_right, height_node);
+        child->right_ = grand->left_;
+        child->balance_ = static_cast<char>(height_grand_left - height_outer);
+        height_child_new = (height_grand_left > height_outer ? height_grand_left : height_outer) + 1;
+        grand->right_ = node;
+        grand->left_ = child;
+        grand->balance_ = static_cast<char>(height_node - height_child_new);
+        height = (height_node > height_child_new ? height_node : height_child_new) + 1;
+        return grand;
+    }
+
+    AvlNode *insert_batch(AvlNode *node, int node_height, Comparable *first, Comparable *last, int &height) {
+        if (first == last) {
+            height = node_height;
+            return node;
+        }
+
+        if (!node) {
+            auto it = std::make_move_iterator(first);
+            return build_sorted(it, std::make_move_iterator(last), static_cast<std::size_t>(last - first), height);
+        }
+
+        auto mid = std::lower_bound(first, last, node->element_, comp_);
+        auto right_first = (mid != last && !comp_(node->element_, *mid)) ? mid + 1 : mid;
+
+        int height_left, height_right;
+        auto left = insert_batch(node->left_, left_height(node, node_height), first, mid, height_left);
+        auto right = insert_batch(node->right_, right_height(node, node_height), right_first, last, height_right);
+        return join(left, height_left, node, right, height_right, height);
+    }
+
+    AvlNode *erase_batch(AvlNode *node, int node_height, const Comparable *first, const Comparable *last, int &height) {
+        if (!node || first == last) {
+            height = node_height;
+            return node;
+        }
+
+        auto mid = std::lower_bound(first, last, node->element_, comp_);
+        auto found = mid != last && !comp_(node->element_, *mid);
+
+        int height_left, height_right;
+        auto left = erase_batch(node->left_, left_height(node, node_height), first, mid, height_left);
+        auto right = erase_batch(node->right_, right_height(node, node_height), found ? mid + 1 : mid, last, height_right);
+        if (!found) {
+            return join(left, height_left, node, right, height_right, height);
+        }
+
+        destroy_node(node);
+        if (!right) {
+            height = height_left;
+            return left;
+        }
+
+        AvlNode *min;
+        right = remove_min(right, height_right, min, height_right);
+        return join(left, height_left, min, right, height_right, height);
+    }
+
+    // Unlinks the minimum of the subtree into min.
+    AvlNode *remove_min(AvlNode *node, int node_height, AvlNode *&min, int &height) {
+        if (!node->left_) {
+            min = node;
+            height = right_height(node, node_height);
+            return node->right_;
+        }
+
+        int height_left;
+        auto left = remove_min(node->left_, left_height(node, node_height), min, height_left);
+        return join(left, height_left, node, node->right_, right_height(node, node_height), height);
+    }
+
+    AvlNode *clone(const AvlNode *node) {
+        AvlNode *left = nullptr, *right = nullptr;
+        if (node->left_) {
+            left = clone(node->left_);
+        }
+
+        if (node->right_) {
+            right = clone(node->right_);
+        }
+
+        auto result = create_node(node->element_, left, right);
+        result->balance_ = node->balance_;
+        return result;
+    }
+
     void single_rorate_left_child(AvlNode **node) {
+        Stats::count(SINGLE_ROTATIONS);
         auto parent = *node;
         auto child = parent->left_;
         *node = child;
@@ -235,6 +828,7 @@ class AvlTree {
     }
 
     void single_rorate_right_child(AvlNode **node) {
+        Stats::count(SINGLE_ROTATIONS);
         auto parent = *node;
         auto child = parent->right_;
         *node = child;
@@ -246,6 +840,7 @@ class AvlTree {
     }
 
     void double_rorate_left_child(AvlNode **node) {
+        Stats::count(DOUBLE_ROTATIONS);
         auto result_right = *node;
         auto result_left = result_right->left_;
         *node = result_left->right_;
@@ -274,6 +869,7 @@ class AvlTree {
     }
 
     void double_rorate_right_child(AvlNode **node) {
+        Stats::count(DOUBLE_ROTATIONS);
         auto result_left = *node;
         auto result_right = result_left->right_;
         *node = result_right->left_;
@@ -317,6 +913,15 @@ class AvlTree {
 // template <typename T>
 // void AvlTree<T, 1>::single_rorate_left_child(typename AvlTree<T, 1>::AvlNode **node) {}
 
+#if __cplusplus >= 201703L
+namespace pmr {
+
+template <typename Comparable, char ALLOWED_IMBALANCE = 1, typename Compare = std::less<Comparable>>
+using AvlTree = tree::AvlTree<Comparable, ALLOWED_IMBALANCE, std::pmr::polymorphic_allocator<Comparable>, Compare>;
+
+}
+#endif
+
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,76 @@
+#ifndef BATCH_LOOKUP_H_
+#define BATCH_LOOKUP_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tree {
+
+// Lookups interleaved per batch. More than this rarely helps: the core
+// only tracks a limited number of outstanding cache misses.
+constexpr std::size_t LOOKUP_GROUP = 16;
+
+inline void prefetch(const void *p) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p);
+#else
+    (void)p;
+#endif
+}
+
+// Searches keys[0, n) in lock-step, GROUP at a time. Every step advances
+// each search by one level and prefetches the child it will read next, so
+// the cache misses of different searches overlap instead of queueing up
+// behind each other. A finished slot takes the next key right away.
+// found(i, node) is called for every key that is present. comp is a
+// KeyCompare: one compare() per node, so a three-way comparator is called
+// once per step.
+template <std::size_t GROUP = LOOKUP_GROUP, typename Node, typename Key, typename Compare, typename Found>
+void interleaved_search(const Node *root, const Key *keys, std::size_t n, const Compare &comp, Found found) {
+    struct Slot {
+        const Node *node_;
+        std::size_t index_;
+    };
+
+    if (!root) {
+        return;
+    }
+
+    Slot slots[GROUP];
+    std::size_t live = 0, next = 0;
+    for (; live < GROUP && next < n; ++live, ++next) {
+        slots[live] = Slot{root, next};
+    }
+
+    while (live) {
+        for (std::size_t j = 0; j < live;) {
+            auto &slot = slots[j];
+            auto node = slot.node_;
+            const auto &key = keys[slot.index_];
+            auto order = comp.compare(key, node->element_);
+            if (order > 0) {
+                node = node->right_;
+            } else if (order < 0) {
+                node = node->left_;
+            } else {
+                found(slot.index_, node);
+                node = nullptr;
+            }
+
+            if (node) {
+                prefetch(node);
+                slot.node_ = node;
+                ++j;
+            } else if (next < n) {
+                slot = Slot{root, next++};
+                ++j;
+            } else {
+                slot = slots[--live];
+            }
+        }
+    }
+}
+
+}
+
+#endif // BATCH_LOOKUP_H_
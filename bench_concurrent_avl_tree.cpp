@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "avl_tree.h"
+#include "concurrent_avl_tree.h"
+
+using namespace std;
+using namespace tree;
+
+// AvlTree behind one mutex, the baseline a concurrent tree has to beat
+class LockedAvlTree {
+  public:
+    bool contains(int e) const {
+        lock_guard<mutex> lock(mutex_);
+        return t_.contains(e);
+    }
+
+    void insert(int e) {
+        lock_guard<mutex> lock(mutex_);
+        t_.insert(e);
+    }
+
+    void remove(int e) {
+        lock_guard<mutex> lock(mutex_);
+        t_.remove(e);
+    }
+
+  private:
+    mutable mutex mutex_;
+    AvlTree<int> t_;
+};
+
+// xorshift, every thread draws its own keys without sharing state
+struct Random {
+    uint64_t state_;
+
+    explicit Random(uint64_t seed) : state_(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+    uint32_t next() {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 7;
+        state_ ^= state_ << 17;
+        return static_cast<uint32_t>(state_ >> 32);
+    }
+};
+
+// Runs threads doing READ_PERCENT contains, the rest split between insert
+// and remove, for the given time; returns operations per second.
+template <typename Tree>
+double run(Tree &t, int threads, int keys, int read_percent, double seconds) {
+    atomic<bool> start(false), stop(false);
+    vector<uint64_t> counts(threads * 8, 0);
+    atomic<uint64_t> hits(0);
+    vector<thread> workers;
+
+    for (int id = 0; id < threads; ++id) {
+        workers.emplace_back([&, id] {
+            Random random(id + 1);
+            uint64_t ops = 0, found = 0;
+            while (!start.load()) {
+                this_thread::yield();
+            }
+            while (!stop.load(memory_order_relaxed)) {
+                for (int i = 0; i < 64; ++i) {
+                    auto r = random.next();
+                    int key = static_cast<int>(r % keys);
+                    int dice = static_cast<int>((r >> 24) % 100);
+                    if (dice < read_percent) {
+                        // counted, so the search can't be optimized away
+                        found += t.contains(key);
+                    } else if (dice & 1) {
+                        t.insert(key);
+                    } else {
+                        t.remove(key);
+                    }
+                }
+                ops += 64;
+            }
+            // one slot per cache line
+            counts[id * 8] = ops;
+            hits += found;
+        });
+    }
+
+    auto begin = chrono::steady_clock::now();
+    start.store(true);
+    this_thread::sleep_for(chrono::duration<double>(seconds));
+    stop.store(true);
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    auto elapsed = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    uint64_t total = 0;
+    for (auto count : counts) {
+        total += count;
+    }
+    return total / elapsed;
+}
+
+template <typename Tree>
+void prefill(Tree &t, int keys) {
+    // half the key range, in an order that keeps the plain tree balanced;
+    // GAP steps around a range it is coprime to, which every key below
+    // keys is part of
+    const int64_t GAP = 37;
+    int64_t m = keys % GAP ? keys : keys + 1;
+    int64_t i = GAP % m;
+    do {
+        if (i < keys && i % 2 == 0) {
+            t.insert(static_cast<int>(i));
+        }
+        i = (i + GAP) % m;
+    } while (i != GAP % m);
+}
+
+    // Throughput benchmark: bench_concurrent_avl_tree [threads [seconds [keys [read%]]]]
+int main(int argc, char *argv[])
+{
+    int max_threads = argc > 1 ? atoi(argv[1]) : static_cast<int>(thread::hardware_concurrency());
+    double seconds = argc > 2 ? atof(argv[2]) : 1.0;
+    int keys = argc > 3 ? atoi(argv[3]) : 1000000;
+    int read_percent = argc > 4 ? atoi(argv[4]) : 100;
+    if (keys < 1) {
+        cerr << "usage: " << argv[0] << " [threads [seconds [keys [read%]]]]" << endl;
+        return 1;
+    }
+    if (max_threads < 1) {
+        max_threads = 1;
+    }
+
+    cout << "keys " << keys << ", " << read_percent << "% contains, " << thread::hardware_concurrency()
+         << " hardware threads" << endl;
+    cout << "threads\tconcurrent ops/s\tscaling\tlocked ops/s\tscaling" << endl;
+
+    ConcurrentAvlTree<int> concurrent;
+    LockedAvlTree locked;
+    prefill(concurrent, keys);
+    prefill(locked, keys);
+
+    double concurrent_base = 0, locked_base = 0;
+    for (int threads = 1;; threads = min(threads * 2, max_threads)) {
+        auto c = run(concurrent, threads, keys, read_percent, seconds);
+        auto l = run(locked, threads, keys, read_percent, seconds);
+        if (1 == threads) {
+            concurrent_base = c;
+            locked_base = l;
+        }
+
+        cout << threads << '\t' << static_cast<uint64_t>(c) << '\t' << c / concurrent_base << '\t'
+             << static_cast<uint64_t>(l) << '\t' << l / locked_base << endl;
+        if (threads == max_threads) {
+            break;
+        }
+    }
+
+    return 0;
+}
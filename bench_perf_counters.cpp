@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+// avl_tree.h and avl_tree_impl1.h both define tree::AvlTree; build with
+// -DBENCH_AVL_IMPL1 for the rows of the second one.
+#ifdef BENCH_AVL_IMPL1
+#include "avl_tree_impl1.h"
+#define AVL_NAME "avl_tree_impl1"
+#else
+#include "avl_tree.h"
+#define AVL_NAME "avl_tree"
+#endif
+#include "binary_search_tree.h"
+#include "btree.h"
+#include "compact_avl_tree.h"
+#include "frozen_set.h"
+#include "perf_counters.h"
+#include "persistent_avl_tree.h"
+
+using namespace std;
+using namespace tree;
+
+// The tree holds the even keys below 2 * keys. Lookups hit and miss half
+// the time each, inserts add odd keys and removes take even ones, so no
+// operation is ever a no-op and BinarySearchTree stays quiet.
+struct Batches {
+    vector<int> lookups;
+    vector<int> inserts;
+    vector<int> removes;
+};
+
+static Batches make_batches(int keys, int batch) {
+    mt19937 random(42);
+    Batches b;
+    for (int i = 0; i < batch; ++i) {
+        b.lookups.push_back(static_cast<int>(random() % (2u * keys)));
+    }
+
+    vector<int> odd, even;
+    for (int i = 0; i < keys; ++i) {
+        odd.push_back(2 * i + 1);
+        even.push_back(2 * i);
+    }
+    shuffle(odd.begin(), odd.end(), random);
+    shuffle(even.begin(), even.end(), random);
+    b.inserts.assign(odd.begin(), odd.begin() + min(batch, keys));
+    b.removes.assign(even.begin(), even.begin() + min(batch, keys));
+    return b;
+}
+
+struct StdSet : std::set<int> {
+    bool contains(int e) const {
+        return count(e) != 0;
+    }
+
+    void remove(int e) {
+        erase(e);
+    }
+};
+
+// one row: events per operation, n/a where a counter isn't available
+static void report(const char *tree, const char *op, size_t ops, double seconds, const PerfReading &reading) {
+    printf("%-20s %-8s %9.1f", tree, op, seconds * 1e9 / ops);
+    for (int i = 0; i < PERF_EVENTS; ++i) {
+        auto e = static_cast<PerfEvent>(i);
+        if (reading.available(e)) {
+            printf(" %12.2f", reading[e] / ops);
+        } else {
+            printf(" %12s", "n/a");
+        }
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+template <typename F>
+static void profile(PerfCounters &counters, const char *tree, const char *op, size_t ops, F &&f) {
+    auto begin = chrono::steady_clock::now();
+    auto reading = counters.measure(f);
+    auto seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    report(tree, op, ops, seconds, reading);
+}
+
+// Builds the tree in random order, then profiles a batch of each
+// operation on it.
+template <typename Tree>
+static void run(PerfCounters &counters, const char *tree, const vector<int> &shuffled, const Batches &b) {
+    Tree t;
+    for (auto e : shuffled) {
+        t.insert(e);
+    }
+
+    size_t hits = 0;
+    profile(counters, tree, "contains", b.lookups.size(), [&] {
+        for (auto e : b.lookups) {
+            hits += t.contains(e);
+        }
+    });
+    if (hits > b.lookups.size()) {
+        printf("Lookup error!\n");
+    }
+
+    profile(counters, tree, "insert", b.inserts.size(), [&] {
+        for (auto e : b.inserts) {
+            t.insert(e);
+        }
+    });
+    profile(counters, tree, "remove", b.removes.size(), [&] {
+        for (auto e : b.removes) {
+            t.remove(e);
+        }
+    });
+}
+
+// read-only layouts, built from the sorted keys
+template <typename Set>
+static void run_frozen(PerfCounters &counters, const char *tree, int keys, const Batches &b) {
+    vector<int> sorted;
+    for (int i = 0; i < keys; ++i) {
+        sorted.push_back(2 * i);
+    }
+    Set s(sorted.begin(), sorted.end());
+
+    size_t hits = 0;
+    profile(counters, tree, "contains", b.lookups.size(), [&] {
+        for (auto e : b.lookups) {
+            hits += s.contains(e);
+        }
+    });
+    if (hits > b.lookups.size()) {
+        printf("Lookup error!\n");
+    }
+}
+
+    // Hardware counter profile: bench_perf_counters [keys [batch]]
+int main(int argc, char *argv[])
+{
+    int keys = argc > 1 ? atoi(argv[1]) : 1000000;
+    int batch = argc > 2 ? atoi(argv[2]) : 1000000;
+    if (keys < 1 || batch < 1) {
+        fprintf(stderr, "usage: %s [keys [batch]]\n", argv[0]);
+        return 1;
+    }
+
+    PerfCounters counters;
+    if (!counters.any()) {
+        fprintf(stderr, "no hardware counters (%s), only times are measured\n", strerror(counters.error()));
+    }
+
+    vector<int> shuffled;
+    for (int i = 0; i < keys; ++i) {
+        shuffled.push_back(2 * i);
+    }
+    shuffle(shuffled.begin(), shuffled.end(), mt19937(7));
+    auto b = make_batches(keys, batch);
+
+    printf("keys %d, per operation:\n%-20s %-8s %9s", keys, "tree", "op", "ns");
+    for (int i = 0; i < PERF_EVENTS; ++i) {
+        printf(" %12s", perf_event_name(static_cast<PerfEvent>(i)));
+    }
+    printf("\n");
+
+    run<AvlTree<int>>(counters, AVL_NAME, shuffled, b);
+#ifndef BENCH_AVL_IMPL1
+    run<BinarySearchTree<int>>(counters, "binary_search_tree", shuffled, b);
+    run<CompactAvlTree<int>>(counters, "compact_avl_tree", shuffled, b);
+    run<PersistentAvlTree<int>>(counters, "persistent_avl_tree", shuffled, b);
+    run<BTree<int>>(counters, "btree", shuffled, b);
+    run_frozen<EytzingerSet<int>>(counters, "eytzinger_set", keys, b);
+    run_frozen<VebSet<int>>(counters, "veb_set", keys, b);
+#endif
+    run<StdSet>(counters, "std_set", shuffled, b);
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "avl_tree.h"
+
+using namespace std;
+using namespace tree;
+
+using Tree = AvlTree<int>;
+
+// keys * step for the first keys multiples of step, built balanced
+Tree multiples(int keys, int step) {
+    vector<int> elements;
+    elements.reserve(keys);
+    for (int i = 0; i < keys; ++i) {
+        elements.push_back(i * step);
+    }
+
+    Tree t;
+    t.assign_sorted(elements.begin(), elements.end());
+    return t;
+}
+
+// Times one set operation on copies of a and b; checks the result size.
+template <typename Op>
+double run(const Tree &a, const Tree &b, size_t expected, Op op) {
+    Tree x(a), y(b);
+    auto begin = chrono::steady_clock::now();
+    op(x, std::move(y));
+    auto elapsed = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    size_t size = 0;
+    for (auto it = x.begin(); it != x.end(); ++it) {
+        ++size;
+    }
+    if (size != expected) {
+        cout << "Size error!" << endl;
+    }
+    return elapsed;
+}
+
+    // Set operation benchmark: bench_set_operations [threads [keys]]
+int main(int argc, char *argv[])
+{
+    int max_threads = argc > 1 ? atoi(argv[1]) : static_cast<int>(thread::hardware_concurrency());
+    int keys = argc > 2 ? atoi(argv[2]) : 10000000;
+    if (max_threads < 1) {
+        max_threads = 1;
+    }
+
+    // multiples of 2 and 3, a third of the smaller set is in both
+    auto a = multiples(keys, 2);
+    auto b = multiples(keys, 3);
+    size_t both = (static_cast<size_t>(keys) * 2 - 1) / 6 + 1;
+
+    cout << "keys " << keys << " per tree, " << thread::hardware_concurrency() << " hardware threads" << endl;
+    cout << "threads\tunion s\tspeedup\tintersect s\tspeedup\tdifference s\tspeedup" << endl;
+
+    double base[3] = {0, 0, 0};
+    for (int threads = 1;; threads = min(threads * 2, max_threads)) {
+        ThreadPool pool(threads);
+        double seconds[3] = {
+            run(a, b, 2 * keys - both, [&](Tree &x, Tree &&y) { x.union_with(std::move(y), pool); }),
+            run(a, b, both, [&](Tree &x, Tree &&y) { x.intersect_with(std::move(y), pool); }),
+            run(a, b, keys - both, [&](Tree &x, Tree &&y) { x.difference_with(std::move(y), pool); }),
+        };
+
+        cout << threads;
+        for (int i = 0; i < 3; ++i) {
+            if (1 == threads) {
+                base[i] = seconds[i];
+            }
+            cout << '\t' << seconds[i] << '\t' << base[i] / seconds[i];
+        }
+        cout << endl;
+
+        if (threads == max_threads) {
+            break;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,472 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#if defined(__GLIBC__) || defined(__linux__)
+#include <malloc.h>
+#endif
+
+// avl_tree.h and avl_tree_impl1.h both define tree::AvlTree, so they can't
+// share a program; build this file once plain and once with
+// -DBENCH_AVL_IMPL1 and append both outputs to the same CSV, the second
+// run with --no-header:
+//
+//   ./bench_trees > trees.csv && ./bench_trees_impl1 --no-header >> trees.csv
+#ifdef BENCH_AVL_IMPL1
+#include "avl_tree_impl1.h"
+#define AVL_NAME "avl_tree_impl1"
+#else
+#include "avl_tree.h"
+#include "binary_search_tree.h"
+#define AVL_NAME "avl_tree"
+#endif
+
+using namespace std;
+using namespace tree;
+
+// Bytes the trees hold, node headers of malloc included where it says.
+static size_t live_bytes = 0;
+
+template <typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    CountingAllocator() = default;
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        auto p = static_cast<T *>(::operator new(n * sizeof(T)));
+        live_bytes += footprint(p, n);
+        return p;
+    }
+
+    void deallocate(T *p, size_t n) noexcept {
+        live_bytes -= footprint(p, n);
+        ::operator delete(p);
+    }
+
+    static size_t footprint(T *p, size_t n) noexcept {
+#if defined(__GLIBC__)
+        (void)n;
+        // the usable chunk plus its size word
+        return malloc_usable_size(p) + sizeof(size_t);
+#else
+        (void)p;
+        return n * sizeof(T);
+#endif
+    }
+
+    template <typename U>
+    bool operator==(const CountingAllocator<U> &) const noexcept {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const CountingAllocator<U> &) const noexcept {
+        return false;
+    }
+};
+
+template <typename Key>
+struct StdSet : std::set<Key, std::less<Key>, CountingAllocator<Key>> {
+    bool contains(const Key &e) const {
+        return this->count(e) != 0;
+    }
+
+    void remove(const Key &e) {
+        this->erase(e);
+    }
+};
+
+// xorshift, the same stream on every machine
+struct Random {
+    uint64_t state_;
+
+    explicit Random(uint64_t seed) : state_(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+    uint64_t next() {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 7;
+        state_ ^= state_ << 17;
+        return state_;
+    }
+
+    // uniform in [0, n)
+    uint64_t below(uint64_t n) {
+        return next() % n;
+    }
+
+    double unit() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+};
+
+// Zipfian ranks in [0, n) with skew theta, as in YCSB (Gray et al.,
+// "Quickly generating billion-record synthetic databases"): O(n) setup,
+// O(1) memory and time per draw.
+class Zipf {
+  public:
+    Zipf(uint64_t n, double theta) : n_(n), theta_(theta) {
+        double zeta2 = 0;
+        zetan_ = 0;
+        for (uint64_t i = 1; i <= n; ++i) {
+            zetan_ += 1 / pow(static_cast<double>(i), theta);
+            if (2 == i) {
+                zeta2 = zetan_;
+            }
+        }
+        alpha_ = 1 / (1 - theta);
+        eta_ = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan_);
+    }
+
+    uint64_t next(Random &random) const {
+        double u = random.unit();
+        double uz = u * zetan_;
+        if (uz < 1) {
+            return 0;
+        }
+        if (uz < 1 + pow(0.5, theta_)) {
+            return 1;
+        }
+        auto rank = static_cast<uint64_t>(n_ * pow(eta_ * u - eta_ + 1, alpha_));
+        return rank < n_ ? rank : n_ - 1;
+    }
+
+  private:
+    uint64_t n_;
+    double theta_, zetan_, alpha_, eta_;
+};
+
+// Keys are drawn from a universe of 2n ascending keys by index.
+template <typename Key>
+struct Keys;
+
+template <>
+struct Keys<int> {
+    static const char *name() {
+        return "int";
+    }
+
+    static int make(uint64_t i) {
+        return static_cast<int>(i);
+    }
+};
+
+template <>
+struct Keys<uint64_t> {
+    static const char *name() {
+        return "u64";
+    }
+
+    // spread out, so the high bytes matter too
+    static uint64_t make(uint64_t i) {
+        return i * 0x100000001ull;
+    }
+};
+
+template <>
+struct Keys<string> {
+    static const char *name() {
+        return "string15";
+    }
+
+    // 15 characters, short enough for every std::string to keep inline
+    static string make(uint64_t i) {
+        char buf[24];
+        snprintf(buf, sizeof(buf), "k%014llu", static_cast<unsigned long long>(i));
+        return buf;
+    }
+};
+
+enum Op : uint64_t { INSERT, REMOVE, CONTAINS };
+
+// A workload: untimed prefill, then the timed operations, each an op in
+// the top two bits and a key index below. Inserts only ever add absent
+// keys and removes take present ones, so every tree does the same work.
+struct Workload {
+    vector<uint64_t> prefill;
+    vector<uint64_t> ops;
+    size_t final_size;
+    bool ordered;
+};
+
+static uint64_t op(Op o, uint64_t index) {
+    return (static_cast<uint64_t>(o) << 62) | index;
+}
+
+// Present and absent key indices, both pickable at random in O(1).
+class KeyPool {
+  public:
+    explicit KeyPool(uint64_t universe) : slot_(universe) {
+        for (uint64_t i = 0; i < universe; ++i) {
+            slot_[i] = absent_.size();
+            absent_.push_back(i);
+        }
+    }
+
+    void add(uint64_t i) {
+        move(i, absent_, present_);
+    }
+
+    void remove(uint64_t i) {
+        move(i, present_, absent_);
+    }
+
+    uint64_t random_absent(Random &random) const {
+        return absent_[random.below(absent_.size())];
+    }
+
+    uint64_t random_present(Random &random) const {
+        return present_[random.below(present_.size())];
+    }
+
+    size_t size() const {
+        return present_.size();
+    }
+
+  private:
+    vector<uint64_t> slot_;
+    vector<uint64_t> present_, absent_;
+
+    void move(uint64_t i, vector<uint64_t> &from, vector<uint64_t> &to) {
+        auto at = slot_[i];
+        slot_[from.back()] = at;
+        from[at] = from.back();
+        from.pop_back();
+        slot_[i] = to.size();
+        to.push_back(i);
+    }
+};
+
+static const char *const WORKLOADS[] = {"sequential", "random",       "gap",  "zipf",
+                                        "insert_heavy", "delete_heavy", "mixed"};
+
+static Workload make_workload(const string &name, uint64_t n) {
+    Workload w;
+    w.ordered = false;
+    Random random(n * 131 + name.size());
+    KeyPool pool(2 * n);
+
+    auto fill = [&](uint64_t count) {
+        for (uint64_t j = 0; j < count; ++j) {
+            auto i = pool.random_absent(random);
+            pool.add(i);
+            w.prefill.push_back(op(INSERT, i));
+        }
+    };
+
+    if ("sequential" == name) {
+        w.ordered = true;
+        for (uint64_t i = 0; i < n; ++i) {
+            w.ops.push_back(op(INSERT, 2 * i));
+        }
+        w.final_size = n;
+        return w;
+    }
+
+    if ("random" == name) {
+        for (uint64_t i = 0; i < n; ++i) {
+            w.ops.push_back(op(INSERT, 2 * i));
+        }
+        for (uint64_t i = n; i > 1; --i) {
+            swap(w.ops[i - 1], w.ops[random.below(i)]);
+        }
+        w.final_size = n;
+        return w;
+    }
+
+    if ("gap" == name) {
+        // the test drivers' order, runs of ascending keys
+        const uint64_t GAP = 37;
+        w.ordered = true;
+        uint64_t m = n % GAP ? n : n + 1;
+        for (uint64_t i = GAP % m; w.ops.size() < n; i = (i + GAP) % m) {
+            if (i < n) {
+                w.ops.push_back(op(INSERT, 2 * i));
+            }
+        }
+        w.final_size = n;
+        return w;
+    }
+
+    if ("zipf" == name) {
+        fill(n);
+        Zipf zipf(n, 0.99);
+        for (uint64_t j = 0; j < n; ++j) {
+            // scrambled, so the hot keys are spread over the tree
+            auto rank = zipf.next(random);
+            w.ops.push_back(op(CONTAINS, (rank * 0x9E3779B97F4A7C15ull) % (2 * n)));
+        }
+        w.final_size = n;
+        return w;
+    }
+
+    int insert_percent, remove_percent;
+    if ("insert_heavy" == name) {
+        fill(n / 2);
+        insert_percent = 90;
+        remove_percent = 0;
+    } else if ("delete_heavy" == name) {
+        fill(n);
+        insert_percent = 0;
+        remove_percent = 90;
+    } else {
+        fill(n / 2);
+        insert_percent = 25;
+        remove_percent = 25;
+    }
+
+    for (uint64_t j = 0; j < n; ++j) {
+        auto dice = static_cast<int>(random.below(100));
+        if (dice < insert_percent && pool.size() < 2 * n) {
+            auto i = pool.random_absent(random);
+            pool.add(i);
+            w.ops.push_back(op(INSERT, i));
+        } else if (dice < insert_percent + remove_percent && pool.size() > 0) {
+            auto i = pool.random_present(random);
+            pool.remove(i);
+            w.ops.push_back(op(REMOVE, i));
+        } else {
+            w.ops.push_back(op(CONTAINS, random.below(2 * n)));
+        }
+    }
+    w.final_size = pool.size();
+    return w;
+}
+
+template <typename Tree, typename Key>
+static bool apply(Tree &t, const vector<Key> &keys, uint64_t o) {
+    const auto &key = keys[o & ((uint64_t(1) << 62) - 1)];
+    switch (static_cast<Op>(o >> 62)) {
+    case INSERT:
+        t.insert(key);
+        return true;
+    case REMOVE:
+        t.remove(key);
+        return true;
+    default:
+        return t.contains(key);
+    }
+}
+
+// Runs the workload on fresh trees until at least min_ops operations were
+// timed, every 16th also on its own for the latency percentiles, and
+// prints one CSV row.
+template <typename Tree, typename Key>
+static void run(const char *tree, const string &workload, const Workload &w, const vector<Key> &keys,
+                uint64_t n, uint64_t min_ops) {
+    vector<double> samples;
+    double seconds = 0;
+    uint64_t ops = 0, hits = 0;
+    double bytes_per_key = 0;
+
+    do {
+        auto before = live_bytes;
+        {
+            Tree t;
+            for (auto o : w.prefill) {
+                apply(t, keys, o);
+            }
+
+            auto begin = chrono::steady_clock::now();
+            for (size_t j = 0; j < w.ops.size(); ++j) {
+                if (j % 16) {
+                    hits += apply(t, keys, w.ops[j]);
+                } else {
+                    auto op_begin = chrono::steady_clock::now();
+                    hits += apply(t, keys, w.ops[j]);
+                    samples.push_back(chrono::duration<double, nano>(chrono::steady_clock::now() - op_begin).count());
+                }
+            }
+            seconds += chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+            ops += w.ops.size();
+
+            bytes_per_key = w.final_size ? static_cast<double>(live_bytes - before) / w.final_size : 0;
+        }
+    } while (ops < min_ops);
+
+    auto percentile = [&samples](double p) {
+        auto at = samples.begin() + static_cast<ptrdiff_t>(p * (samples.size() - 1));
+        nth_element(samples.begin(), at, samples.end());
+        return *at;
+    };
+
+    // hits keeps the lookups from being optimized away
+    printf("%s,%s,%llu,%s,%llu,%.0f,%.1f,%.1f,%.1f,%llu\n", tree, Keys<Key>::name(),
+           static_cast<unsigned long long>(n), workload.c_str(), static_cast<unsigned long long>(ops),
+           ops / seconds, percentile(0.5), percentile(0.99), bytes_per_key, static_cast<unsigned long long>(hits));
+    fflush(stdout);
+}
+
+template <typename Key>
+static void sweep(uint64_t max_keys, const string &only_workload) {
+    for (uint64_t n = 1000; n <= max_keys; n *= 10) {
+        vector<Key> keys;
+        keys.reserve(2 * n);
+        for (uint64_t i = 0; i < 2 * n; ++i) {
+            keys.push_back(Keys<Key>::make(i));
+        }
+
+        // small trees run several rounds for a stable figure
+        const uint64_t MIN_OPS = 1000000;
+        for (auto name : WORKLOADS) {
+            if (!only_workload.empty() && only_workload != name) {
+                continue;
+            }
+
+            auto w = make_workload(name, n);
+            run<AvlTree<Key, 1, CountingAllocator<Key>>>(AVL_NAME, name, w, keys, n, MIN_OPS);
+#ifndef BENCH_AVL_IMPL1
+            // sorted input turns it into a list, quadratic and as deep as
+            // the recursion of its insert
+            if (!w.ordered || n <= 10000) {
+                run<BinarySearchTree<Key, CountingAllocator<Key>>>("binary_search_tree", name, w, keys, n,
+                                                                   MIN_OPS);
+            }
+#endif
+            run<StdSet<Key>>("std_set", name, w, keys, n, MIN_OPS);
+        }
+    }
+}
+
+    // Tree benchmark: bench_trees [--no-header] [max_keys [key_type [workload]]]
+    // key_type is int, u64, string15 or all; the output is CSV, its header
+    // row left out with --no-header.
+int main(int argc, char *argv[])
+{
+    bool header = !(argc > 1 && 0 == strcmp(argv[1], "--no-header"));
+    if (!header) {
+        --argc;
+        ++argv;
+    }
+
+    uint64_t max_keys = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    string key_type = argc > 2 ? argv[2] : "all";
+    string workload = argc > 3 ? argv[3] : "";
+
+    if (header) {
+        printf("tree,key,keys,workload,ops,ops_per_s,p50_ns,p99_ns,bytes_per_key,hits\n");
+    }
+    if ("all" == key_type || "int" == key_type) {
+        sweep<int>(max_keys, workload);
+    }
+    if ("all" == key_type || "u64" == key_type) {
+        sweep<uint64_t>(max_keys, workload);
+    }
+    if ("all" == key_type || "string15" == key_type) {
+        sweep<string>(max_keys, workload);
+    }
+
+    return 0;
+}
@@ -3,6 +3,19 @@
 
 #include <iostream>
 #include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#endif
+
+#include "bulk_build.h"
+#include "tree_compare.h"
+#include "tree_serialize.h"
+#include "tree_shape.h"
 
 namespace tree {
 
@@ -13,33 +26,184 @@ struct UnderflowException : public std::exception {
     }
 };
 
-template <typename Comparable>
+template <typename Comparable, typename Allocator = std::allocator<Comparable>, typename Compare = std::less<Comparable>>
 class BinarySearchTree {
+  private:
+    struct BinaryNode;
+
   public:
+    using allocator_type = Allocator;
+    using key_compare = Compare;
+
+    // Walks the parent links, so a scan of k elements costs O(depth + k)
+    // and needs no stack however degenerate the tree is.
+    class const_iterator {
+      public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = Comparable;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Comparable *;
+        using reference = const Comparable &;
+
+        const_iterator() : node_(nullptr), root_(nullptr) {}
+
+        reference operator*() const {
+            return node_->element_;
+        }
+
+        pointer operator->() const {
+            return &node_->element_;
+        }
+
+        const_iterator &operator++() {
+            if (node_->right_) {
+                node_ = node_->right_;
+                while (node_->left_) {
+                    node_ = node_->left_;
+                }
+            } else {
+                auto child = node_;
+                node_ = node_->parent_;
+                while (node_ && node_->right_ == child) {
+                    child = node_;
+                    node_ = node_->parent_;
+                }
+            }
+
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            auto result = *this;
+            ++*this;
+            return result;
+        }
+
+        const_iterator &operator--() {
+            if (!node_) {
+                node_ = root_;
+                while (node_->right_) {
+                    node_ = node_->right_;
+                }
+            } else if (node_->left_) {
+                node_ = node_->left_;
+                while (node_->right_) {
+                    node_ = node_->right_;
+                }
+            } else {
+                auto child = node_;
+                node_ = node_->parent_;
+                while (node_ && node_->left_ == child) {
+                    child = node_;
+                    node_ = node_->parent_;
+                }
+            }
+
+            return *this;
+        }
+
+        const_iterator operator--(int) {
+            auto result = *this;
+            --*this;
+            return result;
+        }
+
+        bool operator==(const const_iterator &other) const noexcept {
+            return node_ == other.node_;
+        }
+
+        bool operator!=(const const_iterator &other) const noexcept {
+            return node_ != other.node_;
+        }
+
+      private:
+        friend class BinarySearchTree;
+
+        const BinaryNode *node_;
+        const BinaryNode *root_;
+
+        const_iterator(const BinaryNode *node, const BinaryNode *root) : node_(node), root_(root) {}
+    };
+
+    using iterator = const_iterator;
+
     BinarySearchTree() : root_(nullptr)
     {}
 
+    explicit BinarySearchTree(const Allocator &alloc) : alloc_(alloc), root_(nullptr)
+    {}
+
+    explicit BinarySearchTree(const Compare &comp, const Allocator &alloc = Allocator())
+    : comp_(comp), alloc_(alloc), root_(nullptr)
+    {}
+
     BinarySearchTree(const BinarySearchTree &other)
+    : comp_(other.comp_), alloc_(NodeTraits::select_on_container_copy_construction(other.alloc_))
+    {
+        root_ = clone(other.root_);
+    }
+
+    BinarySearchTree(const BinarySearchTree &other, const Allocator &alloc)
+    : comp_(other.comp_), alloc_(alloc)
     {
         root_ = clone(other.root_);
     }
 
-    BinarySearchTree(BinarySearchTree &&other) : root_(other.root_)
+    BinarySearchTree(BinarySearchTree &&other) : comp_(other.comp_), alloc_(other.alloc_), root_(other.root_)
     {
         other.root_ = nullptr;
     }
 
     ~BinarySearchTree() {
-        if (root_) {
-            delete root_;
-            root_ = nullptr;
-        }
+        makeEmpty();
+    }
+
+    allocator_type get_allocator() const {
+        return allocator_type(alloc_);
+    }
+
+    key_compare key_comp() const {
+        return comp_.get();
     }
 
     const Comparable &findMin() const;
     const Comparable &findMax() const;
     bool contains(const Comparable &) const;
     bool isEmpty() const;
+
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_iterator find(const Comparable &) const;
+    const_iterator lower_bound(const Comparable &) const;
+    const_iterator upper_bound(const Comparable &) const;
+    std::pair<const_iterator, const_iterator> equal_range(const Comparable &) const;
+
+    // Heterogeneous lookups, for transparent comparators only.
+    template <typename Key, typename C = Compare, typename = typename std::enable_if<is_transparent<C>::value>::type>
+    bool contains(const Key &e) const {
+        return contains(e, root_);
+    }
+
+    template <typename Key, typename C = Compare, typename = typename std::enable_if<is_transparent<C>::value>::type>
+    const_iterator find(const Key &e) const {
+        return find_key(e);
+    }
+
+    template <typename Key, typename C = Compare, typename = typename std::enable_if<is_transparent<C>::value>::type>
+    const_iterator lower_bound(const Key &e) const {
+        return lower_bound_key(e);
+    }
+
+    template <typename Key, typename C = Compare, typename = typename std::enable_if<is_transparent<C>::value>::type>
+    const_iterator upper_bound(const Key &e) const {
+        return upper_bound_key(e);
+    }
+
+    template <typename Key, typename C = Compare, typename = typename std::enable_if<is_transparent<C>::value>::type>
+    std::pair<const_iterator, const_iterator> equal_range(const Key &e) const {
+        return std::make_pair(lower_bound_key(e), upper_bound_key(e));
+    }
+
     void printTree(std::ostream &out = std::cout) const {
         if (!root_) {
             return;
@@ -48,6 +212,16 @@ class BinarySearchTree {
         printTree(root_, out);
     }
 
+    // Shape and memory of the tree, see tree_shape.h: O(n) and read-only,
+    // so it may run on a background thread as long as no one writes. The
+    // walk needs no recursion, a tree gone linear is measured as well.
+    TreeShape stats() const {
+        auto child = [](const BinaryNode *node, bool right) {
+            return right ? node->right_ : node->left_;
+        };
+        return measure_shape(root_, child, AllocationFootprint<NodeAlloc>::bytes(sizeof(BinaryNode), alignof(BinaryNode)));
+    }
+
     void makeEmpty() {
         if (root_) {
             makeEmpty(root_);
@@ -58,25 +232,55 @@ class BinarySearchTree {
     void insert(Comparable &&);
     void remove(const Comparable &);
 
+    // Replaces the contents with an ascending range in O(n), as a perfectly
+    // balanced tree. Of several equivalent elements only the first is kept.
+    template <typename ForwardIt>
+    void assign_sorted(ForwardIt first, ForwardIt last) {
+        makeEmpty();
+        auto n = count_unique_sorted(first, last, comp_);
+        root_ = build_sorted(first, last, n, nullptr);
+    }
+
+    // Writes the elements in ascending order in the tree_serialize.h
+    // snapshot format. deserialize() rebuilds a balanced tree from one in a
+    // single streaming pass; on BadSnapshot the tree is left empty or
+    // partly loaded.
+    void serialize(std::ostream &os) const {
+        StreamSink sink(os);
+        write_snapshot<Comparable>(begin(), end(), std::distance(begin(), end()), sink);
+    }
+
+    void deserialize(std::istream &is) {
+        StreamSource source(is);
+        load_snapshot(source);
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    void serialize(int fd) const {
+        FdSink sink(fd);
+        write_snapshot<Comparable>(begin(), end(), std::distance(begin(), end()), sink);
+    }
+
+    void deserialize(int fd) {
+        FdSource source(fd);
+        load_snapshot(source);
+    }
+#endif
+
     BinarySearchTree &operator=(const BinarySearchTree &other) {
         if (this == &other) {
             return *this;
         }
 
-        if (root_) {
-            delete root_;
-        }
-
+        makeEmpty();
+        comp_ = other.comp_;
         root_ = clone(other.root_);
 
         return *this;
     }
 
     BinarySearchTree &operator=(BinarySearchTree &&other) {
-        auto temp = root_;
-        root_ = other.root_;
-        other.root_ = temp;
-
+        move_assign(other, typename NodeTraits::propagate_on_container_move_assignment());
         return *this;
     }
 
@@ -85,12 +289,13 @@ class BinarySearchTree {
         Comparable element_;
         BinaryNode *left_;
         BinaryNode *right_;
+        BinaryNode *parent_;
 
-        BinaryNode(const Comparable &e, BinaryNode *l, BinaryNode *r)
-            : element_(e), left_(l), right_(r) {}
+        BinaryNode(const Comparable &e, BinaryNode *l, BinaryNode *r, BinaryNode *p = nullptr)
+            : element_(e), left_(l), right_(r), parent_(p) {}
 
-        BinaryNode(Comparable &&e, BinaryNode *l, BinaryNode *r)
-            : element_(std::move(e)), left_(l), right_(r) {}
+        BinaryNode(Comparable &&e, BinaryNode *l, BinaryNode *r, BinaryNode *p = nullptr)
+            : element_(std::move(e)), left_(l), right_(r), parent_(p) {}
 
         ~BinaryNode() {
             // if (left_) {
@@ -105,21 +310,111 @@ class BinarySearchTree {
         }
     };
 
+    using NodeAlloc = typename std::allocator_traits<Allocator>::template rebind_alloc<BinaryNode>;
+    using NodeTraits = std::allocator_traits<NodeAlloc>;
+
+    KeyCompare<Compare> comp_;
+    NodeAlloc alloc_;
     BinaryNode *root_;
 
-    void insert(const Comparable &, BinaryNode* &);
-    void insert(Comparable &&, BinaryNode* &);
+    template <typename... Args>
+    BinaryNode *create_node(Args &&...args) {
+        BinaryNode *node = NodeTraits::allocate(alloc_, 1);
+        try {
+            NodeTraits::construct(alloc_, node, std::forward<Args>(args)...);
+        } catch (...) {
+            NodeTraits::deallocate(alloc_, node, 1);
+            throw;
+        }
+
+        return node;
+    }
+
+    void destroy_node(BinaryNode *node) {
+        NodeTraits::destroy(alloc_, node);
+        NodeTraits::deallocate(alloc_, node, 1);
+    }
+
+    void move_assign(BinarySearchTree &other, std::true_type) {
+        using std::swap;
+        swap(comp_, other.comp_);
+        swap(alloc_, other.alloc_);
+        swap(root_, other.root_);
+    }
+
+    void move_assign(BinarySearchTree &other, std::false_type) {
+        if (alloc_ == other.alloc_) {
+            std::swap(comp_, other.comp_);
+            std::swap(root_, other.root_);
+        } else {
+            // nodes can't change hands, copy them into our own allocator
+            *this = other;
+            other.makeEmpty();
+        }
+    }
+
+    void insert(const Comparable &, BinaryNode* &, BinaryNode *);
+    void insert(Comparable &&, BinaryNode* &, BinaryNode *);
     void remove(const Comparable &, BinaryNode* &);
     BinaryNode *findMin(BinaryNode *) const;
     BinaryNode *findMax(BinaryNode *) const;
-    bool contains(const Comparable &, BinaryNode *) const;
+    template <typename Key>
+    bool contains(const Key &, BinaryNode *) const;
+    template <typename Key>
+    const_iterator find_key(const Key &) const;
+    template <typename Key>
+    const_iterator lower_bound_key(const Key &) const;
+    template <typename Key>
+    const_iterator upper_bound_key(const Key &) const;
     void makeEmpty(BinaryNode* &);
     void printTree(BinaryNode *, std::ostream &) const;
-    BinaryNode *clone(BinaryNode *) const;
+    BinaryNode *clone(BinaryNode *);
+
+    template <typename Source>
+    void load_snapshot(Source &source) {
+        SnapshotReader<Comparable, Source> reader(source);
+        makeEmpty();
+        auto first = reader.begin();
+        root_ = build_sorted(first, reader.end(), reader.count(), nullptr);
+    }
+
+    // Builds a perfectly balanced tree from the next n distinct elements.
+    template <typename ForwardIt>
+    BinaryNode *build_sorted(ForwardIt &it, ForwardIt last, std::size_t n, BinaryNode *parent) {
+        if (0 == n) {
+            return nullptr;
+        }
+
+        auto left = build_sorted(it, last, n / 2, nullptr);
+        BinaryNode *node;
+        try {
+            node = create_node(*it, left, nullptr, parent);
+        } catch (...) {
+            if (left) {
+                makeEmpty(left);
+            }
+            throw;
+        }
+        if (left) {
+            left->parent_ = node;
+        }
+
+        try {
+            // a snapshot reader may throw here too
+            while (++it != last && !comp_(node->element_, *it)) {
+            }
+            node->right_ = build_sorted(it, last, n - n / 2 - 1, node);
+        } catch (...) {
+            makeEmpty(node);
+            throw;
+        }
+
+        return node;
+    }
 };
 
-template <typename Comparable>
-const Comparable &BinarySearchTree<Comparable>::findMin() const {
+template <typename Comparable, typename Allocator, typename Compare>
+const Comparable &BinarySearchTree<Comparable, Allocator, Compare>::findMin() const {
     if (!root_) {
         throw UnderflowException();
     }
@@ -127,8 +422,8 @@ const Comparable &BinarySearchTree<Comparable>::findMin() const {
     return findMin(root_)->element_;
 }
 
-template <typename Comparable>
-typename BinarySearchTree<Comparable>::BinaryNode *BinarySearchTree<Comparable>::findMin(BinaryNode *node) const {
+template <typename Comparable, typename Allocator, typename Compare>
+typename BinarySearchTree<Comparable, Allocator, Compare>::BinaryNode *BinarySearchTree<Comparable, Allocator, Compare>::findMin(BinaryNode *node) const {
     while (node->left_) {
         node = node->left_;
     }
@@ -136,8 +431,8 @@ typename BinarySearchTree<Comparable>::BinaryNode *BinarySearchTree<Comparable>:
     return node;
 }
 
-template <typename Comparable>
-const Comparable &BinarySearchTree<Comparable>::findMax() const {
+template <typename Comparable, typename Allocator, typename Compare>
+const Comparable &BinarySearchTree<Comparable, Allocator, Compare>::findMax() const {
     if (!root_) {
         throw UnderflowException();
     }
@@ -145,8 +440,8 @@ const Comparable &BinarySearchTree<Comparable>::findMax() const {
     return findMax(root_)->element_;
 }
 
-template <typename Comparable>
-typename BinarySearchTree<Comparable>::BinaryNode *BinarySearchTree<Comparable>::findMax(BinaryNode *node) const {
+template <typename Comparable, typename Allocator, typename Compare>
+typename BinarySearchTree<Comparable, Allocator, Compare>::BinaryNode *BinarySearchTree<Comparable, Allocator, Compare>::findMax(BinaryNode *node) const {
     while (node->right_) {
         node = node->right_;
     }
@@ -154,8 +449,8 @@ typename BinarySearchTree<Comparable>::BinaryNode *BinarySearchTree<Comparable>:
     return node;
 }
 
-template <typename Comparable>
-bool BinarySearchTree<Comparable>::contains(const Comparable &e) const {
+template <typename Comparable, typename Allocator, typename Compare>
+bool BinarySearchTree<Comparable, Allocator, Compare>::contains(const Comparable &e) const {
     if (!root_) {
         return false;
     }
@@ -163,82 +458,168 @@ bool BinarySearchTree<Comparable>::contains(const Comparable &e) const {
     return contains(e, root_);
 }
 
-template <typename Comparable>
-bool BinarySearchTree<Comparable>::contains(const Comparable &e, BinaryNode *node) const {
+template <typename Comparable, typename Allocator, typename Compare>
+template <typename Key>
+bool BinarySearchTree<Comparable, Allocator, Compare>::contains(const Key &e, BinaryNode *node) const {
     if (!node) {
         return false;
     }
 
-    if (e < node->element_) {
+    auto order = comp_.compare(e, node->element_);
+    if (order < 0) {
         return contains(e, node->left_);
-    } else if (node->element_ < e) {
+    } else if (order > 0) {
         return contains(e, node->right_);
     } else {
         return true;
     }
 }
 
-template <typename Comparable>
-bool BinarySearchTree<Comparable>::isEmpty() const {
+template <typename Comparable, typename Allocator, typename Compare>
+bool BinarySearchTree<Comparable, Allocator, Compare>::isEmpty() const {
     return !root_;
 }
 
-template <typename Comparable>
-void BinarySearchTree<Comparable>::insert(const Comparable &e) {
-    return insert(e, root_);
+template <typename Comparable, typename Allocator, typename Compare>
+typename BinarySearchTree<Comparable, Allocator, Compare>::const_iterator BinarySearchTree<Comparable, Allocator, Compare>::begin() const {
+    return const_iterator(root_ ? findMin(root_) : nullptr, root_);
+}
+
+template <typename Comparable, typename Allocator, typename Compare>
+typename BinarySearchTree<Comparable, Allocator, Compare>::const_iterator BinarySearchTree<Comparable, Allocator, Compare>::end() const {
+    return const_iterator(nullptr, root_);
+}
+
+template <typename Comparable, typename Allocator, typename Compare>
+typename BinarySearchTree<Comparable, Allocator, Compare>::const_iterator BinarySearchTree<Comparable, Allocator, Compare>::find(const Comparable &e) const {
+    return find_key(e);
+}
+
+template <typename Comparable, typename Allocator, typename Compare>
+template <typename Key>
+typename BinarySearchTree<Comparable, Allocator, Compare>::const_iterator BinarySearchTree<Comparable, Allocator, Compare>::find_key(const Key &e) const {
+    auto it = lower_bound_key(e);
+    if (it.node_ && comp_(e, it.node_->element_)) {
+        return end();
+    }
+
+    return it;
+}
+
+template <typename Comparable, typename Allocator, typename Compare>
+typename BinarySearchTree<Comparable, Allocator, Compare>::const_iterator BinarySearchTree<Comparable, Allocator, Compare>::lower_bound(const Comparable &e) const {
+    return lower_bound_key(e);
+}
+
+template <typename Comparable, typename Allocator, typename Compare>
+template <typename Key>
+typename BinarySearchTree<Comparable, Allocator, Compare>::const_iterator BinarySearchTree<Comparable, Allocator, Compare>::lower_bound_key(const Key &e) const {
+    const BinaryNode *result = nullptr;
+    auto node = root_;
+    while (node) {
+        auto order = comp_.compare(node->element_, e);
+        if (order < 0) {
+            node = node->right_;
+        } else {
+            result = node;
+            if (0 == order) {
+                break;
+            }
+            node = node->left_;
+        }
+    }
+
+    return const_iterator(result, root_);
+}
+
+template <typename Comparable, typename Allocator, typename Compare>
+typename BinarySearchTree<Comparable, Allocator, Compare>::const_iterator BinarySearchTree<Comparable, Allocator, Compare>::upper_bound(const Comparable &e) const {
+    return upper_bound_key(e);
+}
+
+template <typename Comparable, typename Allocator, typename Compare>
+template <typename Key>
+typename BinarySearchTree<Comparable, Allocator, Compare>::const_iterator BinarySearchTree<Comparable, Allocator, Compare>::upper_bound_key(const Key &e) const {
+    const BinaryNode *result = nullptr;
+    auto node = root_;
+    while (node) {
+        if (comp_(e, node->element_)) {
+            result = node;
+            node = node->left_;
+        } else {
+            node = node->right_;
+        }
+    }
+
+    return const_iterator(result, root_);
+}
+
+template <typename Comparable, typename Allocator, typename Compare>
+std::pair<typename BinarySearchTree<Comparable, Allocator, Compare>::const_iterator,
+          typename BinarySearchTree<Comparable, Allocator, Compare>::const_iterator>
+BinarySearchTree<Comparable, Allocator, Compare>::equal_range(const Comparable &e) const {
+    return std::make_pair(lower_bound(e), upper_bound(e));
+}
+
+template <typename Comparable, typename Allocator, typename Compare>
+void BinarySearchTree<Comparable, Allocator, Compare>::insert(const Comparable &e) {
+    return insert(e, root_, nullptr);
 }
 
-template <typename Comparable>
-void BinarySearchTree<Comparable>::insert(const Comparable &e, BinaryNode* &node) {
+template <typename Comparable, typename Allocator, typename Compare>
+void BinarySearchTree<Comparable, Allocator, Compare>::insert(const Comparable &e, BinaryNode* &node, BinaryNode *parent) {
     if (!node) {
-        node = new BinaryNode(e, nullptr, nullptr);
+        node = create_node(e, nullptr, nullptr, parent);
         return;
     }
 
-    if (e < node->element_) {
-        insert(e, node->left_);
-    } else if (node->element_ < e) {
-        insert(e, node->right_);
+    auto order = comp_.compare(e, node->element_);
+    if (order < 0) {
+        insert(e, node->left_, node);
+    } else if (order > 0) {
+        insert(e, node->right_, node);
     } else {
         std::cout << "already in tree" << std::endl;
     }
 }
 
-template <typename Comparable>
-void BinarySearchTree<Comparable>::insert(Comparable &&e) {
-    return insert(std::move(e), root_);
+template <typename Comparable, typename Allocator, typename Compare>
+void BinarySearchTree<Comparable, Allocator, Compare>::insert(Comparable &&e) {
+    return insert(std::move(e), root_, nullptr);
 }
 
-template <typename Comparable>
-void BinarySearchTree<Comparable>::insert(Comparable &&e, BinaryNode* &node) {
+template <typename Comparable, typename Allocator, typename Compare>
+void BinarySearchTree<Comparable, Allocator, Compare>::insert(Comparable &&e, BinaryNode* &node, BinaryNode *parent) {
     if (!node) {
-        node = new BinaryNode(std::move(e), nullptr, nullptr);
+        node = create_node(std::move(e), nullptr, nullptr, parent);
         return;
     }
 
-    if (e < node->element_) {
-        insert(std::move(e), node->left_);
-    } else if (node->element_ < e) {
-        insert(std::move(e), node->right_);
+    auto order = comp_.compare(e, node->element_);
+    if (order < 0) {
+        insert(std::move(e), node->left_, node);
+    } else if (order > 0) {
+        insert(std::move(e), node->right_, node);
     } else {
         std::cout << "already in tree" << std::endl;
     }
 }
 
-template <typename Comparable>
-void BinarySearchTree<Comparable>::remove(const Comparable &e) {
+template <typename Comparable, typename Allocator, typename Compare>
+void BinarySearchTree<Comparable, Allocator, Compare>::remove(const Comparable &e) {
     remove(e, root_);
 }
 
-template <typename Comparable>
-void BinarySearchTree<Comparable>::remove(const Comparable &e, BinaryNode* &node) {
+template <typename Comparable, typename Allocator, typename Compare>
+void BinarySearchTree<Comparable, Allocator, Compare>::remove(const Comparable &e, BinaryNode* &node) {
     if (!node) {
         return;
     }
 
-    if (e < node->element_) {
+    auto order = comp_.compare(e, node->element_);
+    if (order < 0) {
         remove(e, node->left_);
-    } else if (node->element_ < e) {
+    } else if (order > 0) {
         remove(e, node->right_);
     } else {
         if (node->left_ && node->right_) {
@@ -247,13 +628,16 @@ void BinarySearchTree<Comparable>::remove(const Comparable &e, BinaryNode* &node
         } else {
             auto old = node;
             node = node->left_ ? node->left_ : node->right_;
-            delete old;
+            if (node) {
+                node->parent_ = old->parent_;
+            }
+            destroy_node(old);
         }
     }
 }
 
-template <typename Comparable>
-void BinarySearchTree<Comparable>::printTree(BinaryNode *node, std::ostream &out) const {
+template <typename Comparable, typename Allocator, typename Compare>
+void BinarySearchTree<Comparable, Allocator, Compare>::printTree(BinaryNode *node, std::ostream &out) const {
     if (node) {
         printTree(node->left_, out);
         out << node->element_ << std::endl;
@@ -261,21 +645,27 @@ void BinarySearchTree<Comparable>::printTree(BinaryNode *node, std::ostream &out
     }
 }
 
-template <typename Comparable>
-typename BinarySearchTree<Comparable>::BinaryNode *BinarySearchTree<Comparable>::clone(BinaryNode *node) const {
+template <typename Comparable, typename Allocator, typename Compare>
+typename BinarySearchTree<Comparable, Allocator, Compare>::BinaryNode *BinarySearchTree<Comparable, Allocator, Compare>::clone(BinaryNode *node) {
     if (!node) {
         return nullptr;
     }
 
     auto left = clone(node->left_);
     auto right = clone(node->right_);
-    return new BinaryNode(node->element_, left, right);
-}
-
-void BinarySearchTree<Comparable>::makeEmpty(BinaryNode* &node) {
+    auto result = create_node(node->element_, left, right);
+    if (left) {
+        left->parent_ = result;
+    }
+    if (right) {
+        right->parent_ = result;
+    }
 
+    return result;
+}
 
-    
+template <typename Comparable, typename Allocator, typename Compare>
+void BinarySearchTree<Comparable, Allocator, Compare>::makeEmpty(BinaryNode* &node) {
     if (node->left_) {
         makeEmpty(node->left_);
     }
@@ -284,10 +674,19 @@ void BinarySearchTree<Comparable>::makeEmpty(BinaryNode* &node) {
         makeEmpty(node->right_);
     }
 
-    delete node;
+    destroy_node(node);
     node = nullptr;
 }
 
+#if __cplusplus >= 201703L
+namespace pmr {
+
+template <typename Comparable, typename Compare = std::less<Comparable>>
+using BinarySearchTree = tree::BinarySearchTree<Comparable, std::pmr::polymorphic_allocator<Comparable>, Compare>;
+
+}
+#endif
+
 }
 
 #endif // BINARY_SEARCH_TREE_H_
\ No newline at end of file
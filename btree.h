@@ -0,0 +1,558 @@
+#ifndef BTREE_H_
+#define BTREE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace tree {
+
+struct EmptyBTree : public std::exception {
+    const char *what() const noexcept override {
+        return "EmptyBTree";
+    }
+};
+
+namespace detail {
+
+// Number of keys in the sorted run keys[0, n) that are less than x. The
+// generic version is a branch-free scan the compiler can vectorize; the
+// overloads below use SSE/AVX2 compares for the common integer keys.
+template <typename T>
+inline int count_less(const T *keys, int n, const T &x) {
+    int result = 0;
+    for (int i = 0; i < n; ++i) {
+        result += keys[i] < x;
+    }
+    return result;
+}
+
+#if defined(__AVX2__)
+inline int count_less(const std::int32_t *keys, int n, std::int32_t x) {
+    auto needle = _mm256_set1_epi32(x);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i));
+        auto mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(needle, chunk))));
+        if (mask != 0xff) {
+            // keys are sorted, the first key >= x ends the run
+            return i + __builtin_popcount(mask);
+        }
+    }
+    for (; i < n && keys[i] < x; ++i) {
+    }
+    return i;
+}
+
+inline int count_less(const std::int64_t *keys, int n, std::int64_t x) {
+    auto needle = _mm256_set1_epi64x(x);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i));
+        auto mask = static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(needle, chunk))));
+        if (mask != 0xf) {
+            return i + __builtin_popcount(mask);
+        }
+    }
+    for (; i < n && keys[i] < x; ++i) {
+    }
+    return i;
+}
+#elif defined(__SSE2__)
+inline int count_less(const std::int32_t *keys, int n, std::int32_t x) {
+    auto needle = _mm_set1_epi32(x);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i));
+        auto mask = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(needle, chunk))));
+        if (mask != 0xf) {
+            return i + __builtin_popcount(mask);
+        }
+    }
+    for (; i < n && keys[i] < x; ++i) {
+    }
+    return i;
+}
+#endif
+
+// Position of the first key not less than x. Big nodes are narrowed down
+// by binary search first, the last stretch is scanned.
+template <typename T>
+inline int node_lower_bound(const T *keys, int n, const T &x) {
+    constexpr int SCAN = 64;
+    int first = 0;
+    while (n > SCAN) {
+        int half = n / 2;
+        if (keys[first + half] < x) {
+            first += half + 1;
+            n -= half + 1;
+        } else {
+            n = half;
+        }
+    }
+
+    return first + count_less(keys + first, n, x);
+}
+
+}
+
+// B-tree whose nodes fill NodeBytes (a few cache lines by default, or a
+// page), so a lookup touches one node per level instead of one key. Same
+// interface as AvlTree. Keys must be default constructible.
+template <typename Comparable, std::size_t NodeBytes = 256, typename Allocator = std::allocator<Comparable>>
+class BTree {
+  private:
+    // minimum degree t: every node but the root keeps t - 1 to 2t - 1 keys
+    static constexpr int CAPACITY = static_cast<int>(
+        (NodeBytes - 2 * sizeof(void *)) / (sizeof(Comparable) + sizeof(void *)));
+    static constexpr int MIN_DEGREE = CAPACITY < 3 ? 2 : (CAPACITY + 1) / 2;
+    static constexpr int MAX_KEYS = 2 * MIN_DEGREE - 1;
+
+    struct Node {
+        std::uint16_t count_;
+        bool leaf_;
+        Comparable keys_[MAX_KEYS];
+
+        explicit Node(bool leaf) : count_(0), leaf_(leaf) {}
+    };
+
+    // leaves stop at keys_, only inner nodes pay for child pointers
+    struct InnerNode : Node {
+        Node *children_[MAX_KEYS + 1];
+
+        InnerNode() : Node(false) {}
+    };
+
+    using LeafAlloc = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using LeafTraits = std::allocator_traits<LeafAlloc>;
+    using InnerAlloc = typename std::allocator_traits<Allocator>::template rebind_alloc<InnerNode>;
+    using InnerTraits = std::allocator_traits<InnerAlloc>;
+
+    LeafAlloc leaf_alloc_;
+    InnerAlloc inner_alloc_;
+    Node *root_;
+
+  public:
+    using allocator_type = Allocator;
+
+    static constexpr int max_keys_per_node = MAX_KEYS;
+
+    BTree() : root_(nullptr) {}
+
+    explicit BTree(const Allocator &alloc) : leaf_alloc_(alloc), inner_alloc_(alloc), root_(nullptr) {}
+
+    BTree(const BTree &other)
+    : leaf_alloc_(LeafTraits::select_on_container_copy_construction(other.leaf_alloc_))
+    , inner_alloc_(InnerTraits::select_on_container_copy_construction(other.inner_alloc_))
+    , root_(nullptr)
+    {
+        if (other.root_) {
+            root_ = clone(other.root_);
+        }
+    }
+
+    BTree(BTree &&other)
+    : leaf_alloc_(other.leaf_alloc_)
+    , inner_alloc_(other.inner_alloc_)
+    , root_(other.root_)
+    {
+        other.root_ = nullptr;
+    }
+
+    ~BTree() {
+        makeEmpty();
+    }
+
+    BTree &operator=(const BTree &other) {
+        if (this == &other) {
+            return *this;
+        }
+
+        makeEmpty();
+        if (other.root_) {
+            root_ = clone(other.root_);
+        }
+
+        return *this;
+    }
+
+    BTree &operator=(BTree &&other) {
+        move_assign(other, typename LeafTraits::propagate_on_container_move_assignment());
+        return *this;
+    }
+
+    Allocator get_allocator() const {
+        return Allocator(leaf_alloc_);
+    }
+
+    const Comparable &findMin() const {
+        if (!root_) {
+            throw EmptyBTree();
+        }
+
+        auto node = root_;
+        while (!node->leaf_) {
+            node = inner(node)->children_[0];
+        }
+
+        return node->keys_[0];
+    }
+
+    const Comparable &findMax() const {
+        if (!root_) {
+            throw EmptyBTree();
+        }
+
+        auto node = root_;
+        while (!node->leaf_) {
+            node = inner(node)->children_[node->count_];
+        }
+
+        return node->keys_[node->count_ - 1];
+    }
+
+    bool contains(const Comparable &e) const noexcept {
+        auto node = root_;
+        while (node) {
+            auto i = detail::node_lower_bound(node->keys_, node->count_, e);
+            if (i < node->count_ && !(e < node->keys_[i])) {
+                return true;
+            }
+
+            node = node->leaf_ ? nullptr : inner(node)->children_[i];
+        }
+
+        return false;
+    }
+
+    bool isEmpty() const noexcept {
+        return root_ == nullptr;
+    }
+
+    void printTree(std::ostream &os = std::cout) const {
+        if (root_) {
+            printTree(os, root_);
+        }
+    }
+
+    void makeEmpty() {
+        if (root_) {
+            makeEmpty(root_);
+            root_ = nullptr;
+        }
+    }
+
+    template <typename T, typename = typename std::enable_if<std::is_convertible<T, Comparable>::value>::type>
+    void insert(T &&e) {
+        if (!root_) {
+            root_ = create_leaf();
+        }
+
+        if (MAX_KEYS == root_->count_) {
+            auto root = create_inner();
+            root->children_[0] = root_;
+            root_ = root;
+            split_child(root, 0);
+        }
+
+        insert_nonfull(root_, std::forward<T>(e));
+    }
+
+    void remove(const Comparable &e) {
+        if (!root_) {
+            return;
+        }
+
+        remove(root_, e);
+
+        if (0 == root_->count_) {
+            auto old = root_;
+            root_ = root_->leaf_ ? nullptr : inner(root_)->children_[0];
+            destroy_node(old);
+        }
+    }
+
+  private:
+    static InnerNode *inner(Node *node) noexcept {
+        return static_cast<InnerNode *>(node);
+    }
+
+    static const InnerNode *inner(const Node *node) noexcept {
+        return static_cast<const InnerNode *>(node);
+    }
+
+    Node *create_leaf() {
+        Node *node = LeafTraits::allocate(leaf_alloc_, 1);
+        try {
+            LeafTraits::construct(leaf_alloc_, node, true);
+        } catch (...) {
+            LeafTraits::deallocate(leaf_alloc_, node, 1);
+            throw;
+        }
+
+        return node;
+    }
+
+    InnerNode *create_inner() {
+        InnerNode *node = InnerTraits::allocate(inner_alloc_, 1);
+        try {
+            InnerTraits::construct(inner_alloc_, node);
+        } catch (...) {
+            InnerTraits::deallocate(inner_alloc_, node, 1);
+            throw;
+        }
+
+        return node;
+    }
+
+    void destroy_node(Node *node) {
+        if (node->leaf_) {
+            LeafTraits::destroy(leaf_alloc_, node);
+            LeafTraits::deallocate(leaf_alloc_, node, 1);
+        } else {
+            InnerTraits::destroy(inner_alloc_, inner(node));
+            InnerTraits::deallocate(inner_alloc_, inner(node), 1);
+        }
+    }
+
+    void move_assign(BTree &other, std::true_type) {
+        using std::swap;
+        swap(leaf_alloc_, other.leaf_alloc_);
+        swap(inner_alloc_, other.inner_alloc_);
+        swap(root_, other.root_);
+    }
+
+    void move_assign(BTree &other, std::false_type) {
+        if (leaf_alloc_ == other.leaf_alloc_) {
+            std::swap(root_, other.root_);
+        } else {
+            *this = other;
+            other.makeEmpty();
+        }
+    }
+
+    void makeEmpty(Node *node) {
+        if (!node->leaf_) {
+            for (int i = 0; i <= node->count_; ++i) {
+                makeEmpty(inner(node)->children_[i]);
+            }
+        }
+
+        destroy_node(node);
+    }
+
+    Node *clone(const Node *node) {
+        Node *result;
+        if (node->leaf_) {
+            result = create_leaf();
+        } else {
+            auto copy = create_inner();
+            for (int i = 0; i <= node->count_; ++i) {
+                copy->children_[i] = clone(inner(node)->children_[i]);
+            }
+            result = copy;
+        }
+
+        std::copy(node->keys_, node->keys_ + node->count_, result->keys_);
+        result->count_ = node->count_;
+        return result;
+    }
+
+    void printTree(std::ostream &os, const Node *node) const {
+        for (int i = 0; i < node->count_; ++i) {
+            if (!node->leaf_) {
+                printTree(os, inner(node)->children_[i]);
+            }
+            os << node->keys_[i] << std::endl;
+        }
+
+        if (!node->leaf_) {
+            printTree(os, inner(node)->children_[node->count_]);
+        }
+    }
+
+    // Moves the upper half of the full child i into a new sibling and its
+    // median up into parent.
+    void split_child(InnerNode *parent, int i) {
+        auto child = parent->children_[i];
+        Node *sibling;
+        if (child->leaf_) {
+            sibling = create_leaf();
+        } else {
+            auto inner_sibling = create_inner();
+            std::copy(inner(child)->children_ + MIN_DEGREE, inner(child)->children_ + MAX_KEYS + 1,
+                      inner_sibling->children_);
+            sibling = inner_sibling;
+        }
+
+        std::move(child->keys_ + MIN_DEGREE, child->keys_ + MAX_KEYS, sibling->keys_);
+        sibling->count_ = MIN_DEGREE - 1;
+        child->count_ = MIN_DEGREE - 1;
+
+        std::move_backward(parent->keys_ + i, parent->keys_ + parent->count_, parent->keys_ + parent->count_ + 1);
+        std::copy_backward(parent->children_ + i + 1, parent->children_ + parent->count_ + 1,
+                           parent->children_ + parent->count_ + 2);
+        parent->keys_[i] = std::move(child->keys_[MIN_DEGREE - 1]);
+        parent->children_[i + 1] = sibling;
+        ++parent->count_;
+    }
+
+    template <typename T>
+    void insert_nonfull(Node *node, T &&e) {
+        while (true) {
+            auto i = detail::node_lower_bound(node->keys_, node->count_, static_cast<const Comparable &>(e));
+            if (i < node->count_ && !(e < node->keys_[i])) {
+                return;
+            }
+
+            if (node->leaf_) {
+                std::move_backward(node->keys_ + i, node->keys_ + node->count_, node->keys_ + node->count_ + 1);
+                node->keys_[i] = std::forward<T>(e);
+                ++node->count_;
+                return;
+            }
+
+            auto parent = inner(node);
+            if (MAX_KEYS == parent->children_[i]->count_) {
+                split_child(parent, i);
+                if (!(e < parent->keys_[i]) && !(parent->keys_[i] < e)) {
+                    return;
+                }
+                if (parent->keys_[i] < e) {
+                    ++i;
+                }
+            }
+            node = parent->children_[i];
+        }
+    }
+
+    // Removes e from the subtree of node, which holds at least MIN_DEGREE
+    // keys unless it is the root: every child is topped up before the
+    // descent, so a removal never has to walk back up.
+    void remove(Node *node, const Comparable &e) {
+        while (true) {
+            auto i = detail::node_lower_bound(node->keys_, node->count_, e);
+            auto found = i < node->count_ && !(e < node->keys_[i]);
+
+            if (node->leaf_) {
+                if (found) {
+                    std::move(node->keys_ + i + 1, node->keys_ + node->count_, node->keys_ + i);
+                    --node->count_;
+                }
+                return;
+            }
+
+            auto parent = inner(node);
+            if (found) {
+                auto left = parent->children_[i];
+                auto right = parent->children_[i + 1];
+                if (left->count_ >= MIN_DEGREE) {
+                    parent->keys_[i] = max_of(left);
+                    remove(left, parent->keys_[i]);
+                } else if (right->count_ >= MIN_DEGREE) {
+                    parent->keys_[i] = min_of(right);
+                    remove(right, parent->keys_[i]);
+                } else {
+                    merge_children(parent, i);
+                    node = left;
+                    continue;
+                }
+                return;
+            }
+
+            if (MIN_DEGREE - 1 == parent->children_[i]->count_) {
+                if (i > 0 && parent->children_[i - 1]->count_ >= MIN_DEGREE) {
+                    borrow_from_left(parent, i);
+                } else if (i < parent->count_ && parent->children_[i + 1]->count_ >= MIN_DEGREE) {
+                    borrow_from_right(parent, i);
+                } else if (i < parent->count_) {
+                    merge_children(parent, i);
+                } else {
+                    merge_children(parent, --i);
+                }
+            }
+            node = parent->children_[i];
+        }
+    }
+
+    static const Comparable &max_of(const Node *node) noexcept {
+        while (!node->leaf_) {
+            node = inner(node)->children_[node->count_];
+        }
+        return node->keys_[node->count_ - 1];
+    }
+
+    static const Comparable &min_of(const Node *node) noexcept {
+        while (!node->leaf_) {
+            node = inner(node)->children_[0];
+        }
+        return node->keys_[0];
+    }
+
+    // Folds child i + 1 and the separating key into child i.
+    void merge_children(InnerNode *parent, int i) {
+        auto left = parent->children_[i];
+        auto right = parent->children_[i + 1];
+
+        left->keys_[left->count_] = std::move(parent->keys_[i]);
+        std::move(right->keys_, right->keys_ + right->count_, left->keys_ + left->count_ + 1);
+        if (!left->leaf_) {
+            std::copy(inner(right)->children_, inner(right)->children_ + right->count_ + 1,
+                      inner(left)->children_ + left->count_ + 1);
+        }
+        left->count_ += right->count_ + 1;
+
+        std::move(parent->keys_ + i + 1, parent->keys_ + parent->count_, parent->keys_ + i);
+        std::copy(parent->children_ + i + 2, parent->children_ + parent->count_ + 1, parent->children_ + i + 1);
+        --parent->count_;
+
+        destroy_node(right);
+    }
+
+    void borrow_from_left(InnerNode *parent, int i) {
+        auto child = parent->children_[i];
+        auto sibling = parent->children_[i - 1];
+
+        std::move_backward(child->keys_, child->keys_ + child->count_, child->keys_ + child->count_ + 1);
+        child->keys_[0] = std::move(parent->keys_[i - 1]);
+        if (!child->leaf_) {
+            std::copy_backward(inner(child)->children_, inner(child)->children_ + child->count_ + 1,
+                               inner(child)->children_ + child->count_ + 2);
+            inner(child)->children_[0] = inner(sibling)->children_[sibling->count_];
+        }
+        parent->keys_[i - 1] = std::move(sibling->keys_[sibling->count_ - 1]);
+
+        ++child->count_;
+        --sibling->count_;
+    }
+
+    void borrow_from_right(InnerNode *parent, int i) {
+        auto child = parent->children_[i];
+        auto sibling = parent->children_[i + 1];
+
+        child->keys_[child->count_] = std::move(parent->keys_[i]);
+        if (!child->leaf_) {
+            inner(child)->children_[child->count_ + 1] = inner(sibling)->children_[0];
+            std::copy(inner(sibling)->children_ + 1, inner(sibling)->children_ + sibling->count_ + 1,
+                      inner(sibling)->children_);
+        }
+        parent->keys_[i] = std::move(sibling->keys_[0]);
+        std::move(sibling->keys_ + 1, sibling->keys_ + sibling->count_, sibling->keys_);
+
+        ++child->count_;
+        --sibling->count_;
+    }
+};
+
+}
+
+#endif // BTREE_H_
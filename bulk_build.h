@@ -0,0 +1,94 @@
+#ifndef BULK_BUILD_H_
+#define BULK_BUILD_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace tree {
+
+// Below this many elements per thread the threads cost more than they save.
+constexpr std::size_t PARALLEL_SORT_GRAIN = 1 << 16;
+
+template <typename RandomIt, typename Compare>
+void parallel_sort(RandomIt first, RandomIt last, unsigned threads, Compare comp) {
+    auto n = static_cast<std::size_t>(last - first);
+    if (0 == threads) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned>(std::min<std::size_t>(threads, n / PARALLEL_SORT_GRAIN + 1));
+
+    if (threads <= 1) {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    // sort one run per thread, then merge neighbouring runs level by level
+    std::vector<RandomIt> bounds;
+    for (unsigned i = 0; i <= threads; ++i) {
+        bounds.push_back(first + static_cast<std::ptrdiff_t>(n * i / threads));
+    }
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back([&bounds, &comp, i] {
+            std::sort(bounds[i], bounds[i + 1], comp);
+        });
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    while (bounds.size() > 2) {
+        std::vector<RandomIt> merged;
+        workers.clear();
+        for (std::size_t i = 0; i + 1 < bounds.size(); i += 2) {
+            merged.push_back(bounds[i]);
+            if (i + 2 < bounds.size()) {
+                workers.emplace_back([&bounds, &comp, i] {
+                    std::inplace_merge(bounds[i], bounds[i + 1], bounds[i + 2], comp);
+                });
+            }
+        }
+        merged.push_back(bounds.back());
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        bounds.swap(merged);
+    }
+}
+
+// Sorts v and drops equivalent elements, keeping the first of each run.
+template <typename T, typename Compare = std::less<T>>
+void sort_unique(std::vector<T> &v, unsigned threads = 1, Compare comp = Compare()) {
+    parallel_sort(v.begin(), v.end(), threads, comp);
+    v.erase(std::unique(v.begin(), v.end(), [&comp](const T &a, const T &b) {
+        return !comp(a, b) && !comp(b, a);
+    }), v.end());
+}
+
+// Number of distinct elements in a sorted range.
+template <typename ForwardIt, typename Compare>
+std::size_t count_unique_sorted(ForwardIt first, ForwardIt last, Compare comp) {
+    std::size_t count = 0;
+    while (first != last) {
+        ++count;
+        auto prev = first;
+        while (++first != last && !comp(*prev, *first)) {
+        }
+    }
+
+    return count;
+}
+
+template <typename It>
+using require_input_iterator = typename std::enable_if<
+    std::is_convertible<typename std::iterator_traits<It>::iterator_category, std::input_iterator_tag>::value>::type;
+
+}
+
+#endif // BULK_BUILD_H_
@@ -0,0 +1,591 @@
+#ifndef COMPACT_AVL_TREE_H_
+#define COMPACT_AVL_TREE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "tree_shape.h"
+
+namespace tree {
+
+struct EmptyCompactTree : public std::exception {
+    const char *what() const noexcept override {
+        return "EmptyCompactTree";
+    }
+};
+
+// Node of a CompactAvlTree: the balance factor shares a word with the
+// right index, the way avl_tree_impl1.h keeps it in a char instead of
+// storing heights. An int node takes 12 bytes.
+template <typename Comparable>
+struct CompactAvlNode {
+    static constexpr int INDEX_BITS = 28;
+
+    Comparable element_;
+    std::uint32_t left_;
+    std::uint32_t right_ : INDEX_BITS;
+    signed int balance_ : 32 - INDEX_BITS;
+
+    template <typename T, typename = typename std::enable_if<std::is_convertible<T, Comparable>::value>::type>
+    explicit CompactAvlNode(T &&e) : element_(std::forward<T>(e)), left_(0), right_(0), balance_(0) {}
+};
+
+// Where a CompactAvlTree keeps its nodes, root, free list and size: here
+// a vector and three words, in mapped_avl_tree.h a file. A store acts
+// like a vector of nodes plus root(), free_list() and count().
+template <typename Node, typename NodeAlloc>
+class VectorNodeStore {
+  public:
+    VectorNodeStore() : root_(0), free_(0), size_(0) {}
+
+    explicit VectorNodeStore(const NodeAlloc &alloc) : nodes_(alloc), root_(0), free_(0), size_(0) {}
+
+    VectorNodeStore(const VectorNodeStore &) = default;
+    VectorNodeStore &operator=(const VectorNodeStore &) = default;
+
+    VectorNodeStore(VectorNodeStore &&other)
+    : nodes_(std::move(other.nodes_))
+    , root_(other.root_)
+    , free_(other.free_)
+    , size_(other.size_)
+    {
+        other.clear();
+    }
+
+    VectorNodeStore &operator=(VectorNodeStore &&other) {
+        if (this != &other) {
+            nodes_ = std::move(other.nodes_);
+            root_ = other.root_;
+            free_ = other.free_;
+            size_ = other.size_;
+            other.clear();
+        }
+
+        return *this;
+    }
+
+    NodeAlloc get_allocator() const {
+        return nodes_.get_allocator();
+    }
+
+    Node &operator[](std::size_t i) noexcept {
+        return nodes_[i];
+    }
+
+    const Node &operator[](std::size_t i) const noexcept {
+        return nodes_[i];
+    }
+
+    std::size_t size() const noexcept {
+        return nodes_.size();
+    }
+
+    template <typename T>
+    void emplace_back(T &&e) {
+        nodes_.emplace_back(std::forward<T>(e));
+    }
+
+    void reserve(std::size_t n) {
+        nodes_.reserve(n);
+    }
+
+    void clear() noexcept {
+        nodes_.clear();
+        root_ = free_ = 0;
+        size_ = 0;
+    }
+
+    std::uint32_t &root() noexcept {
+        return root_;
+    }
+
+    std::uint32_t root() const noexcept {
+        return root_;
+    }
+
+    std::uint32_t &free_list() noexcept {
+        return free_;
+    }
+
+    std::uint32_t free_list() const noexcept {
+        return free_;
+    }
+
+    std::uint64_t &count() noexcept {
+        return size_;
+    }
+
+    std::uint64_t count() const noexcept {
+        return size_;
+    }
+
+  private:
+    std::vector<Node, NodeAlloc> nodes_;
+    std::uint32_t root_;
+    std::uint32_t free_;
+    std::uint64_t size_;
+};
+
+// AVL tree for large sets of small keys. Nodes live in one vector and
+// link to each other by 32-bit index, see CompactAvlNode. An int node
+// takes 12 bytes instead of 32.
+//
+// Index 0 is the null link, node i is stored at nodes_[i - 1]. Removed
+// slots go on a free list threaded through left_ and are reused first.
+// Inserts may move the vector, so references to elements are only valid
+// until the next insert.
+template <typename Comparable, char ALLOWED_IMBALANCE = 1, typename Allocator = std::allocator<Comparable>,
+          typename Store = VectorNodeStore<CompactAvlNode<Comparable>,
+                                           typename std::allocator_traits<Allocator>::template rebind_alloc<
+                                               CompactAvlNode<Comparable>>>>
+class CompactAvlTree {
+  private:
+    using AvlNode = CompactAvlNode<Comparable>;
+
+    static constexpr int INDEX_BITS = AvlNode::INDEX_BITS;
+
+    static_assert(ALLOWED_IMBALANCE >= 1 && ALLOWED_IMBALANCE <= 3,
+                  "balance factors must fit in the 4 spare bits of a node");
+
+    using NodeAlloc = typename std::allocator_traits<Allocator>::template rebind_alloc<AvlNode>;
+
+    Store nodes_;
+
+  public:
+    using allocator_type = Allocator;
+
+    static constexpr std::size_t max_nodes = (std::size_t(1) << INDEX_BITS) - 1;
+
+    CompactAvlTree() {}
+
+    explicit CompactAvlTree(const Allocator &alloc) : nodes_(NodeAlloc(alloc)) {}
+
+    Allocator get_allocator() const {
+        return Allocator(nodes_.get_allocator());
+    }
+
+    std::size_t size() const noexcept {
+        return static_cast<std::size_t>(nodes_.count());
+    }
+
+    // Makes room for n elements so that the next inserts don't move nodes.
+    void reserve(std::size_t n) {
+        nodes_.reserve(n);
+    }
+
+    bool isEmpty() const noexcept {
+        return 0 == nodes_.root();
+    }
+
+    void makeEmpty() {
+        nodes_.clear();
+    }
+
+    const Comparable &findMin() const {
+        if (!nodes_.root()) {
+            throw EmptyCompactTree();
+        }
+
+        auto node = nodes_.root();
+        while (at(node).left_) {
+            node = at(node).left_;
+        }
+
+        return at(node).element_;
+    }
+
+    const Comparable &findMax() const {
+        if (!nodes_.root()) {
+            throw EmptyCompactTree();
+        }
+
+        auto node = nodes_.root();
+        while (at(node).right_) {
+            node = at(node).right_;
+        }
+
+        return at(node).element_;
+    }
+
+    bool contains(const Comparable &e) const noexcept {
+        auto node = nodes_.root();
+        while (node) {
+            const auto &n = at(node);
+            if (e < n.element_) {
+                node = n.left_;
+            } else if (n.element_ < e) {
+                node = n.right_;
+            } else {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Walks the whole tree and the free list in O(n): links in range, keys
+    // in order, balance factors right and within bounds, every slot either
+    // in the tree or free, exactly once, and the size right.
+    bool check() const {
+        std::vector<bool> seen(nodes_.size() + 1);
+        std::uint64_t reachable = 0;
+        if (check(nodes_.root(), nullptr, nullptr, seen, 0, reachable) < -1) {
+            return false;
+        }
+
+        std::uint64_t free = 0;
+        for (auto node = nodes_.free_list(); node; node = at(node).left_) {
+            if (node > nodes_.size() || seen[node]) {
+                return false;
+            }
+            seen[node] = true;
+            ++free;
+        }
+
+        return reachable == nodes_.count() && reachable + free == nodes_.size();
+    }
+
+    void printTree(std::ostream &os = std::cout) const {
+        if (nodes_.root()) {
+            printTree(os, nodes_.root());
+        }
+    }
+
+    // Shape and memory of the tree, see tree_shape.h: O(n) and read-only,
+    // so it may run on a background thread as long as no one writes. The
+    // nodes share one array; every slot of it, free ones included, counts
+    // towards the bytes per node in the tree.
+    TreeShape stats() const {
+        auto child = [this](const AvlNode *node, bool right) -> const AvlNode * {
+            std::uint32_t index = right ? node->right_ : node->left_;
+            return index ? &at(index) : nullptr;
+        };
+        auto count = nodes_.count() ? static_cast<double>(nodes_.count()) : 1.0;
+        return measure_shape(nodes_.root() ? &at(nodes_.root()) : nullptr, child,
+                             sizeof(AvlNode) * static_cast<double>(nodes_.size()) / count);
+    }
+
+    template <typename T, typename = typename std::enable_if<std::is_convertible<T, Comparable>::value>::type>
+    void insert(T &&e) {
+        // path[i] is the i-th node on the way down, side[i] says which
+        // child of it we took; indices survive the vector moving
+        std::uint32_t path[64];
+        int side[64];
+
+        int depth = 0;
+        auto node = nodes_.root();
+        while (node) {
+            path[depth] = node;
+            if (at(node).element_ < e) {
+                side[depth++] = 1;
+                node = at(node).right_;
+            } else if (e < at(node).element_) {
+                side[depth++] = -1;
+                node = at(node).left_;
+            } else {
+                return;
+            }
+        }
+
+        link(path, side, depth, create_node(std::forward<T>(e)));
+
+        for (int i = depth - 1; i >= 0; --i) {
+            auto &temp = at(path[i]);
+
+            if (0 == temp.balance_) {
+                temp.balance_ += side[i];
+            } else if ((temp.balance_ ^ side[i]) < 0) {
+                temp.balance_ += side[i];
+                break;
+            } else {
+                temp.balance_ += side[i];
+                if (temp.balance_ < -ALLOWED_IMBALANCE) {
+                    if (at(temp.left_).balance_ < 0) {
+                        link(path, side, i, single_rorate_left_child(path[i]));
+                    } else {
+                        link(path, side, i, double_rorate_left_child(path[i]));
+                    }
+                    break;
+                } else if (temp.balance_ > ALLOWED_IMBALANCE) {
+                    if (at(temp.right_).balance_ > 0) {
+                        link(path, side, i, single_rorate_right_child(path[i]));
+                    } else {
+                        link(path, side, i, double_rorate_right_child(path[i]));
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    void remove(const Comparable &e) {
+        std::uint32_t path[64];
+        int side[64];
+
+        int depth = 0;
+        auto node = nodes_.root();
+        while (node && (at(node).element_ < e || e < at(node).element_)) {
+            path[depth] = node;
+            if (at(node).element_ < e) {
+                side[depth++] = 1;
+                node = at(node).right_;
+            } else {
+                side[depth++] = -1;
+                node = at(node).left_;
+            }
+        }
+
+        if (!node) {
+            return;
+        }
+
+        if (at(node).left_ && at(node).right_) {
+            // move the min of the right subtree up and delete its node
+            auto found = node;
+            path[depth] = node;
+            side[depth++] = 1;
+            node = at(node).right_;
+            while (at(node).left_) {
+                path[depth] = node;
+                side[depth++] = -1;
+                node = at(node).left_;
+            }
+
+            at(found).element_ = std::move(at(node).element_);
+        }
+
+        link(path, side, depth, at(node).left_ ? at(node).left_ : static_cast<std::uint32_t>(at(node).right_));
+        destroy_node(node);
+
+        for (int i = depth - 1; i >= 0; --i) {
+            auto &temp = at(path[i]);
+            // a removal on one side tips the balance to the other
+            auto delta = -side[i];
+
+            if (0 == temp.balance_) {
+                temp.balance_ += delta;
+                return;
+            } else if ((temp.balance_ ^ delta) < 0) {
+                temp.balance_ += delta;
+            } else {
+                temp.balance_ += delta;
+                if (temp.balance_ < -ALLOWED_IMBALANCE) {
+                    if (0 == at(temp.left_).balance_) {
+                        // rotating over a balanced child keeps the height
+                        link(path, side, i, single_rorate_left_child(path[i]));
+                        return;
+                    } else if (at(temp.left_).balance_ < 0) {
+                        link(path, side, i, single_rorate_left_child(path[i]));
+                    } else {
+                        link(path, side, i, double_rorate_left_child(path[i]));
+                    }
+                } else if (temp.balance_ > ALLOWED_IMBALANCE) {
+                    if (0 == at(temp.right_).balance_) {
+                        link(path, side, i, single_rorate_right_child(path[i]));
+                        return;
+                    } else if (at(temp.right_).balance_ > 0) {
+                        link(path, side, i, single_rorate_right_child(path[i]));
+                    } else {
+                        link(path, side, i, double_rorate_right_child(path[i]));
+                    }
+                } else {
+                    // still within the allowed imbalance, height unchanged
+                    return;
+                }
+            }
+        }
+    }
+
+  protected:
+    // for stores that need arguments, see mapped_avl_tree.h
+    explicit CompactAvlTree(Store &&nodes) : nodes_(std::move(nodes)) {}
+
+    Store &store() noexcept {
+        return nodes_;
+    }
+
+  private:
+    AvlNode &at(std::uint32_t node) noexcept {
+        return nodes_[node - 1];
+    }
+
+    const AvlNode &at(std::uint32_t node) const noexcept {
+        return nodes_[node - 1];
+    }
+
+    template <typename T>
+    std::uint32_t create_node(T &&e) {
+        std::uint32_t node;
+        if (nodes_.free_list()) {
+            node = nodes_.free_list();
+            at(node).element_ = std::forward<T>(e);
+            nodes_.free_list() = at(node).left_;
+            at(node).left_ = 0;
+            at(node).right_ = 0;
+            at(node).balance_ = 0;
+        } else {
+            if (nodes_.size() >= max_nodes) {
+                throw std::length_error("CompactAvlTree: out of node indices");
+            }
+            nodes_.emplace_back(std::forward<T>(e));
+            node = static_cast<std::uint32_t>(nodes_.size());
+        }
+
+        ++nodes_.count();
+        return node;
+    }
+
+    void destroy_node(std::uint32_t node) {
+        at(node).left_ = nodes_.free_list();
+        nodes_.free_list() = node;
+        --nodes_.count();
+    }
+
+    // Hangs child where path[depth] hangs, i.e. below path[depth - 1].
+    void link(const std::uint32_t *path, const int *side, int depth, std::uint32_t child) noexcept {
+        if (0 == depth) {
+            nodes_.root() = child;
+        } else if (side[depth - 1] < 0) {
+            at(path[depth - 1]).left_ = child;
+        } else {
+            at(path[depth - 1]).right_ = child;
+        }
+    }
+
+    // The rotations return the new root of the subtree; the balance
+    // updates are those of avl_tree_impl1.h.
+    std::uint32_t single_rorate_left_child(std::uint32_t node) {
+        auto &parent = at(node);
+        auto child_index = parent.left_;
+        auto &child = at(child_index);
+        parent.left_ = child.right_;
+        child.right_ = node;
+
+        parent.balance_ += 1 - child.balance_;
+        ++child.balance_;
+        return child_index;
+    }
+
+    std::uint32_t single_rorate_right_child(std::uint32_t node) {
+        auto &parent = at(node);
+        auto child_index = parent.right_;
+        auto &child = at(child_index);
+        parent.right_ = child.left_;
+        child.left_ = node;
+
+        parent.balance_ += -1 - child.balance_;
+        --child.balance_;
+        return child_index;
+    }
+
+    std::uint32_t double_rorate_left_child(std::uint32_t node) {
+        auto &result_right = at(node);
+        auto left_index = result_right.left_;
+        auto &result_left = at(left_index);
+        auto parent_index = result_left.right_;
+        auto &result_parent = at(parent_index);
+
+        result_left.right_ = result_parent.left_;
+        result_right.left_ = result_parent.right_;
+        result_parent.left_ = left_index;
+        result_parent.right_ = node;
+
+        if (result_parent.balance_ >= 0) {
+            result_right.balance_ += 2;
+            int temp = result_left.balance_;
+            result_left.balance_ += -1 - result_parent.balance_;
+            if (result_left.balance_ < 0) {
+                result_parent.balance_ = temp - 1;
+            }
+        } else {
+            --result_left.balance_;
+            int temp = result_right.balance_;
+            result_right.balance_ += 2 - result_parent.balance_;
+            if (result_right.balance_ > 0) {
+                result_parent.balance_ = 2 + temp;
+            }
+        }
+
+        return parent_index;
+    }
+
+    std::uint32_t double_rorate_right_child(std::uint32_t node) {
+        auto &result_left = at(node);
+        auto right_index = result_left.right_;
+        auto &result_right = at(right_index);
+        auto parent_index = result_right.left_;
+        auto &result_parent = at(parent_index);
+
+        result_left.right_ = result_parent.left_;
+        result_right.left_ = result_parent.right_;
+        result_parent.left_ = node;
+        result_parent.right_ = right_index;
+
+        if (result_parent.balance_ >= 0) {
+            ++result_right.balance_;
+            int temp = result_left.balance_;
+            result_left.balance_ += -2 - result_parent.balance_;
+            if (result_left.balance_ < 0) {
+                result_parent.balance_ = temp - 2;
+            }
+        } else {
+            result_left.balance_ -= 2;
+            int temp = result_right.balance_;
+            result_right.balance_ += 1 - result_parent.balance_;
+            if (result_right.balance_ > 0) {
+                result_parent.balance_ = 1 + temp;
+            }
+        }
+
+        return parent_index;
+    }
+
+    // Height of the subtree at node, -2 if it is broken. Links are checked
+    // before they are followed, so a damaged tree can't lead astray.
+    int check(std::uint32_t node, const Comparable *lo, const Comparable *hi, std::vector<bool> &seen, int depth,
+              std::uint64_t &reachable) const {
+        if (!node) {
+            return -1;
+        }
+        if (node > nodes_.size() || seen[node] || depth >= 64) {
+            return -2;
+        }
+        seen[node] = true;
+        ++reachable;
+
+        const auto &n = at(node);
+        if ((lo && !(*lo < n.element_)) || (hi && !(n.element_ < *hi))) {
+            return -2;
+        }
+
+        auto left = check(n.left_, lo, &n.element_, seen, depth + 1, reachable);
+        auto right = left < -1 ? -2 : check(n.right_, &n.element_, hi, seen, depth + 1, reachable);
+        if (right < -1 || n.balance_ != right - left || right - left > ALLOWED_IMBALANCE ||
+            left - right > ALLOWED_IMBALANCE) {
+            return -2;
+        }
+
+        return (left > right ? left : right) + 1;
+    }
+
+    void printTree(std::ostream &os, std::uint32_t node) const {
+        if (at(node).left_) {
+            printTree(os, at(node).left_);
+        }
+        os << at(node).element_ << std::endl;
+        if (at(node).right_) {
+            printTree(os, at(node).right_);
+        }
+    }
+};
+
+}
+
+#endif // COMPACT_AVL_TREE_H_
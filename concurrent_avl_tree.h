@@ -0,0 +1,985 @@
+#ifndef CONCURRENT_AVL_TREE_H_
+#define CONCURRENT_AVL_TREE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "epoch.h"
+#include "tree_compare.h"
+
+namespace tree {
+
+struct EmptyConcurrentTree : public std::exception {
+    const char *what() const noexcept override {
+        return "EmptyConcurrentTree";
+    }
+};
+
+class SpinLock {
+  public:
+    SpinLock() : locked_(false) {}
+
+    void lock() noexcept {
+        while (locked_.exchange(true, std::memory_order_acquire)) {
+            while (locked_.load(std::memory_order_relaxed)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void unlock() noexcept {
+        locked_.store(false, std::memory_order_release);
+    }
+
+  private:
+    std::atomic<bool> locked_;
+};
+
+// Concurrent AVL set after Bronson, Casper, Chafi and Olukotun, "A
+// Practical Concurrent Binary Search Tree" (PPoPP 2010).
+//
+// Readers take no locks. Every node carries a version that a rotation
+// bumps when keys leave the node's subtree; a search reads a child link,
+// then re-checks the version of the node it came from, and retries one
+// level up if the node shrank in the meantime (optimistic hand-over-hand
+// validation). Writers lock only the nodes they relink, parent before
+// child. Removing a node with two children just marks it absent and
+// leaves it as a routing node; routing nodes with fewer than two children
+// are unlinked during rebalancing. Balance is relaxed: heights are
+// repaired bottom-up after each update, concurrently with other updates.
+//
+// Unlinked nodes go to an EpochDomain, so a reader can still walk a node
+// that was unlinked behind its back. Scans are weakly consistent: they see
+// every key present for the whole scan and no key absent for all of it.
+template <typename Comparable, typename Compare = std::less<Comparable>>
+class ConcurrentAvlTree {
+  private:
+    struct Node;
+
+    static constexpr int LEFT = -1;
+    static constexpr int RIGHT = 1;
+
+    static constexpr std::uint64_t UNLINKED = 1;
+    static constexpr std::uint64_t SHRINKING = 2;
+    static constexpr std::uint64_t SHRINK_COUNT = 4;
+
+    // node_condition() results besides a new height
+    static constexpr int NOTHING_REQUIRED = -1;
+    static constexpr int UNLINK_REQUIRED = -2;
+    static constexpr int REBALANCE_REQUIRED = -3;
+
+    enum Result {
+        FOUND,
+        NOT_FOUND,
+        RETRY,
+    };
+
+    // Everything but the key; the root holder is a bare NodeBase whose
+    // right child is the root.
+    struct NodeBase {
+        std::atomic<Node *> left_;
+        std::atomic<Node *> right_;
+        std::atomic<NodeBase *> parent_;
+        std::atomic<std::uint64_t> version_;
+        std::atomic<int> height_;
+        std::atomic<bool> present_;
+        SpinLock lock_;
+
+        NodeBase(NodeBase *parent, int height, bool present)
+        : left_(nullptr)
+        , right_(nullptr)
+        , parent_(parent)
+        , version_(0)
+        , height_(height)
+        , present_(present)
+        {}
+
+        Node *child(int dir) const noexcept {
+            return dir < 0 ? left_.load() : right_.load();
+        }
+
+        void set_child(int dir, Node *node) noexcept {
+            if (dir < 0) {
+                left_.store(node);
+            } else {
+                right_.store(node);
+            }
+        }
+    };
+
+    struct Node : NodeBase {
+        const Comparable element_;
+
+        template <typename T>
+        Node(T &&e, NodeBase *parent) : NodeBase(parent, 1, true), element_(std::forward<T>(e)) {}
+    };
+
+    using Lock = std::lock_guard<SpinLock>;
+
+    KeyCompare<Compare> comp_;
+    NodeBase holder_;
+    mutable EpochDomain domain_;
+
+  public:
+    using key_compare = Compare;
+
+    ConcurrentAvlTree() : holder_(nullptr, 0, false) {}
+
+    explicit ConcurrentAvlTree(const Compare &comp) : comp_(comp), holder_(nullptr, 0, false) {}
+
+    ConcurrentAvlTree(const ConcurrentAvlTree &) = delete;
+    ConcurrentAvlTree &operator=(const ConcurrentAvlTree &) = delete;
+
+    ~ConcurrentAvlTree() {
+        makeEmpty();
+    }
+
+    bool contains(const Comparable &e) const {
+        auto guard = domain_.pin();
+        while (true) {
+            auto result = attempt_get(e, &holder_, RIGHT, 0);
+            if (RETRY != result) {
+                return FOUND == result;
+            }
+        }
+    }
+
+    // Returns whether e was added.
+    template <typename T, typename = typename std::enable_if<std::is_convertible<T, Comparable>::value>::type>
+    bool insert(T &&e) {
+        auto guard = domain_.pin();
+        while (true) {
+            auto result = attempt_insert(std::forward<T>(e), &holder_, RIGHT, 0);
+            if (RETRY != result) {
+                return FOUND == result;
+            }
+        }
+    }
+
+    // Returns whether e was there.
+    bool remove(const Comparable &e) {
+        auto guard = domain_.pin();
+        while (true) {
+            auto result = attempt_remove(e, &holder_, RIGHT, 0);
+            if (RETRY != result) {
+                return FOUND == result;
+            }
+        }
+    }
+
+    Comparable findMin() const {
+        Comparable result;
+        if (!edge<true>(nullptr, true, result)) {
+            throw EmptyConcurrentTree();
+        }
+
+        return result;
+    }
+
+    Comparable findMax() const {
+        Comparable result;
+        if (!edge<false>(nullptr, true, result)) {
+            throw EmptyConcurrentTree();
+        }
+
+        return result;
+    }
+
+    bool isEmpty() const {
+        return !any_present();
+    }
+
+    // Calls f(e) for every e in [lo, hi] in ascending order without taking
+    // a lock; each step is a fresh O(log n) search, so writers may run in
+    // between.
+    template <typename F>
+    void for_each(const Comparable &lo, const Comparable &hi, F f) const {
+        Comparable e;
+        auto found = edge<true>(&lo, true, e);
+        while (found && !comp_(hi, e)) {
+            f(static_cast<const Comparable &>(e));
+            found = edge<true>(&e, false, e);
+        }
+    }
+
+    template <typename F>
+    void for_each(F f) const {
+        Comparable e;
+        auto found = edge<true>(nullptr, true, e);
+        while (found) {
+            f(static_cast<const Comparable &>(e));
+            found = edge<true>(&e, false, e);
+        }
+    }
+
+    void printTree(std::ostream &os = std::cout) const {
+        for_each([&os](const Comparable &e) {
+            os << e << std::endl;
+        });
+    }
+
+    // Not thread safe: no other thread may use the tree meanwhile.
+    void makeEmpty() {
+        if (auto root = holder_.right_.load()) {
+            makeEmpty(root);
+            holder_.right_.store(nullptr);
+            holder_.height_.store(0);
+        }
+        domain_.drain();
+    }
+
+  private:
+    static int height(const NodeBase *node) noexcept {
+        return node ? node->height_.load() : 0;
+    }
+
+    static bool shrinking_or_unlinked(std::uint64_t version) noexcept {
+        return (version & (UNLINKED | SHRINKING)) != 0;
+    }
+
+    static void wait_until_shrink_completed(const NodeBase *node, std::uint64_t version) noexcept {
+        if (!(version & SHRINKING)) {
+            return;
+        }
+        while (node->version_.load() == version) {
+            std::this_thread::yield();
+        }
+    }
+
+    static std::uint64_t begin_shrink(NodeBase *node) noexcept {
+        auto version = node->version_.load();
+        node->version_.store(version | SHRINKING);
+        return version;
+    }
+
+    static void end_shrink(NodeBase *node, std::uint64_t version) noexcept {
+        node->version_.store(version + SHRINK_COUNT);
+    }
+
+    int direction(int order) const noexcept {
+        return order < 0 ? LEFT : RIGHT;
+    }
+
+    template <typename Key>
+    Result attempt_get(const Key &e, const NodeBase *node, int dir, std::uint64_t version) const {
+        while (true) {
+            auto child = node->child(dir);
+            if (!child) {
+                return node->version_.load() != version ? RETRY : NOT_FOUND;
+            }
+
+            auto order = comp_.compare(e, child->element_);
+            if (0 == order) {
+                return child->present_.load() ? FOUND : NOT_FOUND;
+            }
+
+            auto child_version = child->version_.load();
+            if (shrinking_or_unlinked(child_version)) {
+                wait_until_shrink_completed(child, child_version);
+                if (node->version_.load() != version) {
+                    return RETRY;
+                }
+            } else if (child != node->child(dir)) {
+                if (node->version_.load() != version) {
+                    return RETRY;
+                }
+            } else {
+                if (node->version_.load() != version) {
+                    return RETRY;
+                }
+
+                auto result = attempt_get(e, child, direction(order), child_version);
+                if (RETRY != result) {
+                    return result;
+                }
+            }
+        }
+    }
+
+    // FOUND: e was added, NOT_FOUND: it was there already.
+    template <typename T>
+    Result attempt_insert(T &&e, NodeBase *node, int dir, std::uint64_t version) {
+        while (true) {
+            auto child = node->child(dir);
+            if (!child) {
+                NodeBase *damaged;
+                {
+                    Lock lock(node->lock_);
+                    if (node->version_.load() != version) {
+                        return RETRY;
+                    }
+                    if (node->child(dir)) {
+                        // lost a race for the empty slot, look again
+                        continue;
+                    }
+
+                    node->set_child(dir, new Node(std::forward<T>(e), node));
+                    damaged = fix_height_nl(node);
+                }
+                fix_height_and_rebalance(damaged);
+                return FOUND;
+            }
+
+            auto order = comp_.compare(e, child->element_);
+            if (0 == order) {
+                auto result = attempt_revive(child);
+                if (RETRY != result) {
+                    return result;
+                }
+                if (node->version_.load() != version) {
+                    return RETRY;
+                }
+                continue;
+            }
+
+            auto child_version = child->version_.load();
+            if (shrinking_or_unlinked(child_version)) {
+                wait_until_shrink_completed(child, child_version);
+                if (node->version_.load() != version) {
+                    return RETRY;
+                }
+            } else if (child != node->child(dir)) {
+                if (node->version_.load() != version) {
+                    return RETRY;
+                }
+            } else {
+                if (node->version_.load() != version) {
+                    return RETRY;
+                }
+
+                auto result = attempt_insert(std::forward<T>(e), child, direction(order), child_version);
+                if (RETRY != result) {
+                    return result;
+                }
+            }
+        }
+    }
+
+    // Turns a routing node holding the key back into a member.
+    Result attempt_revive(Node *node) {
+        if (node->present_.load()) {
+            return NOT_FOUND;
+        }
+
+        Lock lock(node->lock_);
+        if (UNLINKED == node->version_.load()) {
+            return RETRY;
+        }
+        if (node->present_.load()) {
+            return NOT_FOUND;
+        }
+
+        node->present_.store(true);
+        return FOUND;
+    }
+
+    // FOUND: e was removed, NOT_FOUND: it wasn't there.
+    Result attempt_remove(const Comparable &e, NodeBase *node, int dir, std::uint64_t version) {
+        while (true) {
+            auto child = node->child(dir);
+            if (!child) {
+                return node->version_.load() != version ? RETRY : NOT_FOUND;
+            }
+
+            auto order = comp_.compare(e, child->element_);
+            if (0 == order) {
+                auto result = attempt_remove_node(node, child);
+                if (RETRY != result) {
+                    return result;
+                }
+                if (node->version_.load() != version) {
+                    return RETRY;
+                }
+                continue;
+            }
+
+            auto child_version = child->version_.load();
+            if (shrinking_or_unlinked(child_version)) {
+                wait_until_shrink_completed(child, child_version);
+                if (node->version_.load() != version) {
+                    return RETRY;
+                }
+            } else if (child != node->child(dir)) {
+                if (node->version_.load() != version) {
+                    return RETRY;
+                }
+            } else {
+                if (node->version_.load() != version) {
+                    return RETRY;
+                }
+
+                auto result = attempt_remove(e, child, direction(order), child_version);
+                if (RETRY != result) {
+                    return result;
+                }
+            }
+        }
+    }
+
+    static bool can_unlink(const NodeBase *node) noexcept {
+        return !node->left_.load() || !node->right_.load();
+    }
+
+    Result attempt_remove_node(NodeBase *parent, Node *node) {
+        if (!node->present_.load()) {
+            return NOT_FOUND;
+        }
+
+        if (!can_unlink(node)) {
+            // two children: leave it in place as a routing node
+            Lock lock(node->lock_);
+            if (UNLINKED == node->version_.load() || can_unlink(node)) {
+                return RETRY;
+            }
+            if (!node->present_.load()) {
+                return NOT_FOUND;
+            }
+
+            node->present_.store(false);
+            return FOUND;
+        }
+
+        NodeBase *damaged;
+        {
+            Lock parent_lock(parent->lock_);
+            if (UNLINKED == parent->version_.load() || node->parent_.load() != parent) {
+                return RETRY;
+            }
+
+            Lock node_lock(node->lock_);
+            if (!node->present_.load()) {
+                return NOT_FOUND;
+            }
+            if (!attempt_unlink_nl(parent, node)) {
+                return RETRY;
+            }
+
+            domain_.retire(node);
+            damaged = fix_height_nl(parent);
+        }
+
+        fix_height_and_rebalance(damaged);
+        return FOUND;
+    }
+
+    // With parent and node locked, splices node out if it has at most one
+    // child.
+    bool attempt_unlink_nl(NodeBase *parent, Node *node) {
+        auto parent_left = parent->left_.load();
+        if (parent_left != node && parent->right_.load() != node) {
+            return false;
+        }
+
+        auto left = node->left_.load();
+        auto right = node->right_.load();
+        if (left && right) {
+            return false;
+        }
+
+        auto splice = left ? left : right;
+        parent->set_child(parent_left == node ? LEFT : RIGHT, splice);
+        if (splice) {
+            splice->parent_.store(parent);
+        }
+
+        node->version_.store(UNLINKED);
+        node->present_.store(false);
+        return true;
+    }
+
+    // The closest present key beyond *e (or the outermost one when e is
+    // nullptr) in ascending order when ASCENDING, descending otherwise.
+    template <bool ASCENDING>
+    bool edge(const Comparable *e, bool inclusive, Comparable &result) const {
+        auto guard = domain_.pin();
+        while (true) {
+            auto found = attempt_edge<ASCENDING>(e, inclusive, &holder_, RIGHT, 0, result);
+            if (RETRY != found) {
+                return FOUND == found;
+            }
+        }
+    }
+
+    template <bool ASCENDING>
+    Result attempt_edge(const Comparable *e, bool inclusive, const NodeBase *node, int dir, std::uint64_t version,
+                        Comparable &result) const {
+        // near is the side of smaller keys in the walking order
+        const int near = ASCENDING ? LEFT : RIGHT;
+        const int far = -near;
+
+        while (true) {
+            auto child = node->child(dir);
+            if (!child) {
+                return node->version_.load() != version ? RETRY : NOT_FOUND;
+            }
+
+            auto child_version = child->version_.load();
+            if (shrinking_or_unlinked(child_version)) {
+                wait_until_shrink_completed(child, child_version);
+                if (node->version_.load() != version) {
+                    return RETRY;
+                }
+                continue;
+            }
+            if (child != node->child(dir)) {
+                if (node->version_.load() != version) {
+                    return RETRY;
+                }
+                continue;
+            }
+            if (node->version_.load() != version) {
+                return RETRY;
+            }
+
+            // order < 0: child comes after e in the walking order
+            int order = -1;
+            if (e) {
+                order = comp_.compare(*e, child->element_);
+                if (!ASCENDING) {
+                    order = -order;
+                }
+                if (0 == order && !inclusive) {
+                    order = 1;
+                }
+            }
+
+            Result found;
+            if (order > 0) {
+                found = attempt_edge<ASCENDING>(e, inclusive, child, far, child_version, result);
+            } else {
+                found = order < 0 ? attempt_edge<ASCENDING>(e, inclusive, child, near, child_version, result)
+                                  : NOT_FOUND;
+                if (NOT_FOUND == found) {
+                    // an unlinked node is never present, no need to validate
+                    if (child->present_.load()) {
+                        result = child->element_;
+                        found = FOUND;
+                    } else {
+                        found = attempt_edge<ASCENDING>(e, inclusive, child, far, child_version, result);
+                    }
+                }
+            }
+
+            if (RETRY != found) {
+                return found;
+            }
+        }
+    }
+
+    bool any_present() const {
+        Comparable e;
+        return edge<true>(nullptr, true, e);
+    }
+
+    // Reads a node's state without locks. Whoever changes a node repairs
+    // it afterwards, so a stale answer is somebody else's job to fix.
+    static int node_condition(const NodeBase *node) noexcept {
+        auto left = node->left_.load();
+        auto right = node->right_.load();
+        if ((!left || !right) && !node->present_.load()) {
+            return UNLINK_REQUIRED;
+        }
+
+        auto height_node = node->height_.load();
+        auto height_left = height(left);
+        auto height_right = height(right);
+
+        auto height_new = 1 + std::max(height_left, height_right);
+        auto balance = height_left - height_right;
+        if (balance < -1 || balance > 1) {
+            return REBALANCE_REQUIRED;
+        }
+
+        return height_node != height_new ? height_new : NOTHING_REQUIRED;
+    }
+
+    // Walks up from node repairing heights, rotating and unlinking
+    // routing nodes until nothing is left to do.
+    //
+    // A rotation that leaves a node below it damaged hands that node back
+    // and the walk goes down to it, but the rotation may also have changed
+    // the height of the subtree it sits in. Whenever the walk ends, it goes
+    // on from the parents of the rotations it made, so stale heights above
+    // them are repaired too. The first few of those wait on the stack, any
+    // more in spilled.
+    void fix_height_and_rebalance(NodeBase *node) {
+        static constexpr int MAX_RESUME = 8;
+        NodeBase *resume[MAX_RESUME];
+        int resumes = 0;
+        std::vector<NodeBase *> spilled;
+
+        while (true) {
+            while (node && node->parent_.load()) {
+                auto condition = node_condition(node);
+                if (NOTHING_REQUIRED == condition || UNLINKED == node->version_.load()) {
+                    break;
+                }
+
+                if (UNLINK_REQUIRED != condition && REBALANCE_REQUIRED != condition) {
+                    Lock lock(node->lock_);
+                    node = fix_height_nl(node);
+                } else {
+                    auto parent = node->parent_.load();
+                    Lock parent_lock(parent->lock_);
+                    if (UNLINKED != parent->version_.load() && node->parent_.load() == parent) {
+                        Lock node_lock(node->lock_);
+                        node = rebalance_nl(parent, static_cast<Node *>(node));
+                        auto last = !spilled.empty() ? spilled.back() : resumes ? resume[resumes - 1] : nullptr;
+                        if (node && node != parent && last != parent) {
+                            if (resumes < MAX_RESUME) {
+                                resume[resumes++] = parent;
+                            } else {
+                                spilled.push_back(parent);
+                            }
+                        }
+                    }
+                }
+            }
+
+            if (!spilled.empty()) {
+                node = spilled.back();
+                spilled.pop_back();
+            } else if (resumes) {
+                node = resume[--resumes];
+            } else {
+                return;
+            }
+        }
+    }
+
+    // With node locked: fixes its height and returns the next node to
+    // look at, nullptr when done.
+    static NodeBase *fix_height_nl(NodeBase *node) noexcept {
+        auto condition = node_condition(node);
+        switch (condition) {
+        case REBALANCE_REQUIRED:
+        case UNLINK_REQUIRED:
+            return node;
+        case NOTHING_REQUIRED:
+            return nullptr;
+        default:
+            node->height_.store(condition);
+            return node->parent_.load();
+        }
+    }
+
+    // With parent and node locked.
+    NodeBase *rebalance_nl(NodeBase *parent, Node *node) {
+        auto left = node->left_.load();
+        auto right = node->right_.load();
+        if ((!left || !right) && !node->present_.load()) {
+            if (attempt_unlink_nl(parent, node)) {
+                domain_.retire(node);
+                return fix_height_nl(parent);
+            }
+            return node;
+        }
+
+        auto height_node = node->height_.load();
+        auto height_left = height(left);
+        auto height_right = height(right);
+        auto height_new = 1 + std::max(height_left, height_right);
+        auto balance = height_left - height_right;
+
+        if (balance > 1) {
+            return rebalance_to_right_nl(parent, node, left, height_right);
+        } else if (balance < -1) {
+            return rebalance_to_left_nl(parent, node, right, height_left);
+        } else if (height_new != height_node) {
+            node->height_.store(height_new);
+            return fix_height_nl(parent);
+        }
+
+        return nullptr;
+    }
+
+    // The left side is too high: rotate right, first left around left if
+    // its inner subtree is the higher one.
+    NodeBase *rebalance_to_right_nl(NodeBase *parent, Node *node, Node *left, int height_right) {
+        {
+            Lock left_lock(left->lock_);
+            auto height_left = left->height_.load();
+            if (height_left - height_right <= 1) {
+                return node;
+            }
+
+            auto left_right = left->right_.load();
+            auto height_left_left = height(left->left_.load());
+            auto height_left_right = height(left_right);
+            if (height_left_left >= height_left_right) {
+                return rotate_right_nl(parent, node, left, height_right, height_left_left, left_right,
+                                       height_left_right);
+            }
+
+            {
+                Lock left_right_lock(left_right->lock_);
+                height_left_right = left_right->height_.load();
+                if (height_left_left >= height_left_right) {
+                    return rotate_right_nl(parent, node, left, height_right, height_left_left, left_right,
+                                           height_left_right);
+                }
+
+                auto height_left_right_left = height(left_right->left_.load());
+                auto balance = height_left_left - height_left_right_left;
+                if (balance >= -1 && balance <= 1) {
+                    return rotate_right_over_left_nl(parent, node, left, height_right, height_left_left,
+                                                     left_right, height_left_right_left);
+                }
+            }
+
+            // a double rotation would leave left unbalanced, fix left first
+            return rebalance_to_left_nl(node, left, left_right, height_left_left);
+        }
+    }
+
+    NodeBase *rebalance_to_left_nl(NodeBase *parent, Node *node, Node *right, int height_left) {
+        {
+            Lock right_lock(right->lock_);
+            auto height_right = right->height_.load();
+            if (height_left - height_right >= -1) {
+                return node;
+            }
+
+            auto right_left = right->left_.load();
+            auto height_right_left = height(right_left);
+            auto height_right_right = height(right->right_.load());
+            if (height_right_right >= height_right_left) {
+                return rotate_left_nl(parent, node, height_left, right, right_left, height_right_left,
+                                      height_right_right);
+            }
+
+            {
+                Lock right_left_lock(right_left->lock_);
+                height_right_left = right_left->height_.load();
+                if (height_right_right >= height_right_left) {
+                    return rotate_left_nl(parent, node, height_left, right, right_left, height_right_left,
+                                          height_right_right);
+                }
+
+                auto height_right_left_right = height(right_left->right_.load());
+                auto balance = height_right_right - height_right_left_right;
+                if (balance >= -1 && balance <= 1) {
+                    return rotate_left_over_right_nl(parent, node, height_left, right, right_left,
+                                                     height_right_right, height_right_left_right);
+                }
+            }
+
+            return rebalance_to_right_nl(node, right, right_left, height_right_right);
+        }
+    }
+
+    void replace_child(NodeBase *parent, Node *old_child, Node *new_child) noexcept {
+        parent->set_child(parent->left_.load() == old_child ? LEFT : RIGHT, new_child);
+        new_child->parent_.store(parent);
+    }
+
+    NodeBase *rotate_right_nl(NodeBase *parent, Node *node, Node *left, int height_right, int height_left_left,
+                              Node *left_right, int height_left_right) {
+        // node loses the keys of left's subtree, readers inside must retry
+        auto version = begin_shrink(node);
+
+        node->left_.store(left_right);
+        if (left_right) {
+            left_right->parent_.store(node);
+        }
+        left->right_.store(node);
+        node->parent_.store(left);
+        replace_child(parent, node, left);
+
+        auto height_node = 1 + std::max(height_left_right, height_right);
+        node->height_.store(height_node);
+        left->height_.store(1 + std::max(height_left_left, height_node));
+
+        end_shrink(node, version);
+
+        // fix whatever damage we can with the locks we hold, deepest first
+        auto balance_node = height_left_right - height_right;
+        if (balance_node < -1 || balance_node > 1) {
+            return node;
+        }
+        if ((!left_right || 0 == height_right) && !node->present_.load()) {
+            return node;
+        }
+
+        auto balance_left = height_left_left - height_node;
+        if (balance_left < -1 || balance_left > 1) {
+            return left;
+        }
+        if (0 == height_left_left && !left->present_.load()) {
+            return left;
+        }
+
+        return fix_height_nl(parent);
+    }
+
+    NodeBase *rotate_left_nl(NodeBase *parent, Node *node, int height_left, Node *right, Node *right_left,
+                             int height_right_left, int height_right_right) {
+        auto version = begin_shrink(node);
+
+        node->right_.store(right_left);
+        if (right_left) {
+            right_left->parent_.store(node);
+        }
+        right->left_.store(node);
+        node->parent_.store(right);
+        replace_child(parent, node, right);
+
+        auto height_node = 1 + std::max(height_left, height_right_left);
+        node->height_.store(height_node);
+        right->height_.store(1 + std::max(height_node, height_right_right));
+
+        end_shrink(node, version);
+
+        auto balance_node = height_right_left - height_left;
+        if (balance_node < -1 || balance_node > 1) {
+            return node;
+        }
+        if ((!right_left || 0 == height_left) && !node->present_.load()) {
+            return node;
+        }
+
+        auto balance_right = height_right_right - height_node;
+        if (balance_right < -1 || balance_right > 1) {
+            return right;
+        }
+        if (0 == height_right_right && !right->present_.load()) {
+            return right;
+        }
+
+        return fix_height_nl(parent);
+    }
+
+    NodeBase *rotate_right_over_left_nl(NodeBase *parent, Node *node, Node *left, int height_right,
+                                        int height_left_left, Node *left_right, int height_left_right_left) {
+        auto left_right_left = left_right->left_.load();
+        auto left_right_right = left_right->right_.load();
+        auto height_left_right_right = height(left_right_right);
+
+        auto version = begin_shrink(node);
+        auto left_version = begin_shrink(left);
+
+        node->left_.store(left_right_right);
+        if (left_right_right) {
+            left_right_right->parent_.store(node);
+        }
+        left->right_.store(left_right_left);
+        if (left_right_left) {
+            left_right_left->parent_.store(left);
+        }
+        left_right->left_.store(left);
+        left->parent_.store(left_right);
+        left_right->right_.store(node);
+        node->parent_.store(left_right);
+        replace_child(parent, node, left_right);
+
+        auto height_node = 1 + std::max(height_left_right_right, height_right);
+        node->height_.store(height_node);
+        auto height_left = 1 + std::max(height_left_left, height_left_right_left);
+        left->height_.store(height_left);
+        left_right->height_.store(1 + std::max(height_left, height_node));
+
+        end_shrink(node, version);
+        end_shrink(left, left_version);
+
+        // left may be a routing node that just lost a child, and we hold
+        // the locks to drop it
+        if ((0 == height_left_left || !left_right_left) && !left->present_.load()
+            && attempt_unlink_nl(left_right, left)) {
+            domain_.retire(left);
+            height_left = std::max(height_left_left, height(left_right_left));
+            left_right->height_.store(1 + std::max(height_left, height_node));
+        }
+
+        auto balance_node = height_left_right_right - height_right;
+        if (balance_node < -1 || balance_node > 1) {
+            return node;
+        }
+        if ((!left_right_right || 0 == height_right) && !node->present_.load()) {
+            return node;
+        }
+
+        auto balance_top = height_left - height_node;
+        if (balance_top < -1 || balance_top > 1) {
+            return left_right;
+        }
+
+        return fix_height_nl(parent);
+    }
+
+    NodeBase *rotate_left_over_right_nl(NodeBase *parent, Node *node, int height_left, Node *right,
+                                        Node *right_left, int height_right_right, int height_right_left_right) {
+        auto right_left_left = right_left->left_.load();
+        auto right_left_right = right_left->right_.load();
+        auto height_right_left_left = height(right_left_left);
+
+        auto version = begin_shrink(node);
+        auto right_version = begin_shrink(right);
+
+        node->right_.store(right_left_left);
+        if (right_left_left) {
+            right_left_left->parent_.store(node);
+        }
+        right->left_.store(right_left_right);
+        if (right_left_right) {
+            right_left_right->parent_.store(right);
+        }
+        right_left->right_.store(right);
+        right->parent_.store(right_left);
+        right_left->left_.store(node);
+        node->parent_.store(right_left);
+        replace_child(parent, node, right_left);
+
+        auto height_node = 1 + std::max(height_left, height_right_left_left);
+        node->height_.store(height_node);
+        auto height_right = 1 + std::max(height_right_left_right, height_right_right);
+        right->height_.store(height_right);
+        right_left->height_.store(1 + std::max(height_node, height_right));
+
+        end_shrink(node, version);
+        end_shrink(right, right_version);
+
+        if ((0 == height_right_right || !right_left_right) && !right->present_.load()
+            && attempt_unlink_nl(right_left, right)) {
+            domain_.retire(right);
+            height_right = std::max(height(right_left_right), height_right_right);
+            right_left->height_.store(1 + std::max(height_node, height_right));
+        }
+
+        auto balance_node = height_right_left_left - height_left;
+        if (balance_node < -1 || balance_node > 1) {
+            return node;
+        }
+        if ((!right_left_left || 0 == height_left) && !node->present_.load()) {
+            return node;
+        }
+
+        auto balance_top = height_right - height_node;
+        if (balance_top < -1 || balance_top > 1) {
+            return right_left;
+        }
+
+        return fix_height_nl(parent);
+    }
+
+    static void makeEmpty(Node *node) {
+        if (auto left = node->left_.load()) {
+            makeEmpty(left);
+        }
+        if (auto right = node->right_.load()) {
+            makeEmpty(right);
+        }
+        delete node;
+    }
+};
+
+}
+
+#endif // CONCURRENT_AVL_TREE_H_
@@ -0,0 +1,355 @@
+#ifndef EPOCH_H_
+#define EPOCH_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "node_pool.h"
+
+namespace tree {
+
+// Epoch-based reclamation for structures whose readers take no locks.
+//
+// Every operation that follows pointers into the structure runs inside a
+// Guard from pin(). A writer that unlinks a node hands it to retire()
+// instead of freeing it, and the domain frees it once every thread that
+// was pinned at the time has left its guard: a retired object is tagged
+// with the global epoch, the epoch only moves on when all pinned threads
+// have seen the current one, so two steps later nobody can still hold a
+// pointer to it.
+//
+// Each thread gets a record in every domain it touches, found through a
+// small thread_local cache. Records live until the domain is destroyed;
+// objects retired by a thread that has exited are freed then.
+//
+// retire() may allocate and so throw. Memory that carries a RetireSlot,
+// reserved when it was allocated, retires without allocating instead, onto
+// a list shared by all threads; RetiringAllocator does that.
+class EpochDomain {
+    static constexpr std::size_t RETIRE_BATCH = 64;
+
+    struct Retired {
+        void *object_;
+        void (*deleter_)(void *);
+        std::uint64_t epoch_;
+    };
+
+    // state_ gets a cache line to itself, pinning must not bounce other
+    // threads' lines (padded rather than aligned, new ignores over-alignment
+    // before C++17)
+    struct Record {
+        char head_[64];
+        // epoch << 1 | pinned
+        std::atomic<std::uint64_t> state_;
+        char tail_[64 - sizeof(std::atomic<std::uint64_t>)];
+        std::thread::id owner_;
+        int depth_;
+        std::vector<Retired> retired_;
+        Record *next_;
+
+        explicit Record(std::thread::id owner) : state_(0), owner_(owner), depth_(0), next_(nullptr) {}
+    };
+
+  public:
+    // Room for the retired list's entry in the retired memory itself.
+    struct RetireSlot {
+        RetireSlot *next_;
+        void (*deleter_)(RetireSlot *);
+        std::uint64_t epoch_;
+    };
+
+    class Guard {
+      public:
+        Guard(Guard &&other) : record_(other.record_) {
+            other.record_ = nullptr;
+        }
+
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+
+        ~Guard() {
+            if (record_ && 0 == --record_->depth_) {
+                record_->state_.store(0, std::memory_order_release);
+            }
+        }
+
+      private:
+        friend class EpochDomain;
+
+        Record *record_;
+
+        explicit Guard(Record *record) : record_(record) {}
+    };
+
+    EpochDomain() : epoch_(0), records_(nullptr), slots_(nullptr), slot_count_(0), swept_(0), id_(next_id()) {}
+
+    EpochDomain(const EpochDomain &) = delete;
+    EpochDomain &operator=(const EpochDomain &) = delete;
+
+    ~EpochDomain() {
+        auto record = records_.load();
+        while (record) {
+            free_all(record);
+            auto next = record->next_;
+            delete record;
+            record = next;
+        }
+        free_slots(slots_.exchange(nullptr), UINT64_MAX);
+    }
+
+    // Pins the calling thread until the guard goes away. Guards nest.
+    Guard pin() {
+        auto record = this_record();
+        if (0 == record->depth_++) {
+            record->state_.store(epoch_.load() << 1 | 1);
+        }
+
+        return Guard(record);
+    }
+
+    // Frees object with deleter once no pinned thread can reach it.
+    void retire(void *object, void (*deleter)(void *)) {
+        auto record = this_record();
+        record->retired_.push_back(Retired{object, deleter, epoch_.load()});
+        if (record->retired_.size() >= RETIRE_BATCH) {
+            try_advance();
+            collect(record);
+        }
+    }
+
+    template <typename T>
+    void retire(T *object) {
+        retire(object, [](void *p) {
+            delete static_cast<T *>(p);
+        });
+    }
+
+    // Frees slot, and the memory it is part of, with deleter once no pinned
+    // thread can reach it. Never allocates.
+    void retire(RetireSlot *slot, void (*deleter)(RetireSlot *)) noexcept {
+        slot->deleter_ = deleter;
+        slot->epoch_ = epoch_.load();
+        push_slots(slot, slot);
+        if (RETIRE_BATCH - 1 == slot_count_.fetch_add(1) % RETIRE_BATCH) {
+            try_advance();
+            // nothing new is due until the epoch moves
+            auto epoch = epoch_.load();
+            if (swept_.exchange(epoch) != epoch) {
+                push_slots_due(slots_.exchange(nullptr));
+            }
+        }
+    }
+
+    // Frees everything retired so far. Only call it while no thread is
+    // pinned, e.g. before tearing the structure down.
+    void drain() {
+        for (auto record = records_.load(); record; record = record->next_) {
+            free_all(record);
+        }
+        free_slots(slots_.exchange(nullptr), UINT64_MAX);
+    }
+
+  private:
+    std::atomic<std::uint64_t> epoch_;
+    std::atomic<Record *> records_;
+    std::atomic<RetireSlot *> slots_;
+    std::atomic<std::size_t> slot_count_;
+    std::atomic<std::uint64_t> swept_;
+    std::uint64_t id_;
+
+    static std::uint64_t next_id() {
+        static std::atomic<std::uint64_t> ids(1);
+        return ids.fetch_add(1);
+    }
+
+    Record *this_record() {
+        struct Slot {
+            std::uint64_t id_;
+            Record *record_;
+        };
+        static thread_local Slot cache[4] = {};
+
+        auto &slot = cache[id_ & 3];
+        if (slot.id_ == id_) {
+            return slot.record_;
+        }
+
+        auto self = std::this_thread::get_id();
+        auto record = records_.load();
+        while (record && record->owner_ != self) {
+            record = record->next_;
+        }
+
+        if (!record) {
+            record = new Record(self);
+            auto head = records_.load();
+            do {
+                record->next_ = head;
+            } while (!records_.compare_exchange_weak(head, record));
+        }
+
+        slot.id_ = id_;
+        slot.record_ = record;
+        return record;
+    }
+
+    void try_advance() {
+        auto epoch = epoch_.load();
+        for (auto record = records_.load(); record; record = record->next_) {
+            auto state = record->state_.load();
+            if ((state & 1) && (state >> 1) != epoch) {
+                return;
+            }
+        }
+
+        epoch_.compare_exchange_strong(epoch, epoch + 1);
+    }
+
+    // Retired objects are in epoch order, so only a prefix can be due;
+    // while a reader holds the epoch back this costs one comparison.
+    void collect(Record *record) {
+        auto epoch = epoch_.load();
+        auto &retired = record->retired_;
+        std::size_t due = 0;
+        while (due < retired.size() && retired[due].epoch_ + 2 <= epoch) {
+            retired[due].deleter_(retired[due].object_);
+            ++due;
+        }
+        if (due) {
+            retired.erase(retired.begin(), retired.begin() + due);
+        }
+    }
+
+    void push_slots(RetireSlot *first, RetireSlot *last) noexcept {
+        auto head = slots_.load();
+        do {
+            last->next_ = head;
+        } while (!slots_.compare_exchange_weak(head, first));
+    }
+
+    // Frees the slots of list that are due and puts the rest back. Threads
+    // push slots concurrently, so unlike a record's list this one is not
+    // in epoch order and is walked in full, once per epoch at most.
+    void push_slots_due(RetireSlot *list) noexcept {
+        auto rest = free_slots(list, epoch_.load());
+        if (rest) {
+            auto last = rest;
+            while (last->next_) {
+                last = last->next_;
+            }
+            push_slots(rest, last);
+        }
+    }
+
+    // Frees the slots of list retired at least two epochs before epoch and
+    // returns the others, still linked.
+    static RetireSlot *free_slots(RetireSlot *list, std::uint64_t epoch) noexcept {
+        RetireSlot *rest = nullptr;
+        while (list) {
+            auto next = list->next_;
+            if (epoch >= 2 && list->epoch_ <= epoch - 2) {
+                list->deleter_(list);
+            } else {
+                list->next_ = rest;
+                rest = list;
+            }
+            list = next;
+        }
+
+        return rest;
+    }
+
+    static void free_all(Record *record) {
+        for (auto &retired : record->retired_) {
+            retired.deleter_(retired.object_);
+        }
+        record->retired_.clear();
+    }
+};
+
+// Allocator for trees read without locks: deallocate() retires the memory
+// to an EpochDomain instead of freeing it, so a reader that still holds a
+// pointer into an unlinked node reads stale data rather than freed memory.
+// Memory comes back zeroed, so a reader that sees a node before its
+// constructor's stores sees null links, never garbage. Every block starts
+// with the RetireSlot it is retired through, so deallocate() cannot fail.
+//
+// Objects are destroyed on deallocation as usual, so only types whose
+// destructor leaves the bytes readable, like trivially destructible ones,
+// are safe to read after that. Without a domain memory is freed at once.
+template <typename T>
+class RetiringAllocator {
+    using RetireSlot = EpochDomain::RetireSlot;
+
+    static constexpr std::size_t ALIGN = alignof(T) > alignof(RetireSlot) ? alignof(T) : alignof(RetireSlot);
+    // the objects start after the slot, aligned for T
+    static constexpr std::size_t OFFSET = (sizeof(RetireSlot) + ALIGN - 1) / ALIGN * ALIGN;
+
+  public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    template <typename U>
+    struct rebind {
+        using other = RetiringAllocator<U>;
+    };
+
+    RetiringAllocator() noexcept : domain_(nullptr) {}
+
+    explicit RetiringAllocator(EpochDomain *domain) noexcept : domain_(domain) {}
+
+    template <typename U>
+    RetiringAllocator(const RetiringAllocator<U> &other) noexcept : domain_(other.domain_) {}
+
+    T *allocate(std::size_t n) {
+        if (n > (SIZE_MAX - OFFSET) / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+
+        auto block = static_cast<char *>(detail::aligned_new(OFFSET + n * sizeof(T), ALIGN));
+        std::memset(block + OFFSET, 0, n * sizeof(T));
+        return reinterpret_cast<T *>(block + OFFSET);
+    }
+
+    void deallocate(T *p, std::size_t) noexcept {
+        auto slot = reinterpret_cast<RetireSlot *>(reinterpret_cast<char *>(p) - OFFSET);
+        if (domain_) {
+            domain_->retire(slot, free_block);
+        } else {
+            free_block(slot);
+        }
+    }
+
+    template <typename U>
+    bool operator==(const RetiringAllocator<U> &other) const noexcept {
+        return domain_ == other.domain_;
+    }
+
+    template <typename U>
+    bool operator!=(const RetiringAllocator<U> &other) const noexcept {
+        return domain_ != other.domain_;
+    }
+
+  private:
+    template <typename U>
+    friend class RetiringAllocator;
+
+    EpochDomain *domain_;
+
+    static void free_block(RetireSlot *slot) noexcept {
+        detail::aligned_delete(slot, ALIGN);
+    }
+};
+
+}
+
+#endif // EPOCH_H_
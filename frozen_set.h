@@ -0,0 +1,457 @@
+#ifndef FROZEN_SET_H_
+#define FROZEN_SET_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <vector>
+
+#include "batch_lookup.h"
+#include "tree_compare.h"
+
+namespace tree {
+
+// Read-only sorted sets laid out as an implicit complete binary tree in
+// one array: node k (1-based, BFS numbering) has children 2k and 2k + 1.
+// Built once in O(n) from any sorted range, for example an AvlTree, and
+// searched without pointer chasing and without branches on the keys.
+// They order their elements by Compare, which must be the order of the
+// range they are built from.
+
+namespace detail {
+
+inline unsigned trailing_zeros(std::uint64_t x) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_ctzll(x));
+#else
+    unsigned n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+inline unsigned depth_of(std::uint64_t k) noexcept {
+    unsigned d = 0;
+    while (k >>= 1) {
+        ++d;
+    }
+    return d;
+}
+
+// In-order neighbours of BFS index k in an implicit tree whose nodes are
+// 1..size. 0 stands for "none".
+inline std::uint64_t successor(std::uint64_t k, std::uint64_t size) noexcept {
+    if (2 * k + 1 <= size) {
+        k = 2 * k + 1;
+        while (2 * k <= size) {
+            k = 2 * k;
+        }
+        return k;
+    }
+
+    // climb out of the right children, then one more step
+    return k >> (trailing_zeros(~k) + 1);
+}
+
+inline std::uint64_t predecessor(std::uint64_t k, std::uint64_t size) noexcept {
+    if (2 * k <= size) {
+        k = 2 * k;
+        while (2 * k + 1 <= size) {
+            k = 2 * k + 1;
+        }
+        return k;
+    }
+
+    return k >> (trailing_zeros(k) + 1);
+}
+
+inline std::uint64_t leftmost(std::uint64_t size) noexcept {
+    std::uint64_t k = size ? 1 : 0;
+    while (k && 2 * k <= size) {
+        k = 2 * k;
+    }
+    return k;
+}
+
+}
+
+// Bidirectional iterator over a frozen set, in key order. Set supplies
+// at(k), next(k), prev(k) and last().
+template <typename Set, typename Value>
+class ImplicitTreeIterator {
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = Value;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Value *;
+    using reference = const Value &;
+
+    ImplicitTreeIterator() : set_(nullptr), k_(0) {}
+
+    ImplicitTreeIterator(const Set *set, std::uint64_t k) : set_(set), k_(k) {}
+
+    reference operator*() const {
+        return set_->at(k_);
+    }
+
+    pointer operator->() const {
+        return &set_->at(k_);
+    }
+
+    ImplicitTreeIterator &operator++() {
+        k_ = set_->next(k_);
+        return *this;
+    }
+
+    ImplicitTreeIterator operator++(int) {
+        auto result = *this;
+        ++*this;
+        return result;
+    }
+
+    ImplicitTreeIterator &operator--() {
+        k_ = k_ ? set_->prev(k_) : set_->last();
+        return *this;
+    }
+
+    ImplicitTreeIterator operator--(int) {
+        auto result = *this;
+        --*this;
+        return result;
+    }
+
+    bool operator==(const ImplicitTreeIterator &other) const noexcept {
+        return k_ == other.k_;
+    }
+
+    bool operator!=(const ImplicitTreeIterator &other) const noexcept {
+        return k_ != other.k_;
+    }
+
+  private:
+    const Set *set_;
+    std::uint64_t k_;
+};
+
+// Eytzinger (BFS) layout: the top levels of the tree share a handful of
+// cache lines, and the 16 descendants four levels down are contiguous, so
+// one prefetch per step hides most of the latency.
+template <typename Comparable, typename Compare = std::less<Comparable>>
+class EytzingerSet {
+  public:
+    using value_type = Comparable;
+    using key_compare = Compare;
+    using const_iterator = ImplicitTreeIterator<EytzingerSet, Comparable>;
+    using iterator = const_iterator;
+
+    EytzingerSet() = default;
+
+    // [first, last) must be sorted by comp and free of duplicates.
+    template <typename ForwardIt>
+    EytzingerSet(ForwardIt first, ForwardIt last, const Compare &comp = Compare()) : comp_(comp) {
+        auto n = static_cast<std::size_t>(std::distance(first, last));
+        if (!n) {
+            return;
+        }
+
+        // visit the slots in key order and hand out the sorted elements
+        std::vector<const Comparable *> source(n);
+        auto it = first;
+        for (auto k = detail::leftmost(n); k; k = detail::successor(k, n), ++it) {
+            source[k - 1] = &*it;
+        }
+
+        elements_.reserve(n);
+        for (auto p : source) {
+            elements_.push_back(*p);
+        }
+    }
+
+    std::size_t size() const noexcept {
+        return elements_.size();
+    }
+
+    bool isEmpty() const noexcept {
+        return elements_.empty();
+    }
+
+    bool contains(const Comparable &e) const {
+        auto k = lower_bound_index(e);
+        return k && !comp_(e, elements_[k - 1]);
+    }
+
+    const_iterator begin() const noexcept {
+        return const_iterator(this, detail::leftmost(elements_.size()));
+    }
+
+    const_iterator end() const noexcept {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator find(const Comparable &e) const {
+        auto k = lower_bound_index(e);
+        return const_iterator(this, k && !comp_(e, elements_[k - 1]) ? k : 0);
+    }
+
+    const_iterator lower_bound(const Comparable &e) const {
+        return const_iterator(this, lower_bound_index(e));
+    }
+
+    const_iterator upper_bound(const Comparable &e) const {
+        std::uint64_t k = 1;
+        const std::uint64_t n = elements_.size();
+        while (k <= n) {
+            prefetch_descendants(k);
+            k = 2 * k + !comp_(e, elements_[k - 1]);
+        }
+
+        return const_iterator(this, k >> (detail::trailing_zeros(~k) + 1));
+    }
+
+  private:
+    friend class ImplicitTreeIterator<EytzingerSet, Comparable>;
+
+    std::vector<Comparable> elements_;
+    KeyCompare<Compare> comp_;
+
+    // The loop only decides left or right, the answer is the last node
+    // where it went left: strip the trailing right turns and that turn.
+    std::uint64_t lower_bound_index(const Comparable &e) const {
+        std::uint64_t k = 1;
+        const std::uint64_t n = elements_.size();
+        while (k <= n) {
+            prefetch_descendants(k);
+            k = 2 * k + comp_(elements_[k - 1], e);
+        }
+
+        return k >> (detail::trailing_zeros(~k) + 1);
+    }
+
+    void prefetch_descendants(std::uint64_t k) const noexcept {
+        // computed on integers, the address may lie past the array
+        auto base = reinterpret_cast<std::uintptr_t>(elements_.data());
+        prefetch(reinterpret_cast<const void *>(base + (16 * k - 1) * sizeof(Comparable)));
+    }
+
+    const Comparable &at(std::uint64_t k) const {
+        return elements_[k - 1];
+    }
+
+    std::uint64_t next(std::uint64_t k) const noexcept {
+        return detail::successor(k, elements_.size());
+    }
+
+    std::uint64_t prev(std::uint64_t k) const noexcept {
+        return detail::predecessor(k, elements_.size());
+    }
+
+    std::uint64_t last() const noexcept {
+        std::uint64_t k = elements_.empty() ? 0 : 1;
+        while (k && 2 * k + 1 <= elements_.size()) {
+            k = 2 * k + 1;
+        }
+        return k;
+    }
+};
+
+// van Emde Boas layout: the complete tree of height h is cut into a top
+// tree of height h / 2 and bottom trees below it, each stored contiguously
+// and laid out the same way, so every subtree of any height touches
+// O(1 + height / log B) cache lines whatever the line size B. Missing
+// slots are padded with the maximum, which makes them invisible to
+// searches. Dereferencing an iterator costs O(log n) here.
+template <typename Comparable, typename Compare = std::less<Comparable>>
+class VebSet {
+  public:
+    using value_type = Comparable;
+    using key_compare = Compare;
+    using const_iterator = ImplicitTreeIterator<VebSet, Comparable>;
+    using iterator = const_iterator;
+
+    // Enough levels for any set that fits in memory.
+    static constexpr unsigned MAX_HEIGHT = 48;
+
+    VebSet() : size_(0), height_(0) {}
+
+    // [first, last) must be sorted by comp and free of duplicates.
+    template <typename ForwardIt>
+    VebSet(ForwardIt first, ForwardIt last, const Compare &comp = Compare()) : comp_(comp), size_(0), height_(0) {
+        size_ = static_cast<std::size_t>(std::distance(first, last));
+        while (((std::uint64_t(1) << height_) - 1) < size_) {
+            ++height_;
+        }
+        if (!size_) {
+            return;
+        }
+
+        plan(0, height_);
+
+        std::vector<const Comparable *> source((std::uint64_t(1) << height_) - 1);
+        const Comparable *max = nullptr;
+        std::uint64_t pos[MAX_HEIGHT];
+        fill(1, 0, pos, first, last, max, source);
+
+        elements_.reserve(source.size());
+        for (auto p : source) {
+            elements_.push_back(p ? *p : *max);
+        }
+    }
+
+    std::size_t size() const noexcept {
+        return size_;
+    }
+
+    bool isEmpty() const noexcept {
+        return 0 == size_;
+    }
+
+    bool contains(const Comparable &e) const {
+        auto k = lower_bound_index(e);
+        return k && !comp_(e, at(k));
+    }
+
+    const_iterator begin() const noexcept {
+        return const_iterator(this, size_ ? detail::leftmost(capacity()) : 0);
+    }
+
+    const_iterator end() const noexcept {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator find(const Comparable &e) const {
+        auto k = lower_bound_index(e);
+        return const_iterator(this, k && !comp_(e, at(k)) ? k : 0);
+    }
+
+    const_iterator lower_bound(const Comparable &e) const {
+        return const_iterator(this, lower_bound_index(e));
+    }
+
+  private:
+    friend class ImplicitTreeIterator<VebSet, Comparable>;
+
+    std::vector<Comparable> elements_;
+    KeyCompare<Compare> comp_;
+    std::size_t size_;
+    unsigned height_;
+    // For a node at depth d: depth of the root of the recursive subtree
+    // whose top part ends right above d, size of that top part and size
+    // of the bottom trees hanging below it.
+    unsigned top_root_[MAX_HEIGHT];
+    std::uint64_t top_size_[MAX_HEIGHT];
+    std::uint64_t bottom_size_[MAX_HEIGHT];
+
+    std::uint64_t capacity() const noexcept {
+        return (std::uint64_t(1) << height_) - 1;
+    }
+
+    void plan(unsigned root, unsigned height) {
+        if (height <= 1) {
+            return;
+        }
+
+        auto top = height / 2, bottom = height - top;
+        top_root_[root + top] = root;
+        top_size_[root + top] = (std::uint64_t(1) << top) - 1;
+        bottom_size_[root + top] = (std::uint64_t(1) << bottom) - 1;
+        plan(root, top);
+        plan(root + top, bottom);
+    }
+
+    // pos[d] holds the array slot of the current node's ancestor at depth d.
+    void locate(std::uint64_t k, unsigned d, std::uint64_t *pos) const noexcept {
+        pos[d] = d ? pos[top_root_[d]] + top_size_[d] + (k & top_size_[d]) * bottom_size_[d] : 0;
+    }
+
+    template <typename ForwardIt>
+    void fill(std::uint64_t k, unsigned d, std::uint64_t *pos, ForwardIt &it, ForwardIt last,
+              const Comparable *&max, std::vector<const Comparable *> &source) {
+        if (d == height_) {
+            return;
+        }
+
+        locate(k, d, pos);
+        fill(2 * k, d + 1, pos, it, last, max, source);
+        if (it != last) {
+            max = &*it;
+            source[pos[d]] = &*it;
+            ++it;
+        }
+        fill(2 * k + 1, d + 1, pos, it, last, max, source);
+    }
+
+    std::uint64_t lower_bound_index(const Comparable &e) const {
+        if (!size_) {
+            return 0;
+        }
+
+        std::uint64_t pos[MAX_HEIGHT];
+        std::uint64_t k = 1;
+        for (unsigned d = 0; d < height_; ++d) {
+            locate(k, d, pos);
+            k = 2 * k + comp_(elements_[pos[d]], e);
+        }
+
+        k >>= detail::trailing_zeros(~k) + 1;
+        return k && rank(k) < size_ ? k : 0;
+    }
+
+    // In-order position of BFS index k in the complete tree.
+    std::uint64_t rank(std::uint64_t k) const noexcept {
+        auto d = detail::depth_of(k);
+        return ((k - (std::uint64_t(1) << d)) * 2 + 1) * (std::uint64_t(1) << (height_ - 1 - d)) - 1;
+    }
+
+    const Comparable &at(std::uint64_t k) const {
+        std::uint64_t pos[MAX_HEIGHT];
+        auto depth = detail::depth_of(k);
+        for (unsigned d = 0; d <= depth; ++d) {
+            locate(k >> (depth - d), d, pos);
+        }
+
+        return elements_[pos[depth]];
+    }
+
+    std::uint64_t next(std::uint64_t k) const noexcept {
+        k = detail::successor(k, capacity());
+        return k && rank(k) < size_ ? k : 0;
+    }
+
+    std::uint64_t prev(std::uint64_t k) const noexcept {
+        return detail::predecessor(k, capacity());
+    }
+
+    // BFS index of rank size_ - 1.
+    std::uint64_t last() const noexcept {
+        if (!size_) {
+            return 0;
+        }
+
+        std::uint64_t r = size_;
+        auto j = detail::trailing_zeros(r);
+        auto d = height_ - 1 - j;
+        return (std::uint64_t(1) << d) + (r >> (j + 1));
+    }
+};
+
+// Snapshots of any tree with in-order iterators and key_comp(), e.g.
+// AvlTree; the snapshot searches in the tree's own order.
+template <typename Tree>
+EytzingerSet<typename Tree::const_iterator::value_type, typename Tree::key_compare> freeze(const Tree &tree) {
+    return EytzingerSet<typename Tree::const_iterator::value_type, typename Tree::key_compare>(
+        tree.begin(), tree.end(), tree.key_comp());
+}
+
+template <typename Tree>
+VebSet<typename Tree::const_iterator::value_type, typename Tree::key_compare> freeze_veb(const Tree &tree) {
+    return VebSet<typename Tree::const_iterator::value_type, typename Tree::key_compare>(
+        tree.begin(), tree.end(), tree.key_comp());
+}
+
+}
+
+#endif // FROZEN_SET_H_
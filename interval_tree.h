@@ -0,0 +1,137 @@
+#ifndef INTERVAL_TREE_H_
+#define INTERVAL_TREE_H_
+
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "avl_tree.h"
+
+namespace tree {
+
+// Closed interval [lo_, hi_], ordered by lo_ and then by hi_.
+template <typename T>
+struct Interval {
+    T lo_;
+    T hi_;
+
+    bool overlaps(const T &lo, const T &hi) const {
+        return !(hi < lo_) && !(hi_ < lo);
+    }
+
+    bool operator<(const Interval &other) const {
+        return lo_ < other.lo_ || (!(other.lo_ < lo_) && hi_ < other.hi_);
+    }
+};
+
+// Largest right endpoint in a subtree.
+template <typename T>
+struct MaxEndpoint {
+    using value_type = T;
+
+    static value_type identity() {
+        return std::numeric_limits<T>::lowest();
+    }
+
+    static value_type lift(const Interval<T> &e) {
+        return e.hi_;
+    }
+
+    static value_type combine(const value_type &left, const value_type &right) {
+        return left < right ? right : left;
+    }
+};
+
+// AvlTree of intervals where every node also knows the largest right
+// endpoint below it, kept up to date by the augmentation hooks through
+// every rotation. Subtrees ending before a query start are skipped, which
+// makes overlap queries O(log n + k). Like AvlTree it is a set: inserting
+// an interval that is already there does nothing.
+template <typename T, typename Allocator = std::allocator<Interval<T>>>
+class IntervalTree : public AvlTree<Interval<T>, 1, Allocator, MaxEndpoint<T>> {
+    using Base = AvlTree<Interval<T>, 1, Allocator, MaxEndpoint<T>>;
+    using AvlNode = typename Base::AvlNode;
+
+  public:
+    using Base::Base;
+    using Base::insert;
+    using Base::remove;
+    using Base::contains;
+
+    void insert(const T &lo, const T &hi) {
+        Base::insert(Interval<T>{lo, hi});
+    }
+
+    void remove(const T &lo, const T &hi) {
+        Base::remove(Interval<T>{lo, hi});
+    }
+
+    bool contains(const T &lo, const T &hi) const noexcept {
+        return Base::contains(Interval<T>{lo, hi});
+    }
+
+    // Writes every stored interval overlapping [lo, hi] to out, ordered by
+    // start point.
+    template <typename OutputIt>
+    OutputIt overlapping(const T &lo, const T &hi, OutputIt out) const {
+        if (!(hi < lo)) {
+            out = overlapping(this->root_, lo, hi, out);
+        }
+
+        return out;
+    }
+
+    std::vector<Interval<T>> overlapping(const T &lo, const T &hi) const {
+        std::vector<Interval<T>> result;
+        overlapping(lo, hi, std::back_inserter(result));
+        return result;
+    }
+
+    // Whether any stored interval overlaps [lo, hi], in O(log n).
+    bool any_overlap(const T &lo, const T &hi) const noexcept {
+        if (hi < lo) {
+            return false;
+        }
+
+        auto node = this->root_;
+        while (node) {
+            if (node->element_.overlaps(lo, hi)) {
+                return true;
+            }
+
+            // if the left subtree reaches lo but holds no overlap, every
+            // interval there starts after hi, and so does the right subtree
+            if (node->left_ && !(node->left_->summary_ < lo)) {
+                node = node->left_;
+            } else {
+                node = node->right_;
+            }
+        }
+
+        return false;
+    }
+
+  private:
+    template <typename OutputIt>
+    static OutputIt overlapping(const AvlNode *node, const T &lo, const T &hi, OutputIt out) {
+        while (node && !(node->summary_ < lo)) {
+            out = overlapping(node->left_, lo, hi, out);
+            if (hi < node->element_.lo_) {
+                // this and everything to the right start too late
+                break;
+            }
+
+            if (!(node->element_.hi_ < lo)) {
+                *out++ = node->element_;
+            }
+            node = node->right_;
+        }
+
+        return out;
+    }
+};
+
+}
+
+#endif // INTERVAL_TREE_H_
@@ -0,0 +1,344 @@
+#ifndef MAPPED_AVL_TREE_H_
+#define MAPPED_AVL_TREE_H_
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "compact_avl_tree.h"
+#include "tree_serialize.h"
+
+namespace tree {
+
+struct BadMappedTree : public std::exception {
+    const char *what() const noexcept override {
+        return "BadMappedTree";
+    }
+};
+
+// CompactAvlTree node store in a file mapped with MAP_SHARED: a page of
+// header, then the node array. Nodes link by index, so the file means
+// the same wherever it is mapped, and the root, free list and size live in
+// the header, so the file is up to date after every completed insert or
+// remove, in the page cache at least; sync() pushes it to the disk.
+//
+// The header records whether the file was closed cleanly. Opening checks
+// the header and clears the flag until the store is closed again; a file
+// left unclean by a crash needs a full check before it can be trusted.
+// The format is the machine's own: node layout, byte order and all.
+template <typename Comparable>
+class MappedNodeStore {
+    static_assert(std::is_trivially_copyable<Comparable>::value,
+                  "MappedNodeStore keeps elements as raw bytes in a file");
+
+    using Node = CompactAvlNode<Comparable>;
+
+    struct Header {
+        char magic_[4];
+        std::uint8_t version_;
+        std::uint8_t key_tag_;
+        std::uint16_t key_size_;
+        std::uint32_t node_size_;
+        std::uint32_t imbalance_;
+        std::uint32_t clean_;
+        std::uint32_t root_;
+        std::uint32_t free_;
+        std::uint32_t unused_;
+        std::uint64_t capacity_;
+        std::uint64_t used_;
+        std::uint64_t size_;
+    };
+
+    static constexpr char MAGIC[4] = {'T', 'R', 'M', 'P'};
+    static constexpr std::uint8_t VERSION = 1;
+    static constexpr std::size_t HEADER_BYTES = 4096;
+    static constexpr std::uint64_t MIN_CAPACITY = 1024;
+
+  public:
+    // Opens path, or makes it a new empty tree if it is missing or empty.
+    // imbalance is recorded, a tree is only reopened with its own.
+    MappedNodeStore(const std::string &path, std::uint32_t imbalance)
+    : fd_(-1)
+    , base_(nullptr)
+    , bytes_(0)
+    , was_clean_(true)
+    {
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            throw BadMappedTree();
+        }
+
+        try {
+            struct stat st;
+            if (::fstat(fd_, &st) != 0) {
+                throw BadMappedTree();
+            }
+
+            if (0 == st.st_size) {
+                resize_file(bytes_for(MIN_CAPACITY));
+                map(bytes_for(MIN_CAPACITY));
+                auto &h = header();
+                std::memcpy(h.magic_, MAGIC, sizeof(MAGIC));
+                h.version_ = VERSION;
+                h.key_tag_ = KeyCodec<Comparable>::TAG;
+                h.key_size_ = sizeof(Comparable);
+                h.node_size_ = sizeof(Node);
+                h.imbalance_ = imbalance;
+                h.capacity_ = MIN_CAPACITY;
+            } else {
+                if (static_cast<std::uint64_t>(st.st_size) < HEADER_BYTES) {
+                    throw BadMappedTree();
+                }
+                map(static_cast<std::size_t>(st.st_size));
+                if (!header_valid(imbalance)) {
+                    throw BadMappedTree();
+                }
+            }
+        } catch (...) {
+            close(false);
+            throw;
+        }
+
+        was_clean_ = header().clean_ != 0;
+        header().clean_ = 0;
+    }
+
+    MappedNodeStore(const MappedNodeStore &) = delete;
+    MappedNodeStore &operator=(const MappedNodeStore &) = delete;
+
+    MappedNodeStore(MappedNodeStore &&other) noexcept
+    : fd_(other.fd_)
+    , base_(other.base_)
+    , bytes_(other.bytes_)
+    , was_clean_(other.was_clean_)
+    {
+        other.fd_ = -1;
+        other.base_ = nullptr;
+        other.bytes_ = 0;
+    }
+
+    MappedNodeStore &operator=(MappedNodeStore &&other) noexcept {
+        if (this != &other) {
+            close(true);
+            std::swap(fd_, other.fd_);
+            std::swap(base_, other.base_);
+            std::swap(bytes_, other.bytes_);
+            was_clean_ = other.was_clean_;
+        }
+
+        return *this;
+    }
+
+    ~MappedNodeStore() {
+        close(true);
+    }
+
+    Node &operator[](std::size_t i) noexcept {
+        return nodes()[i];
+    }
+
+    const Node &operator[](std::size_t i) const noexcept {
+        return nodes()[i];
+    }
+
+    std::size_t size() const noexcept {
+        return base_ ? static_cast<std::size_t>(header().used_) : 0;
+    }
+
+    template <typename T>
+    void emplace_back(T &&e) {
+        if (header().used_ == header().capacity_) {
+            grow(2 * header().capacity_);
+        }
+        new (&nodes()[header().used_]) Node(std::forward<T>(e));
+        ++header().used_;
+    }
+
+    void reserve(std::size_t n) {
+        if (n > header().capacity_) {
+            grow(n);
+        }
+    }
+
+    // Forgets every node; the file keeps its size for the next ones.
+    void clear() noexcept {
+        if (base_) {
+            auto &h = header();
+            h.used_ = h.size_ = 0;
+            h.root_ = h.free_ = 0;
+        }
+    }
+
+    std::uint32_t &root() noexcept {
+        return header().root_;
+    }
+
+    std::uint32_t root() const noexcept {
+        return base_ ? header().root_ : 0;
+    }
+
+    std::uint32_t &free_list() noexcept {
+        return header().free_;
+    }
+
+    std::uint32_t free_list() const noexcept {
+        return base_ ? header().free_ : 0;
+    }
+
+    std::uint64_t &count() noexcept {
+        return header().size_;
+    }
+
+    std::uint64_t count() const noexcept {
+        return base_ ? header().size_ : 0;
+    }
+
+    // Whether the file had been closed cleanly before it was opened.
+    bool was_clean() const noexcept {
+        return was_clean_;
+    }
+
+    // Writes the dirty pages back and waits for the disk.
+    void sync() {
+        if (base_ && ::msync(base_, bytes_, MS_SYNC) != 0) {
+            throw BadMappedTree();
+        }
+    }
+
+    // Unmaps and closes the file, marking it clean or leaving it as it is.
+    void close(bool clean) noexcept {
+        if (base_) {
+            if (clean) {
+                header().clean_ = 1;
+                ::msync(base_, bytes_, MS_SYNC);
+            }
+            ::munmap(base_, bytes_);
+            base_ = nullptr;
+            bytes_ = 0;
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+  private:
+    int fd_;
+    char *base_;
+    std::size_t bytes_;
+    bool was_clean_;
+
+    static std::size_t bytes_for(std::uint64_t capacity) noexcept {
+        return HEADER_BYTES + static_cast<std::size_t>(capacity) * sizeof(Node);
+    }
+
+    Header &header() noexcept {
+        return *reinterpret_cast<Header *>(base_);
+    }
+
+    const Header &header() const noexcept {
+        return *reinterpret_cast<const Header *>(base_);
+    }
+
+    Node *nodes() noexcept {
+        return reinterpret_cast<Node *>(base_ + HEADER_BYTES);
+    }
+
+    const Node *nodes() const noexcept {
+        return reinterpret_cast<const Node *>(base_ + HEADER_BYTES);
+    }
+
+    bool header_valid(std::uint32_t imbalance) const noexcept {
+        const auto &h = header();
+        return 0 == std::memcmp(h.magic_, MAGIC, sizeof(MAGIC)) && VERSION == h.version_ &&
+               KeyCodec<Comparable>::TAG == h.key_tag_ && sizeof(Comparable) == h.key_size_ &&
+               sizeof(Node) == h.node_size_ && imbalance == h.imbalance_ && h.capacity_ > 0 &&
+               h.capacity_ <= (bytes_ - HEADER_BYTES) / sizeof(Node) && h.used_ <= h.capacity_ &&
+               h.size_ <= h.used_ && h.root_ <= h.used_ && h.free_ <= h.used_;
+    }
+
+    void resize_file(std::size_t bytes) {
+        int result;
+        do {
+            result = ::ftruncate(fd_, static_cast<off_t>(bytes));
+        } while (result != 0 && EINTR == errno);
+        if (result != 0) {
+            throw std::bad_alloc();
+        }
+    }
+
+    void map(std::size_t bytes) {
+        auto p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (MAP_FAILED == p) {
+            throw BadMappedTree();
+        }
+        base_ = static_cast<char *>(p);
+        bytes_ = bytes;
+    }
+
+    // Nodes move with the mapping, indices don't.
+    void grow(std::uint64_t capacity) {
+        auto bytes = bytes_for(capacity);
+        resize_file(bytes);
+#ifdef __linux__
+        auto p = ::mremap(base_, bytes_, bytes, MREMAP_MAYMOVE);
+        if (MAP_FAILED == p) {
+            throw std::bad_alloc();
+        }
+        base_ = static_cast<char *>(p);
+        bytes_ = bytes;
+#else
+        ::munmap(base_, bytes_);
+        base_ = nullptr;
+        map(bytes);
+#endif
+        header().capacity_ = capacity;
+    }
+};
+
+template <typename Comparable>
+constexpr char MappedNodeStore<Comparable>::MAGIC[4];
+
+// CompactAvlTree whose nodes live in a file. Opening one maps the file
+// and checks its header, so even a multi-GB tree is back in an instant;
+// pages come in as lookups touch them. Only a file that was not closed
+// cleanly gets the full O(n) check(); it throws BadMappedTree if that
+// fails, or if the header doesn't match Comparable and ALLOWED_IMBALANCE.
+//
+// Every completed insert and remove is in the file as far as a crash of
+// the process goes; sync() makes it so for a crash of the machine.
+template <typename Comparable, char ALLOWED_IMBALANCE = 1>
+class MappedAvlTree
+: public CompactAvlTree<Comparable, ALLOWED_IMBALANCE, std::allocator<Comparable>, MappedNodeStore<Comparable>> {
+    using Base = CompactAvlTree<Comparable, ALLOWED_IMBALANCE, std::allocator<Comparable>, MappedNodeStore<Comparable>>;
+
+  public:
+    explicit MappedAvlTree(const std::string &path, bool full_check = false)
+    : Base(MappedNodeStore<Comparable>(path, ALLOWED_IMBALANCE))
+    {
+        if ((full_check || !this->store().was_clean()) && !this->check()) {
+            // leave the file as it is, unclean
+            this->store().close(false);
+            throw BadMappedTree();
+        }
+    }
+
+    void sync() {
+        this->store().sync();
+    }
+};
+
+}
+
+#endif // MAPPED_AVL_TREE_H_
@@ -0,0 +1,321 @@
+#ifndef NODE_POOL_H_
+#define NODE_POOL_H_
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace tree {
+
+namespace detail {
+
+// ::operator new and delete for blocks aligned to align. The aligned
+// overloads came with C++17; before that, as with std::allocator, types
+// aligned beyond what new guarantees are not supported.
+inline void *aligned_new(std::size_t bytes, std::size_t align) {
+#ifdef __cpp_aligned_new
+    if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        return ::operator new(bytes, std::align_val_t(align));
+    }
+#endif
+    (void)align;
+    return ::operator new(bytes);
+}
+
+inline void aligned_delete(void *p, std::size_t align) noexcept {
+#ifdef __cpp_aligned_new
+    if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        ::operator delete(p, std::align_val_t(align));
+        return;
+    }
+#endif
+    (void)align;
+    ::operator delete(p);
+}
+
+}
+
+// Fixed-size block allocator. Blocks are carved out of large slabs with a
+// bump pointer and recycled through an intrusive free list, so allocate()
+// and deallocate() are O(1) and nodes of one tree stay close together.
+// release() hands every slab back at once, in O(#slabs).
+class NodePool {
+  public:
+    static constexpr std::size_t DEFAULT_SLAB_BYTES = 64 * 1024;
+    static constexpr std::size_t HUGE_PAGE_BYTES = 2 * 1024 * 1024;
+
+    NodePool(std::size_t block_size, std::size_t block_align, bool huge_pages = false)
+    : block_size_(round_up(block_size < sizeof(FreeBlock) ? sizeof(FreeBlock) : block_size,
+                           block_align < alignof(FreeBlock) ? alignof(FreeBlock) : block_align))
+    , block_align_(block_align < alignof(FreeBlock) ? alignof(FreeBlock) : block_align)
+    , slab_bytes_(huge_pages ? HUGE_PAGE_BYTES : DEFAULT_SLAB_BYTES)
+    , huge_pages_(huge_pages)
+    , slabs_(nullptr)
+    , free_(nullptr)
+    , cursor_(nullptr)
+    , end_(nullptr)
+    {
+        if (slab_bytes_ < block_size_ + header_bytes()) {
+            slab_bytes_ = round_up(block_size_ + header_bytes(), DEFAULT_SLAB_BYTES);
+        }
+    }
+
+    NodePool(const NodePool &) = delete;
+    NodePool &operator=(const NodePool &) = delete;
+
+    ~NodePool() {
+        release();
+    }
+
+    void *allocate() {
+        if (free_) {
+            auto block = free_;
+            free_ = free_->next_;
+            return block;
+        }
+
+        if (cursor_ == end_) {
+            add_slab();
+        }
+
+        auto block = cursor_;
+        cursor_ += block_size_;
+        return block;
+    }
+
+    void deallocate(void *p) noexcept {
+        auto block = static_cast<FreeBlock *>(p);
+        block->next_ = free_;
+        free_ = block;
+    }
+
+    void release() noexcept {
+        while (slabs_) {
+            auto next = slabs_->next_;
+            free_slab(slabs_);
+            slabs_ = next;
+        }
+
+        free_ = nullptr;
+        cursor_ = end_ = nullptr;
+    }
+
+    std::size_t block_size() const noexcept {
+        return block_size_;
+    }
+
+  private:
+    struct FreeBlock {
+        FreeBlock *next_;
+    };
+
+    struct Slab {
+        Slab *next_;
+    };
+
+    std::size_t block_size_;
+    std::size_t block_align_;
+    std::size_t slab_bytes_;
+    bool huge_pages_;
+    Slab *slabs_;
+    FreeBlock *free_;
+    char *cursor_;
+    char *end_;
+
+    static std::size_t round_up(std::size_t n, std::size_t align) noexcept {
+        return (n + align - 1) / align * align;
+    }
+
+    std::size_t header_bytes() const noexcept {
+        return round_up(sizeof(Slab), block_align_);
+    }
+
+    void add_slab() {
+        auto slab = static_cast<Slab *>(allocate_slab());
+        slab->next_ = slabs_;
+        slabs_ = slab;
+
+        auto base = reinterpret_cast<char *>(slab);
+        cursor_ = base + header_bytes();
+        end_ = cursor_ + (slab_bytes_ - header_bytes()) / block_size_ * block_size_;
+    }
+
+    void *allocate_slab() {
+#ifdef __linux__
+        if (huge_pages_) {
+            auto p = mmap(nullptr, slab_bytes_, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p == MAP_FAILED) {
+                // no reserved huge pages, fall back to transparent huge pages
+                p = mmap(nullptr, slab_bytes_, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (p == MAP_FAILED) {
+                    throw std::bad_alloc();
+                }
+                madvise(p, slab_bytes_, MADV_HUGEPAGE);
+            }
+            return p;
+        }
+#endif
+        return detail::aligned_new(slab_bytes_, block_align_);
+    }
+
+    void free_slab(Slab *slab) noexcept {
+#ifdef __linux__
+        if (huge_pages_) {
+            munmap(slab, slab_bytes_);
+            return;
+        }
+#endif
+        detail::aligned_delete(slab, block_align_);
+    }
+};
+
+// The pools behind one PoolAllocator and every allocator copied or rebound
+// from it, one pool per block size and alignment. A tree rebinds its
+// allocator to its node type, so a handful of entries is all there is.
+class PoolSet {
+  public:
+    explicit PoolSet(bool huge_pages) : huge_pages_(huge_pages) {}
+
+    PoolSet(const PoolSet &) = delete;
+    PoolSet &operator=(const PoolSet &) = delete;
+
+    NodePool &pool(std::size_t size, std::size_t align) {
+        for (auto &entry : pools_) {
+            if (entry.size_ == size && entry.align_ == align) {
+                return *entry.pool_;
+            }
+        }
+
+        std::unique_ptr<NodePool> pool(new NodePool(size, align, huge_pages_));
+        pools_.push_back(Entry{size, align, std::move(pool)});
+        return *pools_.back().pool_;
+    }
+
+    void release() noexcept {
+        for (auto &entry : pools_) {
+            entry.pool_->release();
+        }
+    }
+
+  private:
+    struct Entry {
+        std::size_t size_;
+        std::size_t align_;
+        std::unique_ptr<NodePool> pool_;
+    };
+
+    bool huge_pages_;
+    std::vector<Entry> pools_;
+};
+
+// Standard allocator on top of NodePool. A default-constructed allocator
+// starts a PoolSet of its own, which its copies and rebinds share and
+// compare equal on, so trees built from one allocator can trade nodes.
+// The pool follows the tree on move/swap, and a copied tree starts a fresh
+// one. Like the pools, allocators sharing a set are for one thread at a
+// time. Only single-object requests come from the pool, anything else goes
+// to ::operator new, the aligned one for over-aligned T.
+template <typename T, bool HUGE_PAGES = false>
+class PoolAllocator {
+  public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    template <typename U>
+    struct rebind {
+        using other = PoolAllocator<U, HUGE_PAGES>;
+    };
+
+    PoolAllocator()
+    : pools_(std::make_shared<PoolSet>(HUGE_PAGES))
+    , pool_(&pools_->pool(sizeof(T), alignof(T)))
+    {}
+
+    // copying shares the pool, also when a tree is moved
+    PoolAllocator(const PoolAllocator &) = default;
+    PoolAllocator &operator=(const PoolAllocator &) = default;
+
+    // rebinding shares the set, and the pool too if the sizes match
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, HUGE_PAGES> &other)
+    : pools_(other.pools_)
+    , pool_(&pools_->pool(sizeof(T), alignof(T)))
+    {}
+
+    T *allocate(std::size_t n) {
+        if (1 == n) {
+            return static_cast<T *>(pool_->allocate());
+        }
+
+        return static_cast<T *>(detail::aligned_new(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept {
+        if (1 == n) {
+            pool_->deallocate(p);
+        } else {
+            detail::aligned_delete(p, alignof(T));
+        }
+    }
+
+    // Frees every block of every pool in the set in O(#slabs), but only if
+    // nobody else shares the set. Returns false when the caller has to
+    // free blocks one by one.
+    bool try_release() noexcept {
+        if (pools_.use_count() != 1) {
+            return false;
+        }
+
+        pools_->release();
+        return true;
+    }
+
+    PoolAllocator select_on_container_copy_construction() const {
+        return PoolAllocator();
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U, HUGE_PAGES> &other) const noexcept {
+        return pools_ == other.pools_;
+    }
+
+    template <typename U>
+    bool operator!=(const PoolAllocator<U, HUGE_PAGES> &other) const noexcept {
+        return pools_ != other.pools_;
+    }
+
+  private:
+    template <typename U, bool>
+    friend class PoolAllocator;
+
+    std::shared_ptr<PoolSet> pools_;
+    NodePool *pool_;
+};
+
+template <typename T>
+using HugePagePoolAllocator = PoolAllocator<T, true>;
+
+// Detects allocators that can drop all of their memory at once.
+template <typename Alloc, typename = void>
+struct has_try_release : std::false_type {};
+
+template <typename Alloc>
+struct has_try_release<Alloc, decltype(static_cast<void>(std::declval<Alloc &>().try_release()))>
+: std::true_type {};
+
+}
+
+#endif // NODE_POOL_H_
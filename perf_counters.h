@@ -0,0 +1,207 @@
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace tree {
+
+enum PerfEvent : unsigned char {
+    CYCLES,
+    INSTRUCTIONS,
+    L1D_MISSES,
+    LLC_MISSES,
+    DTLB_MISSES,
+    BRANCH_MISSES,
+
+    PERF_EVENTS,
+};
+
+inline const char *perf_event_name(PerfEvent e) noexcept {
+    static const char *const NAMES[PERF_EVENTS] = {
+        "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "branch_misses",
+    };
+    return e < PERF_EVENTS ? NAMES[e] : "unknown";
+}
+
+// What the counters saw between start() and stop(). A counter that could
+// not be opened, or never got onto the PMU, is not available; the others
+// are scaled up for the time the kernel had them multiplexed out.
+struct PerfReading {
+    double values_[PERF_EVENTS];
+    bool available_[PERF_EVENTS];
+
+    PerfReading() noexcept : values_(), available_() {}
+
+    bool available(PerfEvent e) const noexcept {
+        return available_[e];
+    }
+
+    double operator[](PerfEvent e) const noexcept {
+        return values_[e];
+    }
+};
+
+// Hardware counters of the calling thread, user space only, through
+// perf_event_open(2). Whatever can't be had - another OS, no PMU in a VM,
+// perf_event_paranoid too strict, a counter the CPU lacks - is left out
+// rather than reported as an error: available() says which counters work
+// and error() the errno of the first one that didn't.
+//
+//     PerfCounters counters;
+//     counters.start();
+//     ... a batch of operations ...
+//     auto reading = counters.stop();
+//
+// The counters are opened one by one, not as a group, so the kernel can
+// multiplex them when there are more than the PMU has room for.
+class PerfCounters {
+  public:
+    PerfCounters() : error_(0) {
+        for (int i = 0; i < PERF_EVENTS; ++i) {
+            fds_[i] = open(static_cast<PerfEvent>(i));
+            if (fds_[i] < 0 && !error_) {
+                error_ = errno ? errno : ENOSYS;
+            }
+        }
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (auto fd : fds_) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+#endif
+    }
+
+    bool available(PerfEvent e) const noexcept {
+        return fds_[e] >= 0;
+    }
+
+    // Whether any counter at all works.
+    bool any() const noexcept {
+        for (auto fd : fds_) {
+            if (fd >= 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int error() const noexcept {
+        return error_;
+    }
+
+    void start() noexcept {
+#ifdef __linux__
+        for (auto fd : fds_) {
+            if (fd >= 0) {
+                ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    PerfReading stop() noexcept {
+        PerfReading reading;
+#ifdef __linux__
+        for (auto fd : fds_) {
+            if (fd >= 0) {
+                ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+
+        for (int i = 0; i < PERF_EVENTS; ++i) {
+            // value, time enabled, time running
+            std::uint64_t data[3];
+            if (fds_[i] < 0 || ::read(fds_[i], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) ||
+                0 == data[2]) {
+                continue;
+            }
+            reading.values_[i] = static_cast<double>(data[0]) * data[1] / data[2];
+            reading.available_[i] = true;
+        }
+#endif
+        return reading;
+    }
+
+    // Runs f between start() and stop().
+    template <typename F>
+    PerfReading measure(F &&f) {
+        start();
+        f();
+        return stop();
+    }
+
+  private:
+    int fds_[PERF_EVENTS];
+    int error_;
+
+    static int open(PerfEvent e) noexcept {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        auto cache = [](std::uint64_t id, std::uint64_t op, std::uint64_t result) {
+            return id | (op << 8) | (result << 16);
+        };
+        switch (e) {
+        case CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case L1D_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+            break;
+        case LLC_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case DTLB_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+            break;
+        default:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        }
+
+        errno = 0;
+        // this thread, on any CPU
+        return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+#else
+        (void)e;
+        errno = ENOSYS;
+        return -1;
+#endif
+    }
+};
+
+}
+
+#endif // PERF_COUNTERS_H_
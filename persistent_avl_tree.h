@@ -0,0 +1,351 @@
+#ifndef PERSISTENT_AVL_TREE_H_
+#define PERSISTENT_AVL_TREE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <utility>
+
+#include "tree_compare.h"
+#include "tree_iterator.h"
+#include "tree_shape.h"
+
+namespace tree {
+
+struct EmptyPersistentTree : public std::exception {
+    const char *what() const noexcept override {
+        return "EmptyPersistentTree";
+    }
+};
+
+// AVL tree whose nodes never change once built.
+//
+// insert and remove copy the path from the root down to the change, plus
+// the few nodes a rotation touches, and share every other subtree with the
+// previous version: O(log n) new nodes per update. Nodes are reference
+// counted, a subtree lives as long as some version still points at it.
+//
+// Copying a tree is therefore O(1) and snapshot() says so: the copy is a
+// version of its own that later updates of either tree don't affect. A
+// version may be read, and dropped, on any thread while other versions
+// are updated on theirs; one and the same tree object still needs the
+// usual external synchronization, so the writer takes the snapshot and
+// hands it to the readers.
+template <typename Comparable, typename Compare = std::less<Comparable>>
+class PersistentAvlTree {
+  private:
+    struct Node;
+
+  public:
+    using key_compare = Compare;
+    using const_iterator = PathIterator<Node, Comparable>;
+    using iterator = const_iterator;
+
+    explicit PersistentAvlTree(const Compare &comp = Compare()) : comp_(comp), size_(0) {}
+
+    PersistentAvlTree(const PersistentAvlTree &) = default;
+    PersistentAvlTree &operator=(const PersistentAvlTree &) = default;
+
+    PersistentAvlTree(PersistentAvlTree &&other) noexcept
+    : comp_(other.comp_)
+    , root_(std::move(other.root_))
+    , size_(other.size_)
+    {
+        other.size_ = 0;
+    }
+
+    PersistentAvlTree &operator=(PersistentAvlTree &&other) noexcept {
+        comp_ = other.comp_;
+        root_ = std::move(other.root_);
+        size_ = other.size_;
+        other.size_ = 0;
+        return *this;
+    }
+
+    // The current version, in O(1).
+    PersistentAvlTree snapshot() const {
+        return *this;
+    }
+
+    const Comparable &findMin() const {
+        if (!root_) {
+            throw EmptyPersistentTree();
+        }
+
+        return *begin();
+    }
+
+    const Comparable &findMax() const {
+        if (!root_) {
+            throw EmptyPersistentTree();
+        }
+
+        return *--end();
+    }
+
+    bool contains(const Comparable &e) const {
+        for (auto node = root_.get(); node;) {
+            auto order = comp_.compare(e, node->element_);
+            if (0 == order) {
+                return true;
+            }
+            node = order < 0 ? node->left_.get() : node->right_.get();
+        }
+
+        return false;
+    }
+
+    bool isEmpty() const noexcept {
+        return !root_;
+    }
+
+    std::size_t size() const noexcept {
+        return size_;
+    }
+
+    Compare key_comp() const {
+        return comp_.get();
+    }
+
+    void printTree(std::ostream &os = std::cout) const {
+        for (const auto &e : *this) {
+            os << e << std::endl;
+        }
+    }
+
+    // Shape and memory of this version, see tree_shape.h, in O(n). Any
+    // thread may measure a snapshot while the writer carries on.
+    TreeShape stats() const {
+        auto child = [](const Node *node, bool right) {
+            return right ? node->right_.get() : node->left_.get();
+        };
+        return measure_shape(root_.get(), child, AllocationFootprint<std::allocator<Node>>::bytes(sizeof(Node), alignof(Node)));
+    }
+
+    // Drops this version; nodes other versions share stay.
+    void makeEmpty() noexcept {
+        root_.reset();
+        size_ = 0;
+    }
+
+    void insert(const Comparable &e) {
+        if (!contains(e)) {
+            root_ = insert(root_.get(), e);
+            ++size_;
+        }
+    }
+
+    void insert(Comparable &&e) {
+        if (!contains(e)) {
+            root_ = insert(root_.get(), std::move(e));
+            ++size_;
+        }
+    }
+
+    void remove(const Comparable &e) {
+        if (contains(e)) {
+            root_ = remove(root_.get(), e);
+            --size_;
+        }
+    }
+
+    const_iterator begin() const {
+        return const_iterator::first(root_.get());
+    }
+
+    const_iterator end() const {
+        return const_iterator(root_.get());
+    }
+
+    const_iterator lower_bound(const Comparable &e) const {
+        return const_iterator::lower_bound(root_.get(), e, comp_);
+    }
+
+    const_iterator upper_bound(const Comparable &e) const {
+        return const_iterator::upper_bound(root_.get(), e, comp_);
+    }
+
+  private:
+    // Owning pointer to a shared node, like an intrusive shared_ptr.
+    class Ref {
+      public:
+        Ref() noexcept : node_(nullptr) {}
+
+        // adopts a fresh node, whose count starts at one
+        explicit Ref(Node *node) noexcept : node_(node) {}
+
+        Ref(const Ref &other) noexcept : node_(other.node_) {
+            retain(node_);
+        }
+
+        Ref(Ref &&other) noexcept : node_(other.node_) {
+            other.node_ = nullptr;
+        }
+
+        Ref &operator=(Ref other) noexcept {
+            std::swap(node_, other.node_);
+            return *this;
+        }
+
+        ~Ref() {
+            release(node_);
+        }
+
+        const Node *get() const noexcept {
+            return node_;
+        }
+
+        const Node *operator->() const noexcept {
+            return node_;
+        }
+
+        // PathIterator walks the links as plain pointers
+        operator const Node *() const noexcept {
+            return node_;
+        }
+
+        void reset() noexcept {
+            release(node_);
+            node_ = nullptr;
+        }
+
+      private:
+        Node *node_;
+
+        static void retain(const Node *node) noexcept {
+            if (node) {
+                node->refs_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        // the last one out frees the node, and with it its children's
+        // references; the recursion is as deep as the tree at most
+        static void release(Node *node) noexcept {
+            if (node && 1 == node->refs_.fetch_sub(1, std::memory_order_acq_rel)) {
+                delete node;
+            }
+        }
+    };
+
+    struct Node {
+        Comparable element_;
+        Ref left_;
+        Ref right_;
+        int height_;
+        mutable std::atomic<std::size_t> refs_;
+
+        template <typename T>
+        Node(T &&e, Ref l, Ref r)
+        : element_(std::forward<T>(e))
+        , left_(std::move(l))
+        , right_(std::move(r))
+        , height_(std::max(height_of(left_.get()), height_of(right_.get())) + 1)
+        , refs_(1)
+        {}
+    };
+
+    KeyCompare<Compare> comp_;
+    Ref root_;
+    std::size_t size_;
+
+    static int height_of(const Node *node) noexcept {
+        return node ? node->height_ : -1;
+    }
+
+    template <typename T>
+    static Ref make(T &&e, Ref l, Ref r) {
+        return Ref(new Node(std::forward<T>(e), std::move(l), std::move(r)));
+    }
+
+    // A new node for e over l and r, or a rotated replacement if their
+    // heights differ by two; one of them is the result of a single insert
+    // or remove, so they differ by two at most. Only new nodes are built,
+    // the ones rotated over stay as they are for older versions.
+    template <typename T>
+    static Ref balance(T &&e, Ref l, Ref r) {
+        auto height_left = height_of(l.get());
+        auto height_right = height_of(r.get());
+
+        if (height_left - height_right > 1) {
+            auto left = l.get();
+            if (height_of(left->left_.get()) >= height_of(left->right_.get())) {
+                auto right = make(std::forward<T>(e), left->right_, std::move(r));
+                return make(left->element_, left->left_, std::move(right));
+            }
+
+            auto middle = left->right_.get();
+            auto right = make(std::forward<T>(e), middle->right_, std::move(r));
+            auto new_left = make(left->element_, left->left_, middle->left_);
+            return make(middle->element_, std::move(new_left), std::move(right));
+        }
+
+        if (height_right - height_left > 1) {
+            auto right = r.get();
+            if (height_of(right->right_.get()) >= height_of(right->left_.get())) {
+                auto left = make(std::forward<T>(e), std::move(l), right->left_);
+                return make(right->element_, std::move(left), right->right_);
+            }
+
+            auto middle = right->left_.get();
+            auto left = make(std::forward<T>(e), std::move(l), middle->left_);
+            auto new_right = make(right->element_, middle->right_, right->right_);
+            return make(middle->element_, std::move(left), std::move(new_right));
+        }
+
+        return make(std::forward<T>(e), std::move(l), std::move(r));
+    }
+
+    // A new version of the subtree at node with e, which it lacks.
+    template <typename T>
+    Ref insert(const Node *node, T &&e) {
+        if (!node) {
+            return make(std::forward<T>(e), Ref(), Ref());
+        }
+
+        if (comp_(e, node->element_)) {
+            return balance(node->element_, insert(node->left_.get(), std::forward<T>(e)), node->right_);
+        }
+
+        return balance(node->element_, node->left_, insert(node->right_.get(), std::forward<T>(e)));
+    }
+
+    // A new version of the subtree at node without e, which it holds.
+    Ref remove(const Node *node, const Comparable &e) {
+        auto order = comp_.compare(e, node->element_);
+        if (order < 0) {
+            return balance(node->element_, remove(node->left_.get(), e), node->right_);
+        } else if (order > 0) {
+            return balance(node->element_, node->left_, remove(node->right_.get(), e));
+        }
+
+        if (!node->left_) {
+            return node->right_;
+        }
+        if (!node->right_) {
+            return node->left_;
+        }
+
+        // the successor's element takes over node's place
+        const Node *min = nullptr;
+        auto right = remove_min(node->right_.get(), min);
+        return balance(min->element_, node->left_, std::move(right));
+    }
+
+    // The subtree at node without its minimum, which min then points to;
+    // the node stays alive through the version being replaced.
+    Ref remove_min(const Node *node, const Node *&min) {
+        if (!node->left_) {
+            min = node;
+            return node->right_;
+        }
+
+        return balance(node->element_, remove_min(node->left_.get(), min), node->right_);
+    }
+};
+
+}
+
+#endif // PERSISTENT_AVL_TREE_H_
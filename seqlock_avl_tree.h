@@ -0,0 +1,213 @@
+#ifndef SEQLOCK_AVL_TREE_H_
+#define SEQLOCK_AVL_TREE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "avl_tree_impl1.h"
+#include "epoch.h"
+
+namespace tree {
+
+// AvlTree for one writer thread and any number of readers.
+//
+// The writer bumps a sequence counter to odd before it touches the tree
+// and back to even afterwards. Readers take no lock and write no shared
+// cache line: they note the counter, walk the tree and start over if the
+// counter moved meanwhile, i.e. if the walk may have seen a half-done
+// insert, remove or rotation. A walk gives up after more steps than any
+// AVL tree is deep, so a link caught mid-rotation can't trap it.
+//
+// Nodes come from a RetiringAllocator, so a node the writer frees stays
+// readable until every reader that might hold it has left, and a fresh
+// node reads as null links until it is built. Comparable must be
+// trivially copyable: a reader copies elements the writer may be
+// overwriting and only trusts the copy once the counter says so.
+//
+// Only one thread may call the writing members at a time.
+template <typename Comparable, typename Compare = std::less<Comparable>>
+class SeqlockAvlTree {
+    static_assert(std::is_trivially_copyable<Comparable>::value,
+                  "SeqlockAvlTree readers copy elements that may be written concurrently");
+
+    using Tree = AvlTree<Comparable, 1, RetiringAllocator<Comparable>, Compare>;
+    using AvlNode = typename Tree::AvlNode;
+
+    // deeper than any AVL tree that fits in memory
+    static constexpr int MAX_STEPS = 128;
+
+  public:
+    using key_compare = Compare;
+
+    explicit SeqlockAvlTree(const Compare &comp = Compare())
+    : sequence_(0)
+    , tree_(comp, RetiringAllocator<Comparable>(&domain_))
+    {}
+
+    SeqlockAvlTree(const SeqlockAvlTree &) = delete;
+    SeqlockAvlTree &operator=(const SeqlockAvlTree &) = delete;
+
+    // Readers, safe from any thread.
+
+    bool contains(const Comparable &e) const {
+        while (true) {
+            auto sequence = read_begin();
+            // pinned only for the walk, a reader waiting for the writer
+            // must not hold back reclamation
+            auto guard = domain_.pin();
+            auto found = find(e);
+            if (read_validate(sequence)) {
+                return found;
+            }
+        }
+    }
+
+    Comparable findMin() const {
+        return edge(&AvlNode::left_);
+    }
+
+    Comparable findMax() const {
+        return edge(&AvlNode::right_);
+    }
+
+    bool isEmpty() const {
+        return load(tree_.root_) == nullptr;
+    }
+
+    // Writers, one thread at a time.
+
+    template <typename T, typename = enable_if_t<std::is_convertible<T, Comparable>>>
+    void insert(T &&e) {
+        WriteSection section(*this);
+        tree_.insert(std::forward<T>(e));
+    }
+
+    void remove(const Comparable &e) {
+        WriteSection section(*this);
+        tree_.remove(e);
+    }
+
+    template <typename InputIt, typename = require_input_iterator<InputIt>>
+    void insert_batch(InputIt first, InputIt last) {
+        WriteSection section(*this);
+        tree_.insert_batch(first, last);
+    }
+
+    template <typename InputIt, typename = require_input_iterator<InputIt>>
+    void erase_batch(InputIt first, InputIt last) {
+        WriteSection section(*this);
+        tree_.erase_batch(first, last);
+    }
+
+    void makeEmpty() {
+        WriteSection section(*this);
+        tree_.makeEmpty();
+    }
+
+    // The tree itself, for the writer thread only, e.g. to iterate.
+    const Tree &writer_view() const noexcept {
+        return tree_;
+    }
+
+  private:
+    // Marks a write: odd while it lasts, even and bumped once it is over.
+    class WriteSection {
+      public:
+        explicit WriteSection(SeqlockAvlTree &tree) : tree_(tree) {
+            auto sequence = tree_.sequence_.load(std::memory_order_relaxed);
+            tree_.sequence_.store(sequence + 1, std::memory_order_relaxed);
+            // the odd count must be visible before any change to the tree
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        WriteSection(const WriteSection &) = delete;
+        WriteSection &operator=(const WriteSection &) = delete;
+
+        ~WriteSection() {
+            auto sequence = tree_.sequence_.load(std::memory_order_relaxed);
+            tree_.sequence_.store(sequence + 1, std::memory_order_release);
+        }
+
+      private:
+        SeqlockAvlTree &tree_;
+    };
+
+    // destroyed last, the tree retires its nodes into it on the way out
+    mutable EpochDomain domain_;
+    std::atomic<std::uint64_t> sequence_;
+    Tree tree_;
+
+    template <typename T>
+    static T load(const T &field) noexcept {
+#if defined(__GNUC__)
+        return __atomic_load_n(&field, __ATOMIC_RELAXED);
+#else
+        return *static_cast<const volatile T *>(&field);
+#endif
+    }
+
+    std::uint64_t read_begin() const noexcept {
+        auto sequence = sequence_.load(std::memory_order_acquire);
+        while (sequence & 1) {
+            std::this_thread::yield();
+            sequence = sequence_.load(std::memory_order_acquire);
+        }
+
+        return sequence;
+    }
+
+    bool read_validate(std::uint64_t sequence) const noexcept {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return sequence_.load(std::memory_order_relaxed) == sequence;
+    }
+
+    // A copy of the element, possibly torn; only used once validated.
+    static Comparable element_of(const AvlNode *node) noexcept {
+        Comparable element;
+        std::memcpy(static_cast<void *>(&element), &node->element_, sizeof(Comparable));
+        return element;
+    }
+
+    bool find(const Comparable &e) const {
+        auto node = load(tree_.root_);
+        for (int steps = 0; node && steps < MAX_STEPS; ++steps) {
+            auto order = tree_.comp_.compare(e, element_of(node));
+            if (0 == order) {
+                return true;
+            }
+            node = order < 0 ? load(node->left_) : load(node->right_);
+        }
+
+        return false;
+    }
+
+    Comparable edge(AvlNode *AvlNode::*child) const {
+        while (true) {
+            auto sequence = read_begin();
+            auto guard = domain_.pin();
+            const AvlNode *last = nullptr;
+            auto node = load(tree_.root_);
+            for (int steps = 0; node && steps < MAX_STEPS; ++steps) {
+                last = node;
+                node = load(node->*child);
+            }
+
+            Comparable result = last ? element_of(last) : Comparable();
+            if (read_validate(sequence)) {
+                if (!last) {
+                    throw EmptyTree();
+                }
+                return result;
+            }
+        }
+    }
+};
+
+}
+
+#endif // SEQLOCK_AVL_TREE_H_
@@ -0,0 +1,412 @@
+#ifndef SHARDED_AVL_TREE_H_
+#define SHARDED_AVL_TREE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#if __cplusplus >= 201402L
+#include <shared_mutex>
+#endif
+
+#include "avl_tree.h"
+#include "epoch.h"
+
+namespace tree {
+
+namespace detail {
+
+#if __cplusplus >= 201703L
+using SharedMutex = std::shared_mutex;
+#elif __cplusplus >= 201402L
+using SharedMutex = std::shared_timed_mutex;
+#else
+// no reader/writer lock before C++14, readers take turns
+class SharedMutex : public std::mutex {
+  public:
+    void lock_shared() {
+        lock();
+    }
+
+    void unlock_shared() {
+        unlock();
+    }
+};
+#endif
+
+// Holds one shared lock at a time; reset() takes the next one before
+// letting go of the current, so a scan never lets go of the structure.
+class SharedLockHandle {
+  public:
+    SharedLockHandle() : mutex_(nullptr) {}
+
+    SharedLockHandle(const SharedLockHandle &) = delete;
+    SharedLockHandle &operator=(const SharedLockHandle &) = delete;
+
+    ~SharedLockHandle() {
+        reset(nullptr);
+    }
+
+    void reset(SharedMutex *mutex) {
+        if (mutex) {
+            mutex->lock_shared();
+        }
+        if (mutex_) {
+            mutex_->unlock_shared();
+        }
+        mutex_ = mutex;
+    }
+
+  private:
+    SharedMutex *mutex_;
+};
+
+}
+
+// Ordered set that range-partitions its keys over N AvlTrees. Shard i
+// holds the keys in [splitter i - 1, splitter i), each shard has its own
+// reader/writer lock, so point operations only contend with operations on
+// the same shard.
+//
+// The splitters start out empty, which puts every key in shard 0. They
+// are chosen from a sample with choose_splitters() or from the current
+// contents with rebalance(); both move the keys into their new shards
+// while holding every shard lock.
+//
+// An operation reads the splitters without a lock and checks, once it
+// holds its shard, that they are still the same; if not, a rebalance got
+// in between and it starts over. Replaced splitters are freed through an
+// EpochDomain, so the pointer comparison can't be fooled by a reused
+// address.
+template <typename Comparable, std::size_t N, typename Compare = std::less<Comparable>>
+class ShardedAvlTree {
+    static_assert(N > 0, "ShardedAvlTree needs at least one shard");
+
+    using Tree = AvlTree<Comparable, 1, std::allocator<Comparable>, NoAugment, Compare>;
+    using ReadLock = detail::SharedLockHandle;
+    using WriteLock = std::lock_guard<detail::SharedMutex>;
+
+    // aligned so that neighbouring shards never share a cache line
+    struct alignas(64) Shard {
+        mutable detail::SharedMutex lock_;
+        Tree tree_;
+
+        explicit Shard(const Compare &comp) : tree_(comp) {}
+
+#ifndef __cpp_aligned_new
+        // new ignores alignas before C++17: over-allocate, align by hand
+        // and keep the address to free right below the shard
+        static void *operator new(std::size_t bytes) {
+            auto raw = static_cast<char *>(::operator new(bytes + alignof(Shard) + sizeof(void *)));
+            auto at = (reinterpret_cast<std::uintptr_t>(raw) + sizeof(void *) + alignof(Shard) - 1) &
+                      ~static_cast<std::uintptr_t>(alignof(Shard) - 1);
+            reinterpret_cast<void **>(at)[-1] = raw;
+            return reinterpret_cast<void *>(at);
+        }
+
+        static void operator delete(void *p) noexcept {
+            ::operator delete(static_cast<void **>(p)[-1]);
+        }
+#endif
+    };
+
+    // immutable once published
+    struct Layout {
+        std::vector<Comparable> splitters_;
+    };
+
+  public:
+    using key_compare = Compare;
+
+    explicit ShardedAvlTree(const Compare &comp = Compare()) : comp_(comp), layout_(new Layout) {
+        shards_.reserve(N);
+        for (std::size_t i = 0; i < N; ++i) {
+            shards_.emplace_back(new Shard(comp));
+        }
+    }
+
+    ShardedAvlTree(const ShardedAvlTree &) = delete;
+    ShardedAvlTree &operator=(const ShardedAvlTree &) = delete;
+
+    ~ShardedAvlTree() {
+        domain_.drain();
+        delete layout_.load();
+        for (auto shard : shards_) {
+            delete shard;
+        }
+    }
+
+    bool contains(const Comparable &e) const {
+        auto guard = domain_.pin();
+        while (true) {
+            auto layout = layout_.load(std::memory_order_acquire);
+            auto &shard = *shards_[shard_of(*layout, e)];
+            ReadLock lock;
+            lock.reset(&shard.lock_);
+            if (layout_.load(std::memory_order_relaxed) == layout) {
+                return shard.tree_.contains(e);
+            }
+        }
+    }
+
+    template <typename T, typename = enable_if_t<std::is_convertible<T, Comparable>>>
+    void insert(T &&e) {
+        auto guard = domain_.pin();
+        while (true) {
+            auto layout = layout_.load(std::memory_order_acquire);
+            auto &shard = *shards_[shard_of(*layout, e)];
+            WriteLock lock(shard.lock_);
+            if (layout_.load(std::memory_order_relaxed) == layout) {
+                shard.tree_.insert(std::forward<T>(e));
+                return;
+            }
+        }
+    }
+
+    void remove(const Comparable &e) {
+        auto guard = domain_.pin();
+        while (true) {
+            auto layout = layout_.load(std::memory_order_acquire);
+            auto &shard = *shards_[shard_of(*layout, e)];
+            WriteLock lock(shard.lock_);
+            if (layout_.load(std::memory_order_relaxed) == layout) {
+                shard.tree_.remove(e);
+                return;
+            }
+        }
+    }
+
+    Comparable findMin() const {
+        bool found = false;
+        Comparable result = Comparable();
+        scan(nullptr, [&](const Tree &tree) {
+            if (tree.isEmpty()) {
+                return true;
+            }
+            result = tree.findMin();
+            found = true;
+            return false;
+        });
+        if (!found) {
+            throw NullTree();
+        }
+
+        return result;
+    }
+
+    Comparable findMax() const {
+        bool found = false;
+        Comparable result = Comparable();
+        scan(nullptr, [&](const Tree &tree) {
+            if (!tree.isEmpty()) {
+                result = tree.findMax();
+                found = true;
+            }
+            return true;
+        });
+        if (!found) {
+            throw NullTree();
+        }
+
+        return result;
+    }
+
+    bool isEmpty() const {
+        bool empty = true;
+        scan(nullptr, [&](const Tree &tree) {
+            empty = tree.isEmpty();
+            return empty;
+        });
+
+        return empty;
+    }
+
+    // Calls f(e) for every e in [lo, hi] in ascending order. The shards are
+    // visited one after another, each under its read lock, and the next
+    // lock is taken before the last one is let go, so no rebalance can
+    // move keys around behind the scan. f must not modify the tree.
+    template <typename F>
+    void for_each(const Comparable &lo, const Comparable &hi, F f) const {
+        if (comp_(hi, lo)) {
+            return;
+        }
+
+        scan(&lo, [&](const Tree &tree) {
+            for (auto it = tree.lower_bound(lo), last = tree.end(); it != last; ++it) {
+                if (comp_(hi, *it)) {
+                    return false;
+                }
+                f(*it);
+            }
+            return true;
+        });
+    }
+
+    template <typename F>
+    void for_each(F f) const {
+        scan(nullptr, [&](const Tree &tree) {
+            for (const auto &e : tree) {
+                f(e);
+            }
+            return true;
+        });
+    }
+
+    void printTree(std::ostream &os = std::cout) const {
+        for_each([&os](const Comparable &e) {
+            os << e << std::endl;
+        });
+    }
+
+    void makeEmpty() {
+        AllLocks lock(*this);
+        for (auto shard : shards_) {
+            shard->tree_.makeEmpty();
+        }
+    }
+
+    // Picks N - 1 evenly spaced splitters from a sample of keys, which
+    // need not be sorted, and moves the current keys to their new shards.
+    template <typename InputIt>
+    void choose_splitters(InputIt first, InputIt last) {
+        std::vector<Comparable> sample(first, last);
+        std::sort(sample.begin(), sample.end(), comp_);
+        sample.erase(std::unique(sample.begin(), sample.end(),
+                                 [this](const Comparable &a, const Comparable &b) {
+                                     return !comp_(a, b);
+                                 }),
+                     sample.end());
+
+        AllLocks lock(*this);
+        relayout(splitters_from(sample), collect());
+    }
+
+    // Chooses new splitters from N * samples_per_shard keys spread evenly
+    // over the current contents and moves the keys to their new shards.
+    void rebalance(std::size_t samples_per_shard = 64) {
+        AllLocks lock(*this);
+        auto elements = collect();
+
+        std::vector<Comparable> sample;
+        auto samples = std::min(elements.size(), N * samples_per_shard);
+        sample.reserve(samples);
+        for (std::size_t i = 0; i < samples; ++i) {
+            sample.push_back(elements[i * elements.size() / samples]);
+        }
+
+        relayout(splitters_from(sample), std::move(elements));
+    }
+
+  private:
+    KeyCompare<Compare> comp_;
+    std::vector<Shard *> shards_;
+    std::atomic<Layout *> layout_;
+    mutable EpochDomain domain_;
+
+    std::size_t shard_of(const Layout &layout, const Comparable &e) const {
+        return std::upper_bound(layout.splitters_.begin(), layout.splitters_.end(), e, comp_)
+               - layout.splitters_.begin();
+    }
+
+    // Visits the shards in order from the one holding from (the first one
+    // when from is nullptr) until visit returns false, each under its read
+    // lock, taken hand over hand.
+    template <typename Visit>
+    void scan(const Comparable *from, Visit visit) const {
+        auto guard = domain_.pin();
+        ReadLock lock;
+        std::size_t i;
+        while (true) {
+            auto layout = layout_.load(std::memory_order_acquire);
+            i = from ? shard_of(*layout, *from) : 0;
+            lock.reset(&shards_[i]->lock_);
+            if (layout_.load(std::memory_order_relaxed) == layout) {
+                break;
+            }
+            // let go before starting over, the next shard may come first
+            lock.reset(nullptr);
+        }
+
+        // a rebalance needs every lock, the one held keeps it out
+        while (visit(static_cast<const Tree &>(shards_[i]->tree_)) && ++i < N) {
+            lock.reset(&shards_[i]->lock_);
+        }
+    }
+
+    // Every shard locked for writing, always in shard order, so two of them
+    // can't deadlock.
+    class AllLocks {
+      public:
+        explicit AllLocks(ShardedAvlTree &tree) : tree_(tree) {
+            for (auto shard : tree_.shards_) {
+                shard->lock_.lock();
+            }
+        }
+
+        AllLocks(const AllLocks &) = delete;
+        AllLocks &operator=(const AllLocks &) = delete;
+
+        ~AllLocks() {
+            for (auto shard : tree_.shards_) {
+                shard->lock_.unlock();
+            }
+        }
+
+      private:
+        ShardedAvlTree &tree_;
+    };
+
+    // With every lock held: the contents of all shards, in order.
+    std::vector<Comparable> collect() const {
+        std::vector<Comparable> elements;
+        for (auto shard : shards_) {
+            for (const auto &e : shard->tree_) {
+                elements.push_back(e);
+            }
+        }
+
+        return elements;
+    }
+
+    // N - 1 splitters at the quantiles of a sorted, duplicate free sample;
+    // fewer if the sample is too small, the last shards stay empty then.
+    std::vector<Comparable> splitters_from(const std::vector<Comparable> &sample) const {
+        std::vector<Comparable> splitters;
+        for (std::size_t i = 1; i < N; ++i) {
+            auto at = i * sample.size() / N;
+            if (at > 0 && at < sample.size() && (splitters.empty() || comp_(splitters.back(), sample[at]))) {
+                splitters.push_back(sample[at]);
+            }
+        }
+
+        return splitters;
+    }
+
+    // With every lock held: publishes the splitters and rebuilds each shard
+    // from its slice of the sorted elements.
+    void relayout(std::vector<Comparable> splitters, std::vector<Comparable> elements) {
+        auto layout = new Layout;
+        layout->splitters_ = std::move(splitters);
+
+        auto first = elements.begin();
+        for (std::size_t i = 0; i < N; ++i) {
+            auto last = i < layout->splitters_.size()
+                            ? std::lower_bound(first, elements.end(), layout->splitters_[i], comp_)
+                            : elements.end();
+            shards_[i]->tree_.assign_sorted(std::make_move_iterator(first), std::make_move_iterator(last));
+            first = last;
+        }
+
+        auto old = layout_.exchange(layout, std::memory_order_acq_rel);
+        domain_.retire(old);
+    }
+};
+
+}
+
+#endif // SHARDED_AVL_TREE_H_
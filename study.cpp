@@ -49,6 +49,13 @@ int main() {
         if( t.contains( i )  )
             cout << "Find error2!" << endl;
     }
+
+    i = 2;
+    for( auto it = t.begin( ); it != t.end( ); ++it, i += 2 )
+        if( *it != i )
+            cout << "Iterator error!" << endl;
+    if( i != NUMS || *t.lower_bound( 3 ) != 4 || t.upper_bound( NUMS - 2 ) != t.end( ) )
+        cout << "Range error!" << endl;
 #if 0
     AvlTree<int> t2;
     t2 = t;
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#endif
+
+#include "avl_tree.h"
+#include "binary_search_tree.h"
+
+using namespace std;
+using namespace tree;
+
+    // What a CountingAllocator handed out and got back
+struct Counts
+{
+    size_t allocations = 0;
+    size_t deallocations = 0;
+    size_t live_bytes = 0;
+};
+
+    // A stateful allocator: copies share the counts, and two allocators are
+    // equal only if they count into the same Counts
+template <typename T>
+struct CountingAllocator
+{
+    typedef T value_type;
+
+    Counts *counts;
+
+    explicit CountingAllocator( Counts *c ) : counts( c ) { }
+
+    template <typename U>
+    CountingAllocator( const CountingAllocator<U> & rhs ) : counts( rhs.counts ) { }
+
+    T *allocate( size_t n )
+    {
+        ++counts->allocations;
+        counts->live_bytes += n * sizeof( T );
+        return static_cast<T *>( ::operator new( n * sizeof( T ) ) );
+    }
+
+    void deallocate( T *p, size_t n )
+    {
+        ++counts->deallocations;
+        counts->live_bytes -= n * sizeof( T );
+        ::operator delete( p );
+    }
+
+    template <typename U>
+    bool operator==( const CountingAllocator<U> & rhs ) const { return counts == rhs.counts; }
+
+    template <typename U>
+    bool operator!=( const CountingAllocator<U> & rhs ) const { return counts != rhs.counts; }
+};
+
+static bool returned( const Counts & c )
+{
+    return c.allocations == c.deallocations && c.live_bytes == 0;
+}
+
+    // Inserts, removes, copies and moves trees across two allocators and
+    // checks the contents; every node must go back where it came from
+template <typename Tree>
+static void run( const char *name, const vector<int> & keys )
+{
+    Counts mine, theirs;
+    CountingAllocator<int> a( &mine ), b( &theirs );
+    {
+        Tree t( a );
+        set<int> s;
+        for( auto k : keys )
+        {
+            t.insert( k );
+            s.insert( k );
+        }
+        for( size_t i = 0; i < keys.size( ); i += 3 )
+        {
+            t.remove( keys[ i ] );
+            s.erase( keys[ i ] );
+        }
+        if( mine.allocations != keys.size( ) || mine.allocations - mine.deallocations != s.size( ) ||
+            theirs.allocations != 0 )
+            cout << name << " allocation count error!" << endl;
+
+        // a plain copy uses the same allocator, the other constructor another
+        Tree same_alloc( t );
+        Tree other_alloc( t, b );
+        if( mine.allocations - mine.deallocations != 2 * s.size( ) || theirs.allocations != s.size( ) ||
+            !equal( s.begin( ), s.end( ), other_alloc.begin( ) ) ||
+            !equal( s.begin( ), s.end( ), same_alloc.begin( ) ) )
+            cout << name << " copy error!" << endl;
+
+        // moving between unequal allocators copies the nodes over
+        Tree target( b );
+        target.insert( -1 );
+        target = std::move( same_alloc );
+        if( !equal( s.begin( ), s.end( ), target.begin( ) ) ||
+            static_cast<size_t>( distance( target.begin( ), target.end( ) ) ) != s.size( ) )
+            cout << name << " move error!" << endl;
+
+        // copy assignment keeps the target's allocator
+        other_alloc = t;
+        t.makeEmpty( );
+        same_alloc.makeEmpty( );
+        if( mine.live_bytes != 0 || theirs.allocations - theirs.deallocations != 2 * s.size( ) ||
+            !equal( s.begin( ), s.end( ), other_alloc.begin( ) ) )
+            cout << name << " makeEmpty error!" << endl;
+    }
+    if( !returned( mine ) || !returned( theirs ) )
+        cout << name << " leak error!" << endl;
+}
+
+#if __cplusplus >= 201703L
+    // Every node from a buffer that refuses to fall back on the heap
+template <typename Tree>
+static void run_pmr( const char *name, const vector<int> & keys )
+{
+    vector<char> buffer( 128 * keys.size( ) );
+    std::pmr::monotonic_buffer_resource arena( buffer.data( ), buffer.size( ), std::pmr::null_memory_resource( ) );
+    std::pmr::monotonic_buffer_resource other;
+
+    Tree t( &arena );
+    for( auto k : keys )
+        t.insert( k );
+    for( size_t i = 0; i < keys.size( ); i += 2 )
+        t.remove( keys[ i ] );
+    Tree copy( t, &other );
+    t.makeEmpty( );
+    for( auto k : keys )
+        t.insert( k );
+
+    vector<int> want( keys );
+    sort( want.begin( ), want.end( ) );
+    if( t.get_allocator( ).resource( ) != &arena || copy.get_allocator( ).resource( ) != &other ||
+        !equal( want.begin( ), want.end( ), t.begin( ) ) ||
+        static_cast<size_t>( distance( copy.begin( ), copy.end( ) ) ) != keys.size( ) / 2 )
+        cout << name << " pmr error!" << endl;
+}
+#endif
+
+    // Test program
+int main( )
+{
+    vector<int> keys;
+    for( int i = 0; i < 20000; ++i )
+        keys.push_back( i );
+    shuffle( keys.begin( ), keys.end( ), mt19937( 21 ) );
+
+    cout << "Checking... (no more output means success)" << endl;
+
+    run<BinarySearchTree<int, CountingAllocator<int>>>( "BinarySearchTree", keys );
+    run<AvlTree<int, 1, CountingAllocator<int>>>( "AvlTree", keys );
+    run<AvlTree<int, 2, CountingAllocator<int>, OrderStatistics>>( "OrderStatisticTree", keys );
+
+#if __cplusplus >= 201703L
+    run_pmr<tree::pmr::BinarySearchTree<int>>( "BinarySearchTree", keys );
+    run_pmr<tree::pmr::AvlTree<int>>( "AvlTree", keys );
+#endif
+
+    cout << "End of test..." << endl;
+    return 0;
+}
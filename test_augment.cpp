@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "avl_tree.h"
+
+using namespace std;
+using namespace tree;
+
+    // Test program
+int main( )
+{
+    AvlTree<int, 1, allocator<int>, Sum<long long>> sum;
+    AvlTree<int, 1, allocator<int>, Min<int>> lowest;
+    AvlTree<int, 1, allocator<int>, Max<int>> highest;
+    vector<int> sorted;
+    mt19937 random( 7 );
+    const int KEYS = 20000;
+    const int ROUNDS = 8;
+
+    cout << "Checking... (no more output means success)" << endl;
+
+    for( int round = 0; round < ROUNDS; ++round )
+    {
+        // random inserts and removes keep every summary busy with rotations
+        for( int i = 0; i < KEYS / 2; ++i )
+        {
+            int k = static_cast<int>( random( ) % KEYS ) - KEYS / 2;
+            sum.insert( k );
+            lowest.insert( k );
+            highest.insert( k );
+            auto at = lower_bound( sorted.begin( ), sorted.end( ), k );
+            if( at == sorted.end( ) || *at != k )
+                sorted.insert( at, k );
+        }
+        for( int i = 0; i < KEYS / 4; ++i )
+        {
+            int k = static_cast<int>( random( ) % KEYS ) - KEYS / 2;
+            sum.remove( k );
+            lowest.remove( k );
+            highest.remove( k );
+            auto at = lower_bound( sorted.begin( ), sorted.end( ), k );
+            if( at != sorted.end( ) && *at == k )
+                sorted.erase( at );
+        }
+
+        // bounds anywhere, present or not, beyond either end, and inverted
+        for( int i = 0; i < 2000; ++i )
+        {
+            int lo = static_cast<int>( random( ) % ( KEYS + 10 ) ) - KEYS / 2 - 5;
+            int hi = i % 10 == 0 ? lo + static_cast<int>( random( ) % 3 ) - 1
+                                 : static_cast<int>( random( ) % ( KEYS + 10 ) ) - KEYS / 2 - 5;
+
+            long long s = 0;
+            int mn = numeric_limits<int>::max( );
+            int mx = numeric_limits<int>::lowest( );
+            for( auto it = lower_bound( sorted.begin( ), sorted.end( ), lo );
+                 it != sorted.end( ) && *it <= hi; ++it )
+            {
+                s += *it;
+                mn = min( mn, *it );
+                mx = max( mx, *it );
+            }
+
+            if( sum.reduce( lo, hi ) != s )
+                cout << "Sum error!" << endl;
+            if( lowest.reduce( lo, hi ) != mn )
+                cout << "Min error!" << endl;
+            if( highest.reduce( lo, hi ) != mx )
+                cout << "Max error!" << endl;
+        }
+    }
+
+    // a range between two neighbours holds nothing
+    for( size_t i = 0; i + 1 < sorted.size( ); ++i )
+        if( sorted[ i ] + 1 < sorted[ i + 1 ] &&
+            ( sum.reduce( sorted[ i ] + 1, sorted[ i + 1 ] - 1 ) != 0 ||
+              lowest.reduce( sorted[ i ] + 1, sorted[ i + 1 ] - 1 ) != numeric_limits<int>::max( ) ) )
+            cout << "Empty range error!" << endl;
+
+    sum.makeEmpty( );
+    if( sum.reduce( -KEYS, KEYS ) != 0 )
+        cout << "Empty tree error!" << endl;
+
+    cout << "End of test..." << endl;
+    return 0;
+}
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "avl_map.h"
+
+using namespace std;
+using namespace tree;
+
+    // A value that can't be copied and counts how often it is built or moved
+struct Tracked
+{
+    static int constructions;
+    static int moves;
+    int value;
+
+    explicit Tracked( int v = 0 ) : value( v ) { ++constructions; }
+    Tracked( const Tracked & ) = delete;
+    Tracked( Tracked && rhs ) : value( rhs.value ) { ++moves; }
+    Tracked & operator=( const Tracked & ) = delete;
+    Tracked & operator=( Tracked && rhs ) { value = rhs.value; ++moves; return *this; }
+};
+
+int Tracked::constructions = 0;
+int Tracked::moves = 0;
+
+ostream & operator<<( ostream & out, const Tracked & t )
+{
+    return out << t.value;
+}
+
+    // Test program
+int main( )
+{
+    int NUMS = 100000;
+    const int GAP  =   37;
+    int i;
+
+    cout << "Checking... (no more output means success)" << endl;
+
+    AvlMap<int, Tracked> m;
+    for( i = GAP; i != 0; i = ( i + GAP ) % NUMS )
+        if( !m.try_emplace( i, i * 2 ).second )
+            cout << "Try_emplace error1!" << endl;
+    for( i = 1; i < NUMS; ++i )
+        if( m.try_emplace( i, -1 ).second || m.at( i ).value != i * 2 )
+            cout << "Try_emplace error2!" << endl;
+    if( Tracked::constructions != NUMS - 1 || Tracked::moves != 0 )
+        cout << "Value construction error!" << endl;
+
+    // rebalancing and remove relink nodes: no value moves, none changes address
+    vector<const Tracked *> where( NUMS );
+    for( i = 1; i < NUMS; ++i )
+        where[ i ] = &m.at( i );
+    for( i = 1; i < NUMS; i += 2 )
+        m.remove( i );
+    for( i = NUMS; i < 2 * NUMS; ++i )
+        m.try_emplace( i, i * 2 );
+    for( i = 2; i < NUMS; i += 2 )
+        if( m.find( i ) != where[ i ] )
+            cout << "Value address error!" << endl;
+    for( i = 1; i < NUMS; i += 2 )
+        if( m.find( i ) != nullptr || m.contains( i ) )
+            cout << "Remove error!" << endl;
+    if( Tracked::moves != 0 )
+        cout << "Value move error!" << endl;
+
+    // insert_or_assign assigns in place or inserts
+    auto assigned = m.insert_or_assign( 2, Tracked( 7 ) );
+    auto added = m.insert_or_assign( 1, Tracked( 9 ) );
+    if( assigned.second || assigned.first != where[ 2 ] || m.at( 2 ).value != 7 ||
+        !added.second || m.at( 1 ).value != 9 )
+        cout << "Insert_or_assign error!" << endl;
+
+    bool thrown = false;
+    try
+    {
+        m.at( -1 );
+    }
+    catch( const KeyNotFound & )
+    {
+        thrown = true;
+    }
+    if( !thrown )
+        cout << "At error!" << endl;
+
+    // operator[] default-constructs what is missing
+    AvlMap<string, int> words;
+    const char *text[ ] = { "b", "a", "c", "a", "b", "a" };
+    for( auto w : text )
+        ++words[ w ];
+    if( words[ "a" ] != 3 || words[ "b" ] != 2 || words[ "c" ] != 1 || words.at( "a" ) != 3 )
+        cout << "Operator[] error!" << endl;
+    vector<string> keys;
+    for( const auto & e : words )
+        keys.push_back( e.key( ) );
+    if( keys != vector<string>{ "a", "b", "c" } )
+        cout << "Iterator error!" << endl;
+
+    // extract and insert move the node itself, in one map and across maps
+    int before = Tracked::moves;
+    auto node = m.extract( 4 );
+    const Tracked *value = &node.value( );
+    if( !node || node.key( ) != 4 || value != where[ 4 ] || m.contains( 4 ) || m.extract( 4 ) )
+        cout << "Extract error!" << endl;
+    if( !m.insert( std::move( node ) ) || node || m.find( 4 ) != value )
+        cout << "Node insert error1!" << endl;
+
+    AvlMap<int, Tracked> other;
+    for( i = 2; i < NUMS; i += 2 )
+        if( !other.insert( m.extract( i ) ) || other.find( i ) != where[ i ] )
+            cout << "Node insert error2!" << endl;
+    for( i = 2; i < NUMS; i += 2 )
+        if( m.contains( i ) || other.at( i ).value != ( i == 2 ? 7 : i * 2 ) )
+            cout << "Node insert error3!" << endl;
+
+    // a taken key leaves the node in the handle
+    m.try_emplace( 6, 0 );
+    node = other.extract( 6 );
+    if( m.insert( std::move( node ) ) || !node || node.value( ).value != 12 || m.at( 6 ).value != 0 )
+        cout << "Node insert error4!" << endl;
+    if( Tracked::moves != before || m.insert( AvlMap<int, Tracked>::node_type( ) ) )
+        cout << "Node move error!" << endl;
+
+    // cold values live out of line, but the same holds for them
+    ColdAvlMap<int, Tracked> cold;
+    for( i = GAP; i != 0; i = ( i + GAP ) % NUMS )
+        cold.try_emplace( i, i );
+    for( i = 1; i < NUMS; ++i )
+        where[ i ] = &cold.at( i );
+    for( i = 1; i < NUMS; i += 2 )
+        cold.remove( i );
+    ColdAvlMap<int, Tracked> cold2;
+    for( i = 2; i < NUMS; i += 4 )
+        cold2.insert( cold.extract( i ) );
+    cold.insert_or_assign( 4, Tracked( -4 ) );
+    cold[ 3 ].value = 3;
+    for( i = 2; i < NUMS; i += 2 )
+    {
+        const auto & holder = i % 4 == 2 ? cold2 : cold;
+        if( holder.find( i ) != where[ i ] || holder.at( i ).value != ( i == 4 ? -4 : i ) )
+            cout << "Cold map error!" << endl;
+    }
+    if( !cold.contains( 3 ) || cold.at( 3 ).value != 3 || cold2.contains( 4 ) )
+        cout << "Cold map error!" << endl;
+    if( Tracked::moves != before + 1 )
+        cout << "Cold value move error!" << endl;
+
+    cout << "End of test..." << endl;
+    return 0;
+}
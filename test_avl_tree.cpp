@@ -1,3 +1,6 @@
+#include <sstream>
+#include <thread>
+
 #include "avl_tree.h"
 
 // #include <iostream>
@@ -35,6 +38,47 @@ int main( )
         if( t.contains( i )  )
             cout << "Find error2!" << endl;
     }
+
+    i = 2;
+    for( auto it = t.begin( ); it != t.end( ); ++it, i += 2 )
+        if( *it != i )
+            cout << "Iterator error!" << endl;
+    if( i != NUMS || *t.lower_bound( 3 ) != 4 || t.upper_bound( NUMS - 2 ) != t.end( ) )
+        cout << "Range error!" << endl;
+
+    stringstream snapshot;
+    t.serialize( snapshot );
+    AvlTree<int> t3;
+    t3.deserialize( snapshot );
+    i = 2;
+    for( auto it = t3.begin( ); it != t3.end( ); ++it, i += 2 )
+        if( *it != i )
+            cout << "Snapshot error!" << endl;
+    if( i != NUMS )
+        cout << "Snapshot size error!" << endl;
+
+    auto shape = t3.stats( );
+    size_t levels = 0;
+    for( auto count : shape.depth_histogram_ )
+        levels += count;
+    if( shape.size_ != size_t( NUMS / 2 - 1 ) || levels != shape.size_ || shape.height_ != 23 ||
+        shape.balance_histogram_.begin( )->first < -1 || shape.balance_histogram_.rbegin( )->first > 1 )
+        cout << "Shape error!" << endl;
+
+    // ascending keys only ever need single rotations, n - log2(n + 1) of them
+    AvlTree<int, 1, allocator<int>, NoAugment, less<int>, CountingStats<>> t4;
+    for( i = 0; i < 1023; ++i )
+        t4.insert( i );
+    auto counts = CountingStats<>::snapshot( );
+    if( counts[ INSERTS ] != 1023 || counts[ ALLOCATIONS ] != 1023 ||
+        counts[ SINGLE_ROTATIONS ] != 1013 || counts[ DOUBLE_ROTATIONS ] != 0 )
+        cout << "Stats error!" << endl;
+    thread remover( [ &t4 ] { for( int j = 0; j < 1023; j += 2 ) t4.remove( j ); } );
+    remover.join( );
+    counts = CountingStats<>::snapshot( ) - counts;
+    if( counts[ REMOVES ] != 512 || counts[ DEALLOCATIONS ] != 512 ||
+        CountingStats<>::thread_snapshot( )[ REMOVES ] != 0 )
+        cout << "Thread stats error!" << endl;
 #if 0
     AvlTree<int> t2;
     t2 = t;
@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <set>
+#include <vector>
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#endif
+
+#include "avl_tree_impl1.h"
+
+using namespace std;
+using namespace tree;
+
+typedef AvlTree<int> Tree;
+
+static bool same( const Tree & t, const set<int> & s )
+{
+    auto shape = t.stats( );
+    bool balanced = shape.balance_histogram_.empty( ) ||
+                    ( shape.balance_histogram_.begin( )->first >= -1 && shape.balance_histogram_.rbegin( )->first <= 1 );
+    return balanced && vector<int>( t.begin( ), t.end( ) ) == vector<int>( s.begin( ), s.end( ) );
+}
+
+    // A stateful allocator counting into a shared total of live blocks;
+    // two are equal if they share it
+template <typename T>
+struct CountingAllocator
+{
+    typedef T value_type;
+
+    long *live;
+
+    explicit CountingAllocator( long *l ) : live( l ) { }
+
+    template <typename U>
+    CountingAllocator( const CountingAllocator<U> & rhs ) : live( rhs.live ) { }
+
+    T *allocate( size_t n )
+    {
+        ++*live;
+        return static_cast<T *>( ::operator new( n * sizeof( T ) ) );
+    }
+
+    void deallocate( T *p, size_t )
+    {
+        --*live;
+        ::operator delete( p );
+    }
+
+    template <typename U>
+    bool operator==( const CountingAllocator<U> & rhs ) const { return live == rhs.live; }
+
+    template <typename U>
+    bool operator!=( const CountingAllocator<U> & rhs ) const { return live != rhs.live; }
+};
+
+    // Test program
+int main( )
+{
+    Tree t;
+    set<int> s;
+    mt19937 random( 11 );
+    const int KEYS = 50000;
+
+    cout << "Checking... (no more output means success)" << endl;
+
+    // empty batches leave the tree alone, empty or not
+    vector<int> none;
+    t.insert_batch( none.begin( ), none.end( ) );
+    t.erase_batch( none.begin( ), none.end( ) );
+    if( !t.isEmpty( ) )
+        cout << "Empty batch error!" << endl;
+
+    // unsorted batches with duplicates, of all sizes relative to the tree:
+    // into an empty tree, far bigger than it, and far smaller
+    const int SIZES[ ] = { 1, 10, 5000, 100, 20000, 3, 1000 };
+    for( int size : SIZES )
+    {
+        vector<int> batch;
+        for( int i = 0; i < size; ++i )
+            batch.push_back( random( ) % KEYS );
+        batch.insert( batch.end( ), batch.begin( ), batch.begin( ) + size / 3 );
+        t.insert_batch( batch.begin( ), batch.end( ) );
+        s.insert( batch.begin( ), batch.end( ) );
+        if( !same( t, s ) )
+            cout << "Insert_batch error!" << endl;
+
+        // half of it hits the tree, half misses, some keys twice
+        vector<int> gone;
+        for( int i = 0; i < size; ++i )
+            gone.push_back( i % 2 ? batch[ i ] : static_cast<int>( random( ) % ( 2 * KEYS ) ) );
+        gone.insert( gone.end( ), gone.begin( ), gone.begin( ) + size / 3 );
+        t.erase_batch( gone.begin( ), gone.end( ) );
+        for( auto k : gone )
+            s.erase( k );
+        if( !same( t, s ) )
+            cout << "Erase_batch error!" << endl;
+
+        t.insert_batch( none.begin( ), none.end( ) );
+        t.erase_batch( none.begin( ), none.end( ) );
+        if( !same( t, s ) )
+            cout << "Empty batch error!" << endl;
+    }
+
+    // a batch bigger than the tree takes everything out
+    vector<int> all;
+    for( int i = KEYS - 1; i >= -1; --i )
+        all.push_back( i );
+    t.erase_batch( all.begin( ), all.end( ) );
+    if( !t.isEmpty( ) )
+        cout << "Erase_batch error!" << endl;
+    s.clear( );
+
+    // batches mix with single inserts and removes
+    for( int i = 0; i < KEYS; i += 3 )
+    {
+        t.insert( i );
+        s.insert( i );
+    }
+    t.insert_batch( all.begin( ), all.begin( ) + KEYS / 2 );
+    s.insert( all.begin( ), all.begin( ) + KEYS / 2 );
+    for( int i = 0; i < KEYS; i += 5 )
+    {
+        t.remove( i );
+        s.erase( i );
+    }
+    if( !same( t, s ) )
+        cout << "Mixed batch error!" << endl;
+
+    // batch lookups, on this tree and an empty one, with n not a multiple
+    // of LOOKUP_GROUP
+    Tree empty;
+    for( size_t n = 0; n < 3 * LOOKUP_GROUP + 2; n += 7 )
+    {
+        vector<int> keys;
+        for( size_t i = 0; i < n; ++i )
+            keys.push_back( static_cast<int>( random( ) % ( 2 * KEYS ) ) - 1 );
+        vector<uint64_t> bitmap( ( n + 63 ) / 64 + 1, 0 ), none( ( n + 63 ) / 64 + 1, 0 );
+        vector<const int *> found( n ), nothing( n, &KEYS );
+        t.contains_many( keys.data( ), n, bitmap.data( ) );
+        t.find_many( keys.data( ), n, found.data( ) );
+        empty.contains_many( keys.data( ), n, none.data( ) );
+        empty.find_many( keys.data( ), n, nothing.data( ) );
+        for( size_t i = 0; i < n; ++i )
+        {
+            bool in = s.count( keys[ i ] ) != 0;
+            if( bool( bitmap[ i / 64 ] >> ( i % 64 ) & 1 ) != in || ( found[ i ] != nullptr ) != in ||
+                ( in && *found[ i ] != keys[ i ] ) )
+                cout << "Batch lookup error!" << endl;
+            if( none[ i / 64 ] || nothing[ i ] )
+                cout << "Empty batch lookup error!" << endl;
+        }
+    }
+
+    // bulk builds from unsorted input with duplicates, on one thread and
+    // more, come out at the least height their size allows
+    vector<int> data;
+    for( int i = 0; i < 300000; ++i )
+        data.push_back( static_cast<int>( random( ) % KEYS ) );
+    const size_t BUILDS[ ] = { 0, 1, 2, 1000, 1023, data.size( ) };
+    for( size_t n : BUILDS )
+        for( unsigned threads : { 1u, 4u } )
+        {
+            s = set<int>( data.begin( ), data.begin( ) + n );
+            int height = -1;
+            for( size_t m = s.size( ); m; m /= 2 )
+                ++height;
+
+            t.assign( data.begin( ), data.begin( ) + n, threads );
+            if( !same( t, s ) || t.stats( ).height_ != height )
+                cout << "Assign error!" << endl;
+
+            vector<int> sorted( data.begin( ), data.begin( ) + n );
+            sort( sorted.begin( ), sorted.end( ) );
+            t.assign_sorted( sorted.begin( ), sorted.end( ) );
+            if( !same( t, s ) || t.stats( ).height_ != height )
+                cout << "Assign_sorted error!" << endl;
+        }
+
+    // every node goes back to the allocator it came from, through
+    // copies and moves between two of them
+    long mine = 0, theirs = 0;
+    {
+        typedef AvlTree<int, 1, CountingAllocator<int>> CountingTree;
+        CountingAllocator<int> a( &mine ), b( &theirs );
+        CountingTree x( a ), y( b );
+        for( int i = 0; i < KEYS; ++i )
+            x.insert( i * 7 % KEYS );
+        for( int i = 0; i < KEYS; i += 2 )
+            x.remove( i );
+        CountingTree copy( x, b );
+        y.insert( -1 );
+        y = std::move( x );
+        x.insert( 1 );
+        if( mine != 1 || theirs != KEYS || !x.contains( 1 ) || !equal( y.begin( ), y.end( ), copy.begin( ) ) )
+            cout << "Allocator count error!" << endl;
+        x.makeEmpty( );
+        y = copy;
+    }
+    if( mine != 0 || theirs != 0 )
+        cout << "Allocator leak error!" << endl;
+
+#if __cplusplus >= 201703L
+    // nodes from a fixed buffer only
+    vector<char> buffer( 128 * KEYS );
+    std::pmr::monotonic_buffer_resource arena( buffer.data( ), buffer.size( ), std::pmr::null_memory_resource( ) );
+    tree::pmr::AvlTree<int> p( &arena );
+    for( int i = 0; i < KEYS; ++i )
+        p.insert( i );
+    for( int i = 0; i < KEYS; i += 2 )
+        p.remove( i );
+    if( p.get_allocator( ).resource( ) != &arena || p.findMin( ) != 1 || p.findMax( ) != KEYS - 1 )
+        cout << "Pmr error!" << endl;
+#endif
+
+    cout << "End of test..." << endl;
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "avl_tree.h"
+
+using namespace std;
+using namespace tree;
+
+    // Runs contains_many and find_many over keys and checks them one by one
+static bool lookups_agree( const AvlTree<int> & t, const vector<int> & keys )
+{
+    // guards past the end show that nothing beyond n is written
+    static const int GUARD = 0;
+    vector<uint64_t> bitmap( ( keys.size( ) + 63 ) / 64 + 1, ~uint64_t( 0 ) );
+    vector<const int *> found( keys.size( ) + 1, &GUARD );
+    t.contains_many( keys.data( ), keys.size( ), bitmap.data( ) );
+    t.find_many( keys.data( ), keys.size( ), found.data( ) );
+
+    for( size_t i = 0; i < keys.size( ); ++i )
+    {
+        bool in = t.contains( keys[ i ] );
+        if( bool( bitmap[ i / 64 ] >> ( i % 64 ) & 1 ) != in || ( found[ i ] != nullptr ) != in ||
+            ( in && ( *found[ i ] != keys[ i ] || found[ i ] != &*t.find( keys[ i ] ) ) ) )
+            return false;
+    }
+    for( size_t i = keys.size( ); i % 64; ++i )
+        if( bitmap[ i / 64 ] >> ( i % 64 ) & 1 )
+            return false;
+    return bitmap.back( ) == ~uint64_t( 0 ) && found.back( ) == &GUARD;
+}
+
+    // Test program
+int main( )
+{
+    AvlTree<int> t;
+    mt19937 random( 9 );
+    const int KEYS = 100000;
+
+    cout << "Checking... (no more output means success)" << endl;
+
+    // sizes below, at and around multiples of LOOKUP_GROUP, and of 64
+    const size_t SIZES[ ] = { 0, 1, LOOKUP_GROUP - 1, LOOKUP_GROUP, LOOKUP_GROUP + 1,
+                              3 * LOOKUP_GROUP + 5, 63, 64, 65, 1000, 20001 };
+
+    vector<int> keys;
+    for( size_t n : SIZES )
+    {
+        keys.resize( n );
+        for( size_t i = 0; i < n; ++i )
+            keys[ i ] = static_cast<int>( random( ) % ( 2 * KEYS ) ) - 1;
+        if( !lookups_agree( t, keys ) )
+            cout << "Empty tree lookup error!" << endl;
+    }
+
+    for( int i = 0; i < KEYS; i += 2 )
+        t.insert( i );
+    for( size_t n : SIZES )
+    {
+        keys.resize( n );
+        for( size_t i = 0; i < n; ++i )
+            keys[ i ] = static_cast<int>( random( ) % ( 2 * KEYS ) ) - 1;
+        // repeated keys in one batch
+        if( n > 2 )
+            keys[ n - 1 ] = keys[ n - 2 ] = keys[ 0 ];
+        if( !lookups_agree( t, keys ) )
+            cout << "Lookup error!" << endl;
+    }
+
+    t.makeEmpty( );
+    t.insert( 7 );
+    keys.assign( { 7, 6, 8, 7 } );
+    if( !lookups_agree( t, keys ) )
+        cout << "Single node lookup error!" << endl;
+
+    cout << "End of test..." << endl;
+    return 0;
+}
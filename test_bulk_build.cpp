@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "avl_tree.h"
+
+using namespace std;
+using namespace tree;
+
+    // Same elements as s, and the least height n elements can have
+static bool built( const AvlTree<int> & t, const set<int> & s )
+{
+    auto shape = t.stats( );
+    int height = -1;
+    for( size_t n = s.size( ); n; n /= 2 )
+        ++height;
+    return shape.height_ == height && shape.size_ == s.size( ) &&
+           ( shape.balance_histogram_.empty( ) ||
+             ( shape.balance_histogram_.begin( )->first >= -1 && shape.balance_histogram_.rbegin( )->first <= 1 ) ) &&
+           equal( s.begin( ), s.end( ), t.begin( ) );
+}
+
+    // Test program
+int main( )
+{
+    mt19937 random( 13 );
+    const int KEYS = 1000000;
+
+    cout << "Checking... (no more output means success)" << endl;
+
+    // parallel_sort against std::sort, big enough for every thread to get
+    // a run, and with thread counts that leave odd runs to merge
+    vector<int> data;
+    for( int i = 0; i < 5 * int( PARALLEL_SORT_GRAIN ) + 17; ++i )
+        data.push_back( static_cast<int>( random( ) % KEYS ) );
+    set<int> distinct( data.begin( ), data.end( ) );
+    vector<int> deduped( distinct.begin( ), distinct.end( ) );
+    for( unsigned threads : { 0u, 1u, 2u, 3u, 4u, 7u } )
+    {
+        auto mine = data, theirs = data;
+        parallel_sort( mine.begin( ), mine.end( ), threads, greater<int>( ) );
+        sort( theirs.begin( ), theirs.end( ), greater<int>( ) );
+        if( mine != theirs )
+            cout << "Parallel_sort error!" << endl;
+
+        mine = data;
+        sort_unique( mine, threads );
+        if( mine != deduped )
+            cout << "Sort_unique error!" << endl;
+    }
+
+    // assign from unsorted input with duplicates, on one thread and more,
+    // replacing whatever the tree held
+    AvlTree<int> t;
+    for( int i = 0; i < 100; ++i )
+        t.insert( -i );
+    const size_t SIZES[ ] = { 0, 1, 2, 3, 1000, 1023, 1024, data.size( ) };
+    for( size_t n : SIZES )
+        for( unsigned threads : { 1u, 4u } )
+        {
+            set<int> s( data.begin( ), data.begin( ) + n );
+            t.assign( data.begin( ), data.begin( ) + n, threads );
+            if( !built( t, s ) )
+                cout << "Assign error!" << endl;
+
+            // assign_sorted keeps one of each run of equal keys
+            vector<int> sorted( data.begin( ), data.begin( ) + n );
+            sort( sorted.begin( ), sorted.end( ) );
+            t.assign_sorted( sorted.begin( ), sorted.end( ) );
+            if( !built( t, s ) )
+                cout << "Assign_sorted error!" << endl;
+        }
+
+    // a built tree takes inserts and removes like any other
+    for( int i = 0; i < KEYS; i += 3 )
+        t.remove( i );
+    for( int i = KEYS; i < KEYS + 1000; ++i )
+        t.insert( i );
+    set<int> s( data.begin( ), data.end( ) );
+    for( int i = 0; i < KEYS; i += 3 )
+        s.erase( i );
+    for( int i = KEYS; i < KEYS + 1000; ++i )
+        s.insert( i );
+    if( !equal( s.begin( ), s.end( ), t.begin( ) ) || t.stats( ).size_ != s.size( ) )
+        cout << "Update after build error!" << endl;
+
+    // the range constructor builds the same way
+    vector<int> few = { 5, 3, 5, 1, 3 };
+    AvlTree<int> u( few.begin( ), few.end( ) );
+    if( !built( u, set<int>( few.begin( ), few.end( ) ) ) )
+        cout << "Constructor error!" << endl;
+
+    cout << "End of test..." << endl;
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+#include "avl_tree.h"
+
+using namespace std;
+using namespace tree;
+
+    // Orders by distance from a pivot, then by value: a comparator with state
+struct ByDistance
+{
+    int pivot;
+
+    explicit ByDistance( int p = 0 ) : pivot( p ) { }
+
+    bool operator()( int a, int b ) const
+    {
+        int da = a < pivot ? pivot - a : a - pivot;
+        int db = b < pivot ? pivot - b : b - pivot;
+        return da < db || ( da == db && a < b );
+    }
+};
+
+    // strcmp-style, counting its calls
+struct ThreeWay
+{
+    static long calls;
+
+    int operator()( int a, int b ) const
+    {
+        ++calls;
+        return a < b ? -1 : b < a ? 1 : 0;
+    }
+};
+
+long ThreeWay::calls = 0;
+
+    // Test program
+int main( )
+{
+    const int NUMS = 10000;
+    int i;
+
+    cout << "Checking... (no more output means success)" << endl;
+
+    // a stateful comparator, copied into the tree and out of key_comp()
+    AvlTree<int, 1, allocator<int>, NoAugment, ByDistance> near( ByDistance( 50 ) );
+    for( i = 0; i <= 100; ++i )
+        near.insert( i );
+    vector<int> order( near.begin( ), near.end( ) );
+    if( order.size( ) != 101 || order[ 0 ] != 50 || order[ 1 ] != 49 || order[ 2 ] != 51 || order[ 100 ] != 100 )
+        cout << "Comparator order error!" << endl;
+    if( near.key_comp( ).pivot != 50 || !near.contains( 0 ) || near.contains( 101 ) ||
+        *near.lower_bound( 60 ) != 60 || *near.upper_bound( 40 ) != 60 || near.findMin( ) != 50 || near.findMax( ) != 100 )
+        cout << "Comparator find error!" << endl;
+    near.remove( 50 );
+    if( near.findMin( ) != 49 )
+        cout << "Comparator remove error!" << endl;
+
+    // a three-way comparator is called once per node on every path
+    AvlTree<int, 1, allocator<int>, NoAugment, ThreeWay> three;
+    for( i = 0; i < NUMS; i += 2 )
+        three.insert( i );
+    i = 0;
+    for( auto e : three )
+        if( e != i )
+            cout << "Three-way order error!" << endl;
+        else
+            i += 2;
+    if( *three.lower_bound( 7 ) != 8 || *three.upper_bound( 8 ) != 10 )
+        cout << "Three-way bound error!" << endl;
+
+    vector<int> probes;
+    for( i = -1; i <= NUMS; ++i )
+        probes.push_back( i );
+    ThreeWay::calls = 0;
+    for( auto k : probes )
+        if( three.contains( k ) != ( k >= 0 && k < NUMS && k % 2 == 0 ) )
+            cout << "Three-way find error!" << endl;
+    long single = ThreeWay::calls;
+
+    // batch lookups take the same paths with the same number of calls
+    vector<uint64_t> bitmap( ( probes.size( ) + 63 ) / 64 );
+    vector<const int *> found( probes.size( ) );
+    ThreeWay::calls = 0;
+    three.contains_many( probes.data( ), probes.size( ), bitmap.data( ) );
+    if( ThreeWay::calls != single )
+        cout << "Three-way batch calls error!" << endl;
+    three.find_many( probes.data( ), probes.size( ), found.data( ) );
+    for( size_t j = 0; j < probes.size( ); ++j )
+    {
+        bool in = three.contains( probes[ j ] );
+        if( bool( bitmap[ j / 64 ] >> ( j % 64 ) & 1 ) != in || ( found[ j ] != nullptr ) != in ||
+            ( in && *found[ j ] != probes[ j ] ) )
+            cout << "Three-way batch error!" << endl;
+    }
+
+#if __cplusplus >= 201703L
+    // a transparent comparator takes string_view probes as they are
+    AvlTree<string, 1, allocator<string>, NoAugment, less<>> words;
+    const char *text[ ] = { "pear", "apple", "fig", "plum", "kiwi" };
+    for( auto w : text )
+        words.insert( string( w ) );
+    string_view line = "fig,kiwi,lime";
+    if( !words.contains( line.substr( 0, 3 ) ) || !words.contains( line.substr( 4, 4 ) ) ||
+        words.contains( line.substr( 9, 4 ) ) || *words.find( line.substr( 4, 4 ) ) != "kiwi" ||
+        words.find( line.substr( 9, 4 ) ) != words.end( ) || *words.lower_bound( line.substr( 9, 4 ) ) != "pear" ||
+        *words.upper_bound( line.substr( 0, 3 ) ) != "kiwi" || !words.contains( "apple" ) )
+        cout << "Transparent find error!" << endl;
+#endif
+
+    cout << "End of test..." << endl;
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "concurrent_avl_tree.h"
+
+using namespace std;
+using namespace tree;
+
+    // Test program
+int main( )
+{
+    ConcurrentAvlTree<int> t;
+    const int WRITERS = 4;
+    const int NUMS = 400000;
+    const int STABLE = 1000;
+    int i;
+
+    cout << "Checking... (no more output means success)" << endl;
+
+    // keys below 0 are there all along and never touched
+    for( i = -STABLE; i < 0; ++i )
+        t.insert( i );
+
+    // writer w owns the keys k with k % WRITERS == w: it inserts all of
+    // them, takes every third out again and puts every ninth back, so
+    // every insert and remove has a known result
+    atomic<int> running( WRITERS );
+    atomic<bool> failed( false );
+    vector<thread> writers;
+    for( int w = 0; w < WRITERS; ++w )
+        writers.emplace_back( [ &, w ] {
+            for( int k = w; k < NUMS; k += WRITERS )
+                if( !t.insert( k ) || t.insert( k ) )
+                    failed = true;
+            for( int k = w; k < NUMS; k += 3 * WRITERS )
+                if( !t.remove( k ) || t.remove( k ) || t.contains( k ) )
+                    failed = true;
+            for( int k = w; k < NUMS; k += 9 * WRITERS )
+                if( !t.insert( k ) )
+                    failed = true;
+            --running;
+        } );
+
+    // ordered scans alongside: always ascending, and never missing a key
+    // that was there for the whole scan
+    int scans = 0;
+    thread scanner( [ & ] {
+        do
+        {
+            int last = -STABLE - 1, stable = 0;
+            bool ordered = true;
+            t.for_each( [ & ]( int e ) {
+                ordered = ordered && last < e;
+                last = e;
+                stable += e < 0;
+            } );
+            if( !ordered || stable != STABLE )
+                failed = true;
+
+            int in_range = 0;
+            last = -STABLE / 2 - 1;
+            t.for_each( -STABLE / 2, -1, [ & ]( int e ) {
+                ordered = ordered && last < e;
+                last = e;
+                ++in_range;
+            } );
+            if( !ordered || in_range != STABLE / 2 )
+                failed = true;
+            ++scans;
+        } while( running > 0 );
+    } );
+
+    for( auto & writer : writers )
+        writer.join( );
+    scanner.join( );
+    if( failed )
+        cout << "Concurrent update error!" << endl;
+    if( scans < 1 )
+        cout << "Scan error!" << endl;
+
+    // every key is where its writer left it
+    for( i = -STABLE; i < NUMS; ++i )
+    {
+        int k = i < 0 ? 0 : i / WRITERS;
+        bool in = i < 0 || k % 3 != 0 || k % 9 == 0;
+        if( t.contains( i ) != in )
+            cout << "Find error!" << endl;
+    }
+
+    i = -STABLE;
+    bool ordered = true;
+    size_t count = 0;
+    t.for_each( [ & ]( int e ) {
+        ordered = ordered && i <= e;
+        i = e + 1;
+        ++count;
+    } );
+    size_t want = STABLE;
+    for( int k = 0; k < NUMS / WRITERS; ++k )
+        want += WRITERS * ( k % 3 != 0 || k % 9 == 0 );
+    if( !ordered || count != want || t.findMin( ) != -STABLE || t.findMax( ) != NUMS - 1 )
+        cout << "Final contents error!" << endl;
+
+    t.makeEmpty( );
+    if( !t.isEmpty( ) )
+        cout << "MakeEmpty error!" << endl;
+
+    cout << "End of test..." << endl;
+    return 0;
+}
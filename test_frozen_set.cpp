@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "avl_tree.h"
+#include "frozen_set.h"
+
+using namespace std;
+using namespace tree;
+
+    // Compares a snapshot with the tree it came from: every key in the
+    // tree's range and one past each end, and a walk both ways
+template <typename Set, typename Tree>
+bool same( const Set & s, const Tree & t, int hi )
+{
+    if( s.size( ) != static_cast<size_t>( distance( t.begin( ), t.end( ) ) ) ||
+        !equal( t.begin( ), t.end( ), s.begin( ) ) )
+        return false;
+
+    auto back = s.end( );
+    for( auto it = t.end( ); it != t.begin( ); )
+        if( *--it != *--back )
+            return false;
+    if( back != s.begin( ) )
+        return false;
+
+    for( int k = -1; k <= hi; ++k )
+    {
+        auto l = t.lower_bound( k );
+        auto f = s.find( k );
+        if( s.contains( k ) != t.contains( k ) ||
+            ( l == t.end( ) ? s.lower_bound( k ) != s.end( ) : *s.lower_bound( k ) != *l ) ||
+            ( t.contains( k ) ? f == s.end( ) || *f != k : f != s.end( ) ) )
+            return false;
+    }
+    return true;
+}
+
+    // Test program
+int main( )
+{
+    int NUMS = 100000;
+    const int GAP  =   37;
+    int i;
+
+    cout << "Checking... (no more output means success)" << endl;
+
+    // both layouts at sizes around and between powers of two, built from
+    // a tree of every third key
+    const int SIZES[ ] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 100, 255, 1000, 1023, 1025, 4097, 65535 };
+    mt19937 random( 3 );
+    for( int n : SIZES )
+    {
+        vector<int> keys;
+        for( i = 0; i < n; ++i )
+            keys.push_back( 3 * i );
+        shuffle( keys.begin( ), keys.end( ), random );
+        AvlTree<int> t;
+        for( auto k : keys )
+            t.insert( k );
+
+        auto eytzinger = freeze( t );
+        auto veb = freeze_veb( t );
+        if( !same( eytzinger, t, 3 * n ) )
+            cout << "Eytzinger error!" << endl;
+        if( !same( veb, t, 3 * n ) )
+            cout << "Veb error!" << endl;
+
+        for( int k = -1; k <= 3 * n; ++k )
+        {
+            auto u = t.upper_bound( k );
+            if( u == t.end( ) ? eytzinger.upper_bound( k ) != eytzinger.end( ) : *eytzinger.upper_bound( k ) != *u )
+                cout << "Eytzinger upper_bound error!" << endl;
+        }
+    }
+
+    // a descending tree: the snapshots must search in its order
+    AvlTree<int, 1, allocator<int>, NoAugment, greater<int>> down;
+    for( i = GAP; i != 0; i = ( i + GAP ) % NUMS )
+        if( i % 2 == 0 )
+            down.insert( i );
+
+    auto eytzinger = freeze( down );
+    auto veb = freeze_veb( down );
+
+    i = NUMS - 2;
+    for( auto e : eytzinger )
+        if( e != i )
+            cout << "Descending order error!" << endl;
+        else
+            i -= 2;
+    i = NUMS - 2;
+    for( auto e : veb )
+        if( e != i )
+            cout << "Descending order error!" << endl;
+        else
+            i -= 2;
+
+    for( i = 0; i < NUMS; ++i )
+    {
+        bool in = i % 2 == 0 && i != 0;
+        if( eytzinger.contains( i ) != in || veb.contains( i ) != in )
+            cout << "Descending find error!" << endl;
+
+        // first element not above i, and first one below it
+        int lower = i % 2 == 0 ? i : i - 1;
+        int upper = i % 2 == 0 ? i - 2 : i - 1;
+        auto l = eytzinger.lower_bound( i );
+        auto u = eytzinger.upper_bound( i );
+        auto v = veb.lower_bound( i );
+        if( ( lower < 2 ? l != eytzinger.end( ) : *l != lower ) ||
+            ( upper < 2 ? u != eytzinger.end( ) : *u != upper ) ||
+            ( lower < 2 ? v != veb.end( ) : *v != lower ) )
+            cout << "Descending bound error!" << endl;
+    }
+
+    cout << "End of test..." << endl;
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <iterator>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "interval_tree.h"
+
+using namespace std;
+using namespace tree;
+
+    // Test program
+int main( )
+{
+    IntervalTree<int> t;
+    set<Interval<int>> s;
+    mt19937 random( 5 );
+    const int SPAN = 2000;
+    const int ROUNDS = 10;
+
+    cout << "Checking... (no more output means success)" << endl;
+
+    // closed intervals: touching endpoints overlap, one apart don't
+    t.insert( 10, 20 );
+    if( !t.any_overlap( 20, 30 ) || !t.any_overlap( 0, 10 ) || !t.any_overlap( 15, 15 ) ||
+        t.any_overlap( 21, 30 ) || t.any_overlap( 0, 9 ) || t.any_overlap( 20, 10 ) ||
+        t.overlapping( 20, 20 ).size( ) != 1 || !t.overlapping( 21, 21 ).empty( ) )
+        cout << "Endpoint error!" << endl;
+    t.remove( 10, 20 );
+    if( !t.isEmpty( ) || t.any_overlap( 0, SPAN ) || !t.overlapping( 0, SPAN ).empty( ) )
+        cout << "Empty tree error!" << endl;
+
+    // short intervals on a narrow span share endpoints all the time
+    for( int round = 0; round < ROUNDS; ++round )
+    {
+        for( int i = 0; i < SPAN; ++i )
+        {
+            int lo = random( ) % SPAN;
+            int hi = lo + static_cast<int>( random( ) % ( i % 10 ? 20 : 300 ) );
+            t.insert( lo, hi );
+            s.insert( Interval<int>{ lo, hi } );
+        }
+        for( int i = 0; i < SPAN / 2; ++i )
+        {
+            // half of them stored ones, half most likely not
+            auto at = s.begin( );
+            advance( at, random( ) % s.size( ) );
+            Interval<int> gone = i % 2 ? *at : Interval<int>{ static_cast<int>( random( ) % SPAN ), static_cast<int>( random( ) % SPAN ) };
+            t.remove( gone.lo_, gone.hi_ );
+            s.erase( gone );
+        }
+
+        for( int i = 0; i < 2000; ++i )
+        {
+            int lo = static_cast<int>( random( ) % ( SPAN + 400 ) ) - 50;
+            int hi = i % 4 == 0 ? lo : i % 4 == 1 ? lo - 1 : lo + static_cast<int>( random( ) % 100 );
+
+            vector<Interval<int>> want;
+            for( const auto & e : s )
+                if( e.overlaps( lo, hi ) && !( hi < lo ) )
+                    want.push_back( e );
+
+            auto got = t.overlapping( lo, hi );
+            if( got.size( ) != want.size( ) )
+                cout << "Overlapping error!" << endl;
+            else
+                for( size_t j = 0; j < got.size( ); ++j )
+                    if( got[ j ].lo_ != want[ j ].lo_ || got[ j ].hi_ != want[ j ].hi_ )
+                        cout << "Overlapping order error!" << endl;
+
+            if( t.any_overlap( lo, hi ) != !want.empty( ) )
+                cout << "Any_overlap error!" << endl;
+        }
+
+        for( const auto & e : s )
+            if( !t.contains( e.lo_, e.hi_ ) )
+                cout << "Find error!" << endl;
+    }
+
+    cout << "End of test..." << endl;
+    return 0;
+}
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "avl_tree.h"
+
+using namespace std;
+using namespace tree;
+
+typedef AvlTree<int, 1, PoolAllocator<int>> PoolTree;
+
+static bool same( const PoolTree & t, const set<int> & s )
+{
+    return static_cast<size_t>( distance( t.begin( ), t.end( ) ) ) == s.size( ) &&
+           equal( s.begin( ), s.end( ), t.begin( ) );
+}
+
+#ifdef __cpp_aligned_new
+struct alignas( 64 ) Wide
+{
+    int value;
+};
+#endif
+
+    // Test program
+int main( )
+{
+    mt19937 random( 17 );
+    const int KEYS = 200000;
+
+    cout << "Checking... (no more output means success)" << endl;
+
+    // freed blocks come back first, newest first
+    NodePool pool( 24, 8 );
+    void *a = pool.allocate( ), *b = pool.allocate( ), *c = pool.allocate( );
+    if( a == b || b == c || pool.block_size( ) != 24 ||
+        static_cast<char *>( b ) - static_cast<char *>( a ) != 24 )
+        cout << "NodePool allocate error!" << endl;
+    pool.deallocate( a );
+    pool.deallocate( c );
+    if( pool.allocate( ) != c || pool.allocate( ) != a )
+        cout << "NodePool reuse error!" << endl;
+
+    // many slabs, then all of them at once
+    vector<void *> blocks;
+    for( int i = 0; i < 100000; ++i )
+        blocks.push_back( pool.allocate( ) );
+    sort( blocks.begin( ), blocks.end( ) );
+    if( adjacent_find( blocks.begin( ), blocks.end( ) ) != blocks.end( ) )
+        cout << "NodePool overlap error!" << endl;
+    pool.release( );
+    pool.allocate( );
+
+    // blocks too small for the free list link grow to hold it
+    NodePool tiny( 1, 1 );
+    if( tiny.block_size( ) < sizeof( void * ) )
+        cout << "NodePool block size error!" << endl;
+
+    // copies and rebinds share the pools, a rebind back is equal to where
+    // it started, and only the sole owner may release them
+    PoolAllocator<int> x;
+    PoolAllocator<int> y( x );
+    PoolAllocator<double> z( x );
+    if( x != y || x == PoolAllocator<int>( ) || z != x || PoolAllocator<int>( z ) != x ||
+        x == x.select_on_container_copy_construction( ) )
+        cout << "PoolAllocator sharing error!" << endl;
+    int *p = x.allocate( 1 );
+    y.deallocate( p, 1 );
+    if( x.allocate( 1 ) != p || x.try_release( ) )
+        cout << "PoolAllocator shared pool error!" << endl;
+    int *array = x.allocate( 100 );
+    for( int i = 0; i < 100; ++i )
+        array[ i ] = i;
+    x.deallocate( array, 100 );
+    y = PoolAllocator<int>( );
+    if( x.try_release( ) )
+        cout << "PoolAllocator shared pool error!" << endl;
+    z = PoolAllocator<double>( );
+    if( !x.try_release( ) )
+        cout << "PoolAllocator release error!" << endl;
+
+    // over-aligned nodes, on and off the pool
+#ifdef __cpp_aligned_new
+    PoolAllocator<Wide> wide;
+    for( int i = 0; i < 2000; ++i )
+    {
+        auto one = wide.allocate( 1 );
+        auto many = wide.allocate( 3 );
+        if( reinterpret_cast<uintptr_t>( one ) % 64 || reinterpret_cast<uintptr_t>( many ) % 64 )
+            cout << "PoolAllocator alignment error!" << endl;
+        wide.deallocate( many, 3 );
+    }
+#endif
+
+    // huge pages fall back to ordinary ones where none are reserved
+    AvlTree<int, 1, HugePagePoolAllocator<int>> huge;
+    for( int i = 0; i < KEYS; ++i )
+        huge.insert( i );
+    for( int i = 0; i < KEYS; i += 2 )
+        huge.remove( i );
+    if( huge.findMin( ) != 1 || huge.findMax( ) != KEYS - 1 || huge.contains( 2 ) )
+        cout << "Huge page pool error!" << endl;
+    huge.makeEmpty( );
+
+    // trees built from one allocator compare equal, and set operations
+    // between them relink nodes rather than copy them
+    PoolAllocator<int> shared;
+    PoolTree odd( shared ), even( shared );
+    for( int i = 0; i < 1000; ++i )
+        ( i % 2 ? odd : even ).insert( i );
+    const int *node = &*even.find( 500 );
+    if( odd.get_allocator( ) != even.get_allocator( ) || odd.get_allocator( ) != shared )
+        cout << "Pool tree sharing error!" << endl;
+    odd.union_with( std::move( even ) );
+    if( &*odd.find( 500 ) != node || odd.findMin( ) != 0 || odd.findMax( ) != 999 || !even.isEmpty( ) )
+        cout << "Pool union error!" << endl;
+
+    // pooled trees through copies, moves, swaps and makeEmpty, with rounds
+    // of inserts and removes in between
+    PoolTree t, u;
+    set<int> s, r;
+    for( int round = 0; round < 6; ++round )
+    {
+        for( int i = 0; i < KEYS / 4; ++i )
+        {
+            int k = random( ) % KEYS;
+            t.insert( k );
+            s.insert( k );
+            k = random( ) % KEYS;
+            u.remove( k );
+            r.erase( k );
+        }
+        for( int i = 0; i < KEYS / 8; ++i )
+        {
+            int k = random( ) % KEYS;
+            t.remove( k );
+            s.erase( k );
+        }
+
+        // a copy has a pool of its own, which it frees in one go when
+        // emptied, while the source carries on with its own
+        PoolTree copy( t ), spare( t );
+        spare.makeEmpty( );
+        spare.insert( -3 );
+        t.insert( -1 );
+        t.remove( -1 );
+        if( !same( copy, s ) || !same( t, s ) || spare.findMin( ) != -3 || spare.findMax( ) != -3 )
+            cout << "Pool copy error!" << endl;
+
+        // moving takes the nodes along, in place
+        const int *first = t.isEmpty( ) ? nullptr : &*t.begin( );
+        PoolTree moved( std::move( t ) );
+        if( !same( moved, s ) || !t.isEmpty( ) || ( first && &*moved.begin( ) != first ) )
+            cout << "Pool move error!" << endl;
+        t = std::move( moved );
+        moved.makeEmpty( );
+        if( !same( t, s ) || ( first && &*t.begin( ) != first ) )
+            cout << "Pool move assign error!" << endl;
+
+        // copy assignment keeps each tree's pool
+        copy = u;
+        u.insert( -2 );
+        u.remove( -2 );
+        if( !same( copy, r ) )
+            cout << "Pool copy assign error!" << endl;
+        copy.makeEmpty( );
+
+        swap( t, u );
+        swap( s, r );
+        if( !same( t, s ) || !same( u, r ) || ( first && &*u.begin( ) != first ) )
+            cout << "Pool swap error!" << endl;
+
+        if( round % 3 == 2 )
+        {
+            t.makeEmpty( );
+            s.clear( );
+            if( !t.isEmpty( ) )
+                cout << "Pool makeEmpty error!" << endl;
+        }
+    }
+
+    cout << "End of test..." << endl;
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "avl_tree.h"
+
+using namespace std;
+using namespace tree;
+
+    // Test program
+int main( )
+{
+    AvlTree<int, 1, allocator<int>, OrderStatistics> t;
+    vector<int> sorted;
+    mt19937 random( 42 );
+    const int KEYS = 20000;
+    const int ROUNDS = 10;
+
+    cout << "Checking... (no more output means success)" << endl;
+
+    for( int round = 0; round < ROUNDS; ++round )
+    {
+        // a batch of random inserts, then one of random removes
+        for( int i = 0; i < KEYS / 2; ++i )
+        {
+            int k = random( ) % KEYS;
+            t.insert( k );
+            auto at = lower_bound( sorted.begin( ), sorted.end( ), k );
+            if( at == sorted.end( ) || *at != k )
+                sorted.insert( at, k );
+        }
+        for( int i = 0; i < KEYS / 4; ++i )
+        {
+            int k = random( ) % KEYS;
+            t.remove( k );
+            auto at = lower_bound( sorted.begin( ), sorted.end( ), k );
+            if( at != sorted.end( ) && *at == k )
+                sorted.erase( at );
+        }
+
+        if( t.size( ) != sorted.size( ) )
+            cout << "Size error!" << endl;
+
+        for( size_t k = 0; k < sorted.size( ); ++k )
+            if( t.select( k ) != sorted[ k ] )
+                cout << "Select error!" << endl;
+
+        // present and absent keys, and keys beyond both ends
+        for( int k = -1; k <= KEYS; ++k )
+        {
+            auto less = lower_bound( sorted.begin( ), sorted.end( ), k ) - sorted.begin( );
+            if( t.rank( k ) != static_cast<size_t>( less ) )
+                cout << "Rank error!" << endl;
+        }
+
+        for( int i = 0; i < 1000; ++i )
+        {
+            int lo = static_cast<int>( random( ) % ( KEYS + 2 ) ) - 1;
+            int hi = static_cast<int>( random( ) % ( KEYS + 2 ) ) - 1;
+            auto inside = lo > hi ? 0 : upper_bound( sorted.begin( ), sorted.end( ), hi ) -
+                                        lower_bound( sorted.begin( ), sorted.end( ), lo );
+            if( t.count_range( lo, hi ) != static_cast<size_t>( inside ) )
+                cout << "Count_range error!" << endl;
+        }
+
+        bool thrown = false;
+        try
+        {
+            t.select( sorted.size( ) );
+        }
+        catch( const IndexOutOfRange & )
+        {
+            thrown = true;
+        }
+        if( !thrown )
+            cout << "Select range error!" << endl;
+    }
+
+    t.makeEmpty( );
+    bool thrown = false;
+    try
+    {
+        t.select( 0 );
+    }
+    catch( const IndexOutOfRange & )
+    {
+        thrown = true;
+    }
+    if( !thrown || t.size( ) != 0 || t.rank( 5 ) != 0 || t.count_range( 0, KEYS ) != 0 )
+        cout << "Empty tree error!" << endl;
+
+    cout << "End of test..." << endl;
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include <atomic>
+#include <thread>
+
+#include "persistent_avl_tree.h"
+
+using namespace std;
+using namespace tree;
+
+    // Test program
+int main( )
+{
+    PersistentAvlTree<int> t;
+    int NUMS = 2000000;
+    const int GAP  =   37;
+    int i;
+
+    cout << "Checking... (no more output means success)" << endl;
+
+    for( i = GAP; i != 0; i = ( i + GAP ) % NUMS )
+        t.insert( i );
+
+    // a reader walks the full version while the odd keys are removed
+    // from the next one
+    auto full = t.snapshot( );
+    thread reader( [&full, NUMS] {
+        int j = 1;
+        for( auto e : full )
+            if( e != j++ )
+                cout << "Snapshot error!" << endl;
+        if( j != NUMS || full.size( ) != static_cast<size_t>( NUMS - 1 ) )
+            cout << "Snapshot size error!" << endl;
+    } );
+
+    t.remove( 0 );
+    for( i = 1; i < NUMS; i += 2 )
+        t.remove( i );
+    reader.join( );
+
+    if( NUMS < 40 )
+        t.printTree( );
+    if( t.findMin( ) != 2 || t.findMax( ) != NUMS - 2 )
+        cout << "FindMin or FindMax error!" << endl;
+    if( full.findMin( ) != 1 || full.findMax( ) != NUMS - 1 )
+        cout << "Snapshot FindMin or FindMax error!" << endl;
+
+    for( i = 2; i < NUMS; i += 2 )
+        if( !t.contains( i ) || !full.contains( i ) )
+            cout << "Find error1!" << endl;
+
+    for( i = 1; i < NUMS; i += 2 )
+    {
+        if( t.contains( i ) || !full.contains( i ) )
+            cout << "Find error2!" << endl;
+    }
+
+    cout << "End of test..." << endl;
+    return 0;
+}
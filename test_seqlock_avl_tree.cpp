@@ -0,0 +1,80 @@
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "seqlock_avl_tree.h"
+
+using namespace std;
+using namespace tree;
+
+#ifdef __cpp_aligned_new
+struct alignas( 64 ) Wide
+{
+    int value;
+};
+#endif
+
+    // Test program
+int main( )
+{
+    SeqlockAvlTree<int> t;
+    int NUMS = 20000000;
+    const int GAP  =   37;
+    int i;
+
+    cout << "Checking... (no more output means success)" << endl;
+
+    for( i = GAP; i != 0; i = ( i + GAP ) % NUMS )
+        t.insert( i );
+    t.remove( 0 );
+
+    // a reader runs while the odd keys are removed, the even ones must
+    // stay visible to it all along
+    atomic<bool> done( false );
+    thread reader( [&] {
+        for( int j = 2; !done; j = j + 2 < NUMS ? j + 2 : 2 )
+            if( !t.contains( j ) || ( t.findMin( ) != 1 && t.findMin( ) != 2 ) )
+                cout << "Concurrent find error!" << endl;
+    } );
+
+    for( i = 1; i < NUMS; i += 2 )
+        t.remove( i );
+    done = true;
+    reader.join( );
+
+    if( NUMS < 40 )
+        t.writer_view( ).printTree( );
+    if( t.findMin( ) != 2 || t.findMax( ) != NUMS - 2 )
+        cout << "FindMin or FindMax error!" << endl;
+
+    for( i = 2; i < NUMS; i += 2 )
+        if( !t.contains( i ) )
+            cout << "Find error1!" << endl;
+
+    for( i = 1; i < NUMS; i += 2 )
+    {
+        if( t.contains( i )  )
+            cout << "Find error2!" << endl;
+    }
+
+    // retired blocks keep their alignment and come back zeroed, and a
+    // domain frees them all in the end
+#ifdef __cpp_aligned_new
+    {
+        EpochDomain domain;
+        RetiringAllocator<Wide> wide( &domain );
+        for( i = 0; i < 1000; ++i )
+        {
+            Wide *one = wide.allocate( 1 ), *many = wide.allocate( 3 );
+            if( reinterpret_cast<uintptr_t>( one ) % 64 || reinterpret_cast<uintptr_t>( many ) % 64 ||
+                one->value != 0 || many[ 2 ].value != 0 )
+                cout << "RetiringAllocator alignment error!" << endl;
+            wide.deallocate( one, 1 );
+            wide.deallocate( many, 3 );
+        }
+    }
+#endif
+
+    cout << "End of test..." << endl;
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "avl_tree.h"
+
+using namespace std;
+using namespace tree;
+
+typedef AvlTree<int> Tree;
+
+static vector<int> contents( const Tree & t )
+{
+    return vector<int>( t.begin( ), t.end( ) );
+}
+
+static bool balanced( const Tree & t )
+{
+    auto shape = t.stats( );
+    return shape.balance_histogram_.empty( ) ||
+           ( shape.balance_histogram_.begin( )->first >= -1 && shape.balance_histogram_.rbegin( )->first <= 1 );
+}
+
+    // size distinct keys from [lo, hi), sorted
+static vector<int> random_keys( mt19937 & random, int size, int lo, int hi )
+{
+    vector<int> keys;
+    for( int i = lo; i < hi; ++i )
+        keys.push_back( i );
+    shuffle( keys.begin( ), keys.end( ), random );
+    keys.resize( size );
+    sort( keys.begin( ), keys.end( ) );
+    return keys;
+}
+
+static Tree build( const vector<int> & keys )
+{
+    Tree t;
+    for( auto k : keys )
+        t.insert( k );
+    return t;
+}
+
+    // Test program
+int main( )
+{
+    mt19937 random( 42 );
+    ThreadPool pool( 4 );
+    const int SIZES[ ] = { 0, 1, 7, 100, 2000 };
+
+    cout << "Checking... (no more output means success)" << endl;
+
+    // every pair of sizes, from overlapping and from disjoint key ranges,
+    // sequential and on the pool
+    for( int m : SIZES )
+        for( int n : SIZES )
+            for( int disjoint = 0; disjoint < 2; ++disjoint )
+                for( int op = 0; op < 3; ++op )
+                    for( int parallel = 0; parallel < 2; ++parallel )
+                    {
+                        auto a = random_keys( random, m, 0, 3000 );
+                        auto b = disjoint ? random_keys( random, n, 3000, 6000 ) : random_keys( random, n, 0, 3000 );
+                        Tree x = build( a ), y = build( b );
+                        vector<int> want;
+                        if( op == 0 )
+                        {
+                            set_union( a.begin( ), a.end( ), b.begin( ), b.end( ), back_inserter( want ) );
+                            parallel ? x.union_with( std::move( y ), pool ) : x.union_with( std::move( y ) );
+                        }
+                        else if( op == 1 )
+                        {
+                            set_intersection( a.begin( ), a.end( ), b.begin( ), b.end( ), back_inserter( want ) );
+                            parallel ? x.intersect_with( std::move( y ), pool ) : x.intersect_with( std::move( y ) );
+                        }
+                        else
+                        {
+                            set_difference( a.begin( ), a.end( ), b.begin( ), b.end( ), back_inserter( want ) );
+                            parallel ? x.difference_with( std::move( y ), pool ) : x.difference_with( std::move( y ) );
+                        }
+
+                        if( contents( x ) != want || !y.isEmpty( ) )
+                            cout << "Set operation error!" << endl;
+                        if( !balanced( x ) )
+                            cout << "Set operation balance error!" << endl;
+                    }
+
+    // join: either side empty, and sides of very different heights
+    for( int m : SIZES )
+        for( int n : SIZES )
+        {
+            auto a = random_keys( random, m, 0, 3000 );
+            auto b = random_keys( random, n, 3001, 6000 );
+            Tree left = build( a ), right = build( b ), t = build( { 1, 2, 3 } );
+            t.join( left, 3000, right );
+
+            vector<int> want = a;
+            want.push_back( 3000 );
+            want.insert( want.end( ), b.begin( ), b.end( ) );
+            if( contents( t ) != want || !left.isEmpty( ) || !right.isEmpty( ) )
+                cout << "Join error!" << endl;
+            if( !balanced( t ) )
+                cout << "Join balance error!" << endl;
+        }
+
+    // split: at present and absent keys, at both ends and beyond them
+    for( int n : SIZES )
+    {
+        auto keys = random_keys( random, n, 0, 3000 );
+        vector<int> at = { -1, 0, 1500, 2999, 3000 };
+        if( n )
+        {
+            at.push_back( keys.front( ) );
+            at.push_back( keys[ keys.size( ) / 2 ] );
+            at.push_back( keys.back( ) );
+        }
+
+        for( int k : at )
+        {
+            Tree t = build( keys ), left = build( { -5 } ), right = build( { 5000 } );
+            bool found = t.split( k, left, right );
+
+            auto middle = lower_bound( keys.begin( ), keys.end( ), k );
+            bool present = middle != keys.end( ) && *middle == k;
+            vector<int> less_than( keys.begin( ), middle );
+            vector<int> greater_than( present ? middle + 1 : middle, keys.end( ) );
+            if( found != present || !t.isEmpty( ) || contents( left ) != less_than || contents( right ) != greater_than )
+                cout << "Split error!" << endl;
+            if( !balanced( left ) || !balanced( right ) )
+                cout << "Split balance error!" << endl;
+        }
+    }
+
+    cout << "End of test..." << endl;
+    return 0;
+}
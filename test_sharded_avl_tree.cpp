@@ -0,0 +1,68 @@
+#include <vector>
+
+#include "sharded_avl_tree.h"
+
+using namespace std;
+using namespace tree;
+
+    // Test program
+int main( )
+{
+    ShardedAvlTree<int, 16> t;
+    int NUMS = 20000000;
+    const int GAP  =   37;
+    int i;
+
+    cout << "Checking... (no more output means success)" << endl;
+
+    vector<int> sample;
+    for( i = 0; i < NUMS; i += 1000 )
+        sample.push_back( i );
+    t.choose_splitters( sample.begin( ), sample.end( ) );
+
+    for( i = GAP; i != 0; i = ( i + GAP ) % NUMS )
+        t.insert( i );
+    t.remove( 0 );
+    for( i = 1; i < NUMS; i += 2 )
+        t.remove( i );
+
+    if( NUMS < 40 )
+        t.printTree( );
+    if( t.findMin( ) != 2 || t.findMax( ) != NUMS - 2 )
+        cout << "FindMin or FindMax error!" << endl;
+
+    for( i = 2; i < NUMS; i += 2 )
+        if( !t.contains( i ) )
+            cout << "Find error1!" << endl;
+
+    for( i = 1; i < NUMS; i += 2 )
+    {
+        if( t.contains( i )  )
+            cout << "Find error2!" << endl;
+    }
+
+    for( i = NUMS / 2; i < NUMS; ++i )
+        t.remove( i );
+    t.rebalance( );
+
+    i = 2;
+    t.for_each( [&]( int e ) {
+        if( e != i )
+            cout << "Scan error!" << endl;
+        i += 2;
+    } );
+    if( i != NUMS / 2 )
+        cout << "Scan error!" << endl;
+
+    i = 1000;
+    t.for_each( 999, 3000001, [&]( int e ) {
+        if( e != i )
+            cout << "Range scan error!" << endl;
+        i += 2;
+    } );
+    if( i != 3000002 )
+        cout << "Range scan error!" << endl;
+
+    cout << "End of test..." << endl;
+    return 0;
+}
@@ -0,0 +1,239 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace tree {
+
+// Work-stealing pool for fork-join recursion.
+//
+// fork_join(a, b) queues b on the calling worker's deque, runs a, then
+// takes b back and runs it too unless an idle worker stole it meanwhile;
+// in that case it runs other queued tasks until b is done. Owners work
+// their deque LIFO, thieves take the oldest, i.e. biggest, task. Threads
+// outside the pool share one extra deque and help the same way while they
+// wait, so ThreadPool(n) runs n threads' worth of work with n - 1 workers.
+class ThreadPool {
+  public:
+    // 0 uses all cores.
+    explicit ThreadPool(unsigned threads = 0) : stop_(false), queued_(0), sleepers_(0) {
+        if (0 == threads) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        // queue 0 takes tasks from threads outside the pool
+        for (unsigned i = 0; i < threads; ++i) {
+            queues_.emplace_back(new Queue);
+        }
+        for (unsigned i = 1; i < threads; ++i) {
+            workers_.emplace_back([this, i] {
+                work(i);
+            });
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stop_.store(true);
+        }
+        wake_.notify_all();
+        for (auto &worker : workers_) {
+            worker.join();
+        }
+    }
+
+    // Threads that do work, the caller included.
+    unsigned size() const noexcept {
+        return static_cast<unsigned>(queues_.size());
+    }
+
+    // Runs a() and b(), possibly in parallel, and returns once both are
+    // done. An exception from either is rethrown after both finished.
+    template <typename A, typename B>
+    void fork_join(A &&a, B &&b) {
+        Job<B> job(b);
+        auto queue = own_queue();
+        push(*queue, &job);
+
+        std::exception_ptr error;
+        try {
+            a();
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        if (take_back(*queue, &job)) {
+            job.execute();
+        } else {
+            while (!job.done_.load(std::memory_order_acquire)) {
+                if (auto task = find_task(queue)) {
+                    task->execute();
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        if (job.error_) {
+            std::rethrow_exception(job.error_);
+        }
+    }
+
+  private:
+    struct Task {
+        void (*run_)(Task *);
+        std::atomic<bool> done_;
+        std::exception_ptr error_;
+
+        explicit Task(void (*run)(Task *)) : run_(run), done_(false) {}
+
+        void execute() {
+            try {
+                run_(this);
+            } catch (...) {
+                error_ = std::current_exception();
+            }
+            done_.store(true, std::memory_order_release);
+        }
+    };
+
+    template <typename F>
+    struct Job : Task {
+        F &f_;
+
+        explicit Job(F &f) : Task(&Job::run), f_(f) {}
+
+        static void run(Task *task) {
+            static_cast<Job *>(task)->f_();
+        }
+    };
+
+    // padded so that neighbouring queues never share a cache line
+    struct Queue {
+        std::mutex mutex_;
+        std::deque<Task *> tasks_;
+        char pad_[64];
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<bool> stop_;
+    std::atomic<std::size_t> queued_;
+    std::atomic<int> sleepers_;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+
+    // the pool and queue of the calling thread if it is a worker
+    struct Current {
+        ThreadPool *pool_;
+        Queue *queue_;
+    };
+
+    static Current &current() {
+        static thread_local Current current = {nullptr, nullptr};
+        return current;
+    }
+
+    Queue *own_queue() {
+        auto &self = current();
+        return self.pool_ == this ? self.queue_ : queues_[0].get();
+    }
+
+    void push(Queue &queue, Task *task) {
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex_);
+            queue.tasks_.push_back(task);
+        }
+        queued_.fetch_add(1);
+        if (sleepers_.load() > 0) {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            wake_.notify_one();
+        }
+    }
+
+    bool take_back(Queue &queue, Task *task) {
+        std::lock_guard<std::mutex> lock(queue.mutex_);
+        // usually the newest one, unless a thread outside the pool shares
+        // the queue
+        auto it = std::find(queue.tasks_.rbegin(), queue.tasks_.rend(), task);
+        if (it == queue.tasks_.rend()) {
+            return false;
+        }
+
+        queue.tasks_.erase(std::next(it).base());
+        queued_.fetch_sub(1);
+        return true;
+    }
+
+    // The newest task of own, else the oldest one of some other queue.
+    Task *find_task(Queue *own) {
+        if (0 == queued_.load()) {
+            return nullptr;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(own->mutex_);
+            if (!own->tasks_.empty()) {
+                auto task = own->tasks_.back();
+                own->tasks_.pop_back();
+                queued_.fetch_sub(1);
+                return task;
+            }
+        }
+
+        for (auto &queue : queues_) {
+            if (queue.get() == own) {
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(queue->mutex_);
+            if (!queue->tasks_.empty()) {
+                auto task = queue->tasks_.front();
+                queue->tasks_.pop_front();
+                queued_.fetch_sub(1);
+                return task;
+            }
+        }
+
+        return nullptr;
+    }
+
+    void work(unsigned index) {
+        current() = Current{this, queues_[index].get()};
+        while (!stop_.load()) {
+            if (auto task = find_task(queues_[index].get())) {
+                task->execute();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            ++sleepers_;
+            wake_.wait_for(lock, std::chrono::milliseconds(10), [this] {
+                return stop_.load() || queued_.load() > 0;
+            });
+            --sleepers_;
+        }
+    }
+};
+
+}
+
+#endif // THREAD_POOL_H_
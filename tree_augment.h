@@ -0,0 +1,122 @@
+#ifndef TREE_AUGMENT_H_
+#define TREE_AUGMENT_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <limits>
+
+namespace tree {
+
+struct IndexOutOfRange : public std::exception {
+    const char *what() const noexcept override {
+        return "IndexOutOfRange";
+    }
+};
+
+// Augmentation policies keep a summary of every subtree in its root node.
+// A policy names the summary type and says how to build it:
+//
+//     using value_type = ...;
+//     static value_type identity();                         // empty range
+//     static value_type lift(const Comparable &e);          // one element
+//     static value_type combine(const value_type &left,     // associative
+//                               const value_type &right);
+//
+// The tree recomputes a node's summary whenever its children change, so
+// every summary stays exact through insert, remove and rotations.
+
+// Default: no summary, no extra bytes in the node.
+struct NoAugment {};
+
+// Subtree sizes, for rank/select in O(log n).
+struct OrderStatistics {
+    using value_type = std::size_t;
+
+    static value_type identity() noexcept {
+        return 0;
+    }
+
+    template <typename T>
+    static value_type lift(const T &) noexcept {
+        return 1;
+    }
+
+    static value_type combine(value_type left, value_type right) noexcept {
+        return left + right;
+    }
+};
+
+// Projections pick the aggregated quantity out of an element.
+struct Identity {
+    template <typename T>
+    const T &operator()(const T &e) const noexcept {
+        return e;
+    }
+};
+
+template <typename Value, typename Project = Identity>
+struct Sum {
+    using value_type = Value;
+
+    static value_type identity() {
+        return Value();
+    }
+
+    template <typename T>
+    static value_type lift(const T &e) {
+        return static_cast<Value>(Project()(e));
+    }
+
+    static value_type combine(const value_type &left, const value_type &right) {
+        return left + right;
+    }
+};
+
+template <typename Value, typename Project = Identity>
+struct Min {
+    using value_type = Value;
+
+    static value_type identity() {
+        return std::numeric_limits<Value>::max();
+    }
+
+    template <typename T>
+    static value_type lift(const T &e) {
+        return static_cast<Value>(Project()(e));
+    }
+
+    static value_type combine(const value_type &left, const value_type &right) {
+        return std::min(left, right);
+    }
+};
+
+template <typename Value, typename Project = Identity>
+struct Max {
+    using value_type = Value;
+
+    static value_type identity() {
+        return std::numeric_limits<Value>::lowest();
+    }
+
+    template <typename T>
+    static value_type lift(const T &e) {
+        return static_cast<Value>(Project()(e));
+    }
+
+    static value_type combine(const value_type &left, const value_type &right) {
+        return std::max(left, right);
+    }
+};
+
+template <typename Augment>
+struct AugmentedNode {
+    typename Augment::value_type summary_;
+};
+
+template <>
+struct AugmentedNode<NoAugment> {};
+
+}
+
+#endif // TREE_AUGMENT_H_
@@ -0,0 +1,93 @@
+#ifndef TREE_COMPARE_H_
+#define TREE_COMPARE_H_
+
+#include <type_traits>
+#include <utility>
+
+namespace tree {
+
+template <typename...>
+struct make_void {
+    using type = void;
+};
+
+// Comparators that declare is_transparent, like std::less<> or
+// std::compare_three_way, can compare the stored keys with other types,
+// e.g. std::string keys with a std::string_view.
+template <typename Compare, typename = void>
+struct is_transparent : std::false_type {};
+
+template <typename Compare>
+struct is_transparent<Compare, typename make_void<typename Compare::is_transparent>::type> : std::true_type {};
+
+// The trees order their keys through a KeyCompare. Compare is either a
+// strict weak order returning bool, like std::less, or a three-way
+// comparator whose result compares against 0, like std::compare_three_way
+// or a strcmp-style function object returning int.
+//
+// compare(a, b) is negative, zero or positive. It costs one call of a
+// three-way comparator, but two of a less, where the second call only
+// happens when a is not less than b. operator() is the plain less.
+template <typename Compare>
+class KeyCompare {
+  public:
+    KeyCompare() : comp_() {}
+
+    explicit KeyCompare(const Compare &comp) : comp_(comp) {}
+
+    const Compare &get() const noexcept {
+        return comp_;
+    }
+
+    template <typename A, typename B>
+    int compare(const A &a, const B &b) const {
+        return compare(a, b, is_less<A, B>());
+    }
+
+    template <typename A, typename B>
+    bool operator()(const A &a, const B &b) const {
+        return less(a, b, is_less<A, B>());
+    }
+
+  private:
+    Compare comp_;
+
+    template <typename A, typename B>
+    using is_less = std::is_same<
+        typename std::decay<decltype(std::declval<const Compare &>()(std::declval<const A &>(),
+                                                                     std::declval<const B &>()))>::type,
+        bool>;
+
+    template <typename A, typename B>
+    int compare(const A &a, const B &b, std::true_type) const {
+        if (comp_(a, b)) {
+            return -1;
+        }
+
+        return comp_(b, a) ? 1 : 0;
+    }
+
+    template <typename A, typename B>
+    int compare(const A &a, const B &b, std::false_type) const {
+        auto result = comp_(a, b);
+        if (result < 0) {
+            return -1;
+        }
+
+        return 0 < result ? 1 : 0;
+    }
+
+    template <typename A, typename B>
+    bool less(const A &a, const B &b, std::true_type) const {
+        return comp_(a, b);
+    }
+
+    template <typename A, typename B>
+    bool less(const A &a, const B &b, std::false_type) const {
+        return comp_(a, b) < 0;
+    }
+};
+
+}
+
+#endif // TREE_COMPARE_H_
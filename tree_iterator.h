@@ -0,0 +1,199 @@
+#ifndef TREE_ITERATOR_H_
+#define TREE_ITERATOR_H_
+
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+
+namespace tree {
+
+// In-order iterator for balanced trees whose nodes have no parent link.
+// It carries the path from the root to the current node, so ++/-- cost
+// amortized O(1) and a range scan of k elements costs O(log n + k) without
+// recursion or extra bytes per node. An empty path is end().
+//
+// Node needs element_, left_ and right_. Any insert or remove invalidates
+// every iterator of the tree.
+template <typename Node, typename Value>
+class PathIterator {
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = Value;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Value *;
+    using reference = const Value &;
+
+    // Enough for any AVL tree that fits in memory.
+    static constexpr int MAX_DEPTH = 64;
+
+    PathIterator() : root_(nullptr), depth_(0) {}
+
+    explicit PathIterator(const Node *root) : root_(root), depth_(0) {}
+
+    PathIterator(const PathIterator &other) : root_(other.root_), depth_(other.depth_) {
+        for (int i = 0; i < depth_; ++i) {
+            path_[i] = other.path_[i];
+        }
+    }
+
+    PathIterator &operator=(const PathIterator &other) {
+        root_ = other.root_;
+        depth_ = other.depth_;
+        for (int i = 0; i < depth_; ++i) {
+            path_[i] = other.path_[i];
+        }
+
+        return *this;
+    }
+
+    static PathIterator first(const Node *root) {
+        PathIterator it(root);
+        if (root) {
+            it.push(root);
+            it.descend_left();
+        }
+
+        return it;
+    }
+
+    // First element not less than e.
+    template <typename Key, typename Less>
+    static PathIterator lower_bound(const Node *root, const Key &e, Less less) {
+        PathIterator it(root);
+        int found = 0;
+        for (auto node = root; node;) {
+            it.push(node);
+            if (less(node->element_, e)) {
+                node = node->right_;
+            } else {
+                found = it.depth_;
+                if (!less(e, node->element_)) {
+                    break;
+                }
+                node = node->left_;
+            }
+        }
+
+        it.depth_ = found;
+        return it;
+    }
+
+    // First element greater than e.
+    template <typename Key, typename Less>
+    static PathIterator upper_bound(const Node *root, const Key &e, Less less) {
+        PathIterator it(root);
+        int found = 0;
+        for (auto node = root; node;) {
+            it.push(node);
+            if (less(e, node->element_)) {
+                found = it.depth_;
+                node = node->left_;
+            } else {
+                node = node->right_;
+            }
+        }
+
+        it.depth_ = found;
+        return it;
+    }
+
+    reference operator*() const {
+        return path_[depth_ - 1]->element_;
+    }
+
+    pointer operator->() const {
+        return &path_[depth_ - 1]->element_;
+    }
+
+    PathIterator &operator++() {
+        auto node = path_[depth_ - 1];
+        if (node->right_) {
+            push(node->right_);
+            descend_left();
+        } else {
+            // climb until we leave a left subtree
+            const Node *child;
+            do {
+                child = path_[--depth_];
+            } while (depth_ && path_[depth_ - 1]->right_ == child);
+        }
+
+        return *this;
+    }
+
+    PathIterator operator++(int) {
+        auto result = *this;
+        ++*this;
+        return result;
+    }
+
+    PathIterator &operator--() {
+        if (!depth_) {
+            // --end() is the maximum
+            push(root_);
+            descend_right();
+            return *this;
+        }
+
+        auto node = path_[depth_ - 1];
+        if (node->left_) {
+            push(node->left_);
+            descend_right();
+        } else {
+            const Node *child;
+            do {
+                child = path_[--depth_];
+            } while (depth_ && path_[depth_ - 1]->left_ == child);
+        }
+
+        return *this;
+    }
+
+    PathIterator operator--(int) {
+        auto result = *this;
+        --*this;
+        return result;
+    }
+
+    bool operator==(const PathIterator &other) const noexcept {
+        if (!depth_ || !other.depth_) {
+            return depth_ == other.depth_;
+        }
+
+        return path_[depth_ - 1] == other.path_[other.depth_ - 1];
+    }
+
+    bool operator!=(const PathIterator &other) const noexcept {
+        return !(*this == other);
+    }
+
+    const Node *node() const noexcept {
+        return depth_ ? path_[depth_ - 1] : nullptr;
+    }
+
+  private:
+    const Node *root_;
+    int depth_;
+    const Node *path_[MAX_DEPTH];
+
+    void push(const Node *node) {
+        assert(depth_ < MAX_DEPTH && "tree deeper than PathIterator::MAX_DEPTH");
+        path_[depth_++] = node;
+    }
+
+    void descend_left() {
+        while (path_[depth_ - 1]->left_) {
+            push(path_[depth_ - 1]->left_);
+        }
+    }
+
+    void descend_right() {
+        while (path_[depth_ - 1]->right_) {
+            push(path_[depth_ - 1]->right_);
+        }
+    }
+};
+
+}
+
+#endif // TREE_ITERATOR_H_
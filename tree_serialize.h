@@ -0,0 +1,449 @@
+#ifndef TREE_SERIALIZE_H_
+#define TREE_SERIALIZE_H_
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <istream>
+#include <iterator>
+#include <ostream>
+#include <string>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+namespace tree {
+
+struct BadSnapshot : public std::exception {
+    const char *what() const noexcept override {
+        return "BadSnapshot";
+    }
+};
+
+// Snapshot format, all numbers little endian:
+//
+//   header  "TRSN", u8 version, u8 key tag, u16 key size, u64 count
+//   block   u32 payload bytes, u32 elements, u64 checksum, payload
+//
+// Elements come in ascending order, packed into blocks of about
+// SNAPSHOT_BLOCK_BYTES by KeyCodec<T>, and a block's checksum covers its
+// payload. Each block starts its delta chain afresh, so a reader needs one
+// block in memory at a time and checks it before decoding it.
+constexpr std::size_t SNAPSHOT_BLOCK_BYTES = 64 * 1024;
+
+namespace detail {
+
+constexpr char SNAPSHOT_MAGIC[4] = {'T', 'R', 'S', 'N'};
+constexpr std::uint8_t SNAPSHOT_VERSION = 1;
+constexpr std::size_t SNAPSHOT_HEADER_BYTES = 16;
+constexpr std::size_t SNAPSHOT_BLOCK_HEADER_BYTES = 16;
+
+inline void put_le(char *p, std::uint64_t v, int bytes) noexcept {
+    for (int i = 0; i < bytes; ++i) {
+        p[i] = static_cast<char>(v >> (8 * i));
+    }
+}
+
+inline std::uint64_t get_le(const char *p, int bytes) noexcept {
+    std::uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i) {
+        v |= static_cast<std::uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    }
+    return v;
+}
+
+// FNV-1a over 8-byte words, then the tail bytes; one multiply per word
+// keeps it well ahead of any disk.
+inline std::uint64_t checksum(const char *p, std::size_t n) noexcept {
+    const std::uint64_t PRIME = 0x100000001b3ull;
+    std::uint64_t h = 0xcbf29ce484222325ull;
+    for (; n >= 8; p += 8, n -= 8) {
+        std::uint64_t word;
+        std::memcpy(&word, p, 8);
+        h = (h ^ word) * PRIME;
+    }
+    for (; n; ++p, --n) {
+        h = (h ^ static_cast<unsigned char>(*p)) * PRIME;
+    }
+    return h;
+}
+
+inline void put_varint(std::string &out, std::uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+inline bool get_varint(const char *&p, const char *end, std::uint64_t &v) noexcept {
+    v = 0;
+    for (int shift = 0; p != end && shift < 64; shift += 7) {
+        auto byte = static_cast<unsigned char>(*p++);
+        v |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+// How a key type is written. encode appends e to out, prev is the element
+// before it in the same block or nullptr; decode reads it back, advancing
+// p, and returns false on malformed input. TAG and SIZE go into the header
+// so a snapshot is never loaded as the wrong key type. MAX_BYTES bounds the
+// encoding of one key, and with it the block a reader will accept.
+// Specialize it for other key types.
+template <typename T, typename = void>
+struct KeyCodec;
+
+// Integers: the difference to the previous key, zigzag and varint encoded,
+// a byte or two for dense keys whatever their width.
+template <typename T>
+struct KeyCodec<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> {
+    static constexpr std::uint8_t TAG = std::is_signed<T>::value ? 'i' : 'u';
+    static constexpr std::uint16_t SIZE = sizeof(T);
+    static constexpr std::size_t MAX_BYTES = (8 * sizeof(T) + 6) / 7;
+
+    using Unsigned = typename std::make_unsigned<T>::type;
+
+    static void encode(std::string &out, const T &e, const T *prev) {
+        // wraps around in unsigned arithmetic, any order works
+        Unsigned delta = static_cast<Unsigned>(static_cast<Unsigned>(e) - (prev ? static_cast<Unsigned>(*prev) : 0));
+        Unsigned sign = (delta >> (8 * sizeof(T) - 1)) ? static_cast<Unsigned>(~Unsigned(0)) : Unsigned(0);
+        detail::put_varint(out, static_cast<Unsigned>((delta << 1) ^ sign));
+    }
+
+    static bool decode(const char *&p, const char *end, T &e, const T *prev) noexcept {
+        std::uint64_t v;
+        if (!detail::get_varint(p, end, v)) {
+            return false;
+        }
+        auto zigzag = static_cast<Unsigned>(v);
+        auto delta = static_cast<Unsigned>((zigzag >> 1) ^ static_cast<Unsigned>(0 - (zigzag & 1)));
+        e = static_cast<T>(static_cast<Unsigned>((prev ? static_cast<Unsigned>(*prev) : 0) + delta));
+        return true;
+    }
+};
+
+// Any other trivially copyable key: its bytes as they are.
+template <typename T>
+struct KeyCodec<T, typename std::enable_if<std::is_trivially_copyable<T>::value &&
+                                           !(std::is_integral<T>::value && !std::is_same<T, bool>::value)>::type> {
+    static constexpr std::uint8_t TAG = std::is_floating_point<T>::value ? 'f' : 'b';
+    static constexpr std::uint16_t SIZE = sizeof(T);
+    static constexpr std::size_t MAX_BYTES = sizeof(T);
+
+    static void encode(std::string &out, const T &e, const T *) {
+        out.append(reinterpret_cast<const char *>(&e), sizeof(T));
+    }
+
+    static bool decode(const char *&p, const char *end, T &e, const T *) noexcept {
+        if (static_cast<std::size_t>(end - p) < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(static_cast<void *>(&e), p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+};
+
+// Strings: the length as a varint, then the bytes. Keys of more than
+// MAX_LENGTH bytes can't be written.
+template <>
+struct KeyCodec<std::string> {
+    static constexpr std::uint8_t TAG = 's';
+    static constexpr std::uint16_t SIZE = 0;
+    static constexpr std::size_t MAX_LENGTH = 1024 * 1024;
+    static constexpr std::size_t MAX_BYTES = MAX_LENGTH + 3;
+
+    static void encode(std::string &out, const std::string &e, const std::string *) {
+        if (e.size() > MAX_LENGTH) {
+            throw BadSnapshot();
+        }
+        detail::put_varint(out, e.size());
+        out.append(e);
+    }
+
+    static bool decode(const char *&p, const char *end, std::string &e, const std::string *) {
+        std::uint64_t size;
+        if (!detail::get_varint(p, end, size) || size > MAX_LENGTH || size > static_cast<std::uint64_t>(end - p)) {
+            return false;
+        }
+        e.assign(p, static_cast<std::size_t>(size));
+        p += size;
+        return true;
+    }
+};
+
+// Byte sinks and sources; they throw BadSnapshot when the I/O fails.
+
+class StreamSink {
+  public:
+    explicit StreamSink(std::ostream &os) : os_(os) {}
+
+    void write(const char *p, std::size_t n) {
+        if (!os_.write(p, static_cast<std::streamsize>(n))) {
+            throw BadSnapshot();
+        }
+    }
+
+  private:
+    std::ostream &os_;
+};
+
+class StreamSource {
+  public:
+    explicit StreamSource(std::istream &is) : is_(is) {}
+
+    void read(char *p, std::size_t n) {
+        if (!is_.read(p, static_cast<std::streamsize>(n))) {
+            throw BadSnapshot();
+        }
+    }
+
+  private:
+    std::istream &is_;
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+class FdSink {
+  public:
+    explicit FdSink(int fd) : fd_(fd) {}
+
+    void write(const char *p, std::size_t n) {
+        while (n) {
+            auto written = ::write(fd_, p, n);
+            if (written < 0 && EINTR == errno) {
+                continue;
+            }
+            if (written <= 0) {
+                throw BadSnapshot();
+            }
+            p += written;
+            n -= static_cast<std::size_t>(written);
+        }
+    }
+
+  private:
+    int fd_;
+};
+
+class FdSource {
+  public:
+    explicit FdSource(int fd) : fd_(fd) {}
+
+    void read(char *p, std::size_t n) {
+        while (n) {
+            auto got = ::read(fd_, p, n);
+            if (got < 0 && EINTR == errno) {
+                continue;
+            }
+            if (got <= 0) {
+                throw BadSnapshot();
+            }
+            p += got;
+            n -= static_cast<std::size_t>(got);
+        }
+    }
+
+  private:
+    int fd_;
+};
+#endif
+
+// Writes the count elements of the ascending range [first, last).
+template <typename T, typename InputIt, typename Sink>
+void write_snapshot(InputIt first, InputIt last, std::uint64_t count, Sink &sink) {
+    using Codec = KeyCodec<T>;
+
+    char header[detail::SNAPSHOT_HEADER_BYTES];
+    std::memcpy(header, detail::SNAPSHOT_MAGIC, 4);
+    header[4] = static_cast<char>(detail::SNAPSHOT_VERSION);
+    header[5] = static_cast<char>(Codec::TAG);
+    detail::put_le(header + 6, Codec::SIZE, 2);
+    detail::put_le(header + 8, count, 8);
+    sink.write(header, sizeof(header));
+
+    std::string block(detail::SNAPSHOT_BLOCK_HEADER_BYTES, '\0');
+    block.reserve(SNAPSHOT_BLOCK_BYTES + 64);
+    std::uint32_t elements = 0;
+    auto flush = [&] {
+        auto payload = block.size() - detail::SNAPSHOT_BLOCK_HEADER_BYTES;
+        detail::put_le(&block[0], payload, 4);
+        detail::put_le(&block[4], elements, 4);
+        detail::put_le(&block[8], detail::checksum(block.data() + detail::SNAPSHOT_BLOCK_HEADER_BYTES, payload), 8);
+        sink.write(block.data(), block.size());
+        block.resize(detail::SNAPSHOT_BLOCK_HEADER_BYTES);
+        elements = 0;
+    };
+
+    const T *prev = nullptr;
+    std::uint64_t written = 0;
+    for (; first != last; ++first, ++written) {
+        const T &e = *first;
+        Codec::encode(block, e, prev);
+        ++elements;
+        prev = &e;
+        if (block.size() - detail::SNAPSHOT_BLOCK_HEADER_BYTES >= SNAPSHOT_BLOCK_BYTES) {
+            flush();
+            prev = nullptr;
+        }
+    }
+    if (elements) {
+        flush();
+    }
+    if (written != count) {
+        throw BadSnapshot();
+    }
+}
+
+// Reads a snapshot one block at a time. begin() and end() give an input
+// iterator over the elements, which the trees' one-pass loaders consume;
+// reading past the count, a bad block or failed I/O throws BadSnapshot.
+template <typename T, typename Source>
+class SnapshotReader {
+    using Codec = KeyCodec<T>;
+
+  public:
+    class iterator {
+      public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T *;
+        using reference = const T &;
+
+        iterator() : reader_(nullptr) {}
+
+        reference operator*() const {
+            return reader_->current_;
+        }
+
+        pointer operator->() const {
+            return &reader_->current_;
+        }
+
+        iterator &operator++() {
+            reader_->next();
+            return *this;
+        }
+
+        // at end once the reader is through
+        bool operator==(const iterator &other) const noexcept {
+            return at_end() == other.at_end();
+        }
+
+        bool operator!=(const iterator &other) const noexcept {
+            return !(*this == other);
+        }
+
+      private:
+        friend class SnapshotReader;
+
+        SnapshotReader *reader_;
+
+        explicit iterator(SnapshotReader *reader) : reader_(reader) {}
+
+        bool at_end() const noexcept {
+            return !reader_ || reader_->done_;
+        }
+    };
+
+    // Reads and checks the header.
+    explicit SnapshotReader(Source &source) : source_(source), read_(0), left_in_block_(0), pos_(nullptr), end_(nullptr), done_(false) {
+        char header[detail::SNAPSHOT_HEADER_BYTES];
+        source_.read(header, sizeof(header));
+        if (std::memcmp(header, detail::SNAPSHOT_MAGIC, 4) != 0 ||
+            static_cast<std::uint8_t>(header[4]) != detail::SNAPSHOT_VERSION ||
+            static_cast<std::uint8_t>(header[5]) != Codec::TAG || detail::get_le(header + 6, 2) != Codec::SIZE) {
+            throw BadSnapshot();
+        }
+        count_ = detail::get_le(header + 8, 8);
+        next();
+    }
+
+    SnapshotReader(const SnapshotReader &) = delete;
+    SnapshotReader &operator=(const SnapshotReader &) = delete;
+
+    std::uint64_t count() const noexcept {
+        return count_;
+    }
+
+    // Single pass: begin() is wherever the reader is.
+    iterator begin() {
+        return iterator(this);
+    }
+
+    iterator end() {
+        return iterator();
+    }
+
+  private:
+    Source &source_;
+    std::uint64_t count_;
+    std::uint64_t read_;
+    std::uint32_t left_in_block_;
+    std::string block_;
+    const char *pos_;
+    const char *end_;
+    T current_;
+    bool done_;
+
+    void next() {
+        if (read_ == count_) {
+            if (done_ || pos_ != end_) {
+                throw BadSnapshot();
+            }
+            done_ = true;
+            return;
+        }
+
+        const T *prev = &current_;
+        if (0 == left_in_block_) {
+            if (pos_ != end_) {
+                throw BadSnapshot();
+            }
+            read_block();
+            prev = nullptr;
+        }
+
+        T e;
+        if (!Codec::decode(pos_, end_, e, prev)) {
+            throw BadSnapshot();
+        }
+        current_ = std::move(e);
+        --left_in_block_;
+        ++read_;
+    }
+
+    void read_block() {
+        char header[detail::SNAPSHOT_BLOCK_HEADER_BYTES];
+        source_.read(header, sizeof(header));
+        auto payload = static_cast<std::size_t>(detail::get_le(header, 4));
+        left_in_block_ = static_cast<std::uint32_t>(detail::get_le(header + 4, 4));
+        // a writer closes a block once it reaches SNAPSHOT_BLOCK_BYTES, so
+        // no block runs over by more than one key
+        if (0 == left_in_block_ || payload > SNAPSHOT_BLOCK_BYTES + Codec::MAX_BYTES) {
+            throw BadSnapshot();
+        }
+
+        block_.resize(payload);
+        source_.read(&block_[0], payload);
+        if (detail::checksum(block_.data(), payload) != detail::get_le(header + 8, 8)) {
+            throw BadSnapshot();
+        }
+        pos_ = block_.data();
+        end_ = pos_ + payload;
+    }
+};
+
+}
+
+#endif // TREE_SERIALIZE_H_
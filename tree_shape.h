@@ -0,0 +1,157 @@
+#ifndef TREE_SHAPE_H_
+#define TREE_SHAPE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "node_pool.h"
+
+namespace tree {
+
+// What a tree's stats() found: shape, memory and locality, from one O(n)
+// walk. Depths count from 0 at the root and height is that of the root,
+// -1 for an empty tree, so it is the depth of the deepest node too.
+struct TreeShape {
+    std::size_t size_;
+    int height_;
+    double average_depth_;
+    // depth_histogram_[d] nodes at depth d
+    std::vector<std::size_t> depth_histogram_;
+    // nodes by balance factor, height of the right subtree minus the left
+    std::map<int, std::size_t> balance_histogram_;
+    // what a node costs in memory, allocator bookkeeping included
+    double bytes_per_node_;
+    // mean distance in bytes between the addresses of parent and child,
+    // and the share of those links that stay within one 4 KiB page
+    double average_link_distance_;
+    double same_page_links_;
+
+    TreeShape()
+    : size_(0)
+    , height_(-1)
+    , average_depth_(0)
+    , bytes_per_node_(0)
+    , average_link_distance_(0)
+    , same_page_links_(0)
+    {}
+};
+
+// Bytes an allocator takes for one object of the given size and alignment,
+// its own bookkeeping included. Allocators it doesn't know are taken at
+// the object size.
+template <typename Alloc>
+struct AllocationFootprint {
+    static std::size_t bytes(std::size_t size, std::size_t) noexcept {
+        return size;
+    }
+};
+
+// malloc like glibc's: a size word per chunk, chunks in steps of two
+// words and of four words at least.
+template <typename T>
+struct AllocationFootprint<std::allocator<T>> {
+    static std::size_t bytes(std::size_t size, std::size_t) noexcept {
+        const std::size_t STEP = 2 * sizeof(std::size_t);
+        auto chunk = (size + sizeof(std::size_t) + STEP - 1) / STEP * STEP;
+        return chunk < 2 * STEP ? 2 * STEP : chunk;
+    }
+};
+
+// NodePool blocks, which hold a free list link at least.
+template <typename T, bool HUGE_PAGES>
+struct AllocationFootprint<PoolAllocator<T, HUGE_PAGES>> {
+    static std::size_t bytes(std::size_t size, std::size_t align) noexcept {
+        if (size < sizeof(void *)) {
+            size = sizeof(void *);
+        }
+        if (align < alignof(void *)) {
+            align = alignof(void *);
+        }
+        return (size + align - 1) / align * align;
+    }
+};
+
+// Walks the tree at root for its TreeShape, with a stack of its own rather
+// than recursion, so a tree degenerated into a list of any length is fine.
+// child(node, false) and child(node, true) give the left and right child
+// of node, or nullptr. Only reads the nodes.
+template <typename Node, typename Child>
+TreeShape measure_shape(const Node *root, Child child, double bytes_per_node) {
+    TreeShape shape;
+    shape.bytes_per_node_ = bytes_per_node;
+    if (!root) {
+        return shape;
+    }
+
+    // stage 0: node not seen yet, 1: left subtree done, 2: both done
+    struct Frame {
+        const Node *node_;
+        int depth_;
+        int stage_;
+        int height_left_;
+    };
+    std::vector<Frame> stack;
+    stack.push_back(Frame{root, 0, 0, -1});
+
+    double depths = 0, distances = 0;
+    std::size_t links = 0, same_page = 0;
+    auto descend = [&](const Node *parent, const Node *node, int depth) {
+        auto from = reinterpret_cast<std::uintptr_t>(parent);
+        auto to = reinterpret_cast<std::uintptr_t>(node);
+        distances += static_cast<double>(from > to ? from - to : to - from);
+        same_page += (from >> 12) == (to >> 12);
+        ++links;
+        stack.push_back(Frame{node, depth, 0, -1});
+    };
+
+    // height of the subtree finished last
+    int height = -1;
+    while (!stack.empty()) {
+        auto &frame = stack.back();
+        auto node = frame.node_;
+        if (0 == frame.stage_) {
+            ++shape.size_;
+            depths += frame.depth_;
+            if (shape.depth_histogram_.size() <= static_cast<std::size_t>(frame.depth_)) {
+                shape.depth_histogram_.resize(frame.depth_ + 1);
+            }
+            ++shape.depth_histogram_[frame.depth_];
+
+            frame.stage_ = 1;
+            if (auto left = child(node, false)) {
+                descend(node, left, frame.depth_ + 1);
+                continue;
+            }
+            height = -1;
+        }
+
+        if (1 == frame.stage_) {
+            frame.height_left_ = height;
+            frame.stage_ = 2;
+            if (auto right = child(node, true)) {
+                descend(node, right, frame.depth_ + 1);
+                continue;
+            }
+            height = -1;
+        }
+
+        ++shape.balance_histogram_[height - frame.height_left_];
+        height = (height > frame.height_left_ ? height : frame.height_left_) + 1;
+        stack.pop_back();
+    }
+
+    shape.height_ = height;
+    shape.average_depth_ = depths / shape.size_;
+    if (links) {
+        shape.average_link_distance_ = distances / links;
+        shape.same_page_links_ = static_cast<double>(same_page) / links;
+    }
+    return shape;
+}
+
+}
+
+#endif // TREE_SHAPE_H_
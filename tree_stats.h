@@ -0,0 +1,185 @@
+#ifndef TREE_STATS_H_
+#define TREE_STATS_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+
+namespace tree {
+
+// What the trees report to their Stats policy. A policy has one function,
+//
+//     static void count(StatsEvent e, std::uint64_t n = 1);
+//
+// called as the events happen: one LOOKUPS, INSERTS or REMOVES per call
+// of contains, insert or remove, one COMPARISONS per three-way key
+// comparison, one STEPS per node a search passes on its way down, and one
+// per rotation and node allocated or freed (makeEmpty() freeing a whole
+// pool at once counts nothing).
+enum StatsEvent : unsigned char {
+    LOOKUPS,
+    INSERTS,
+    REMOVES,
+    COMPARISONS,
+    STEPS,
+    SINGLE_ROTATIONS,
+    DOUBLE_ROTATIONS,
+    ALLOCATIONS,
+    DEALLOCATIONS,
+
+    STATS_EVENTS,
+};
+
+inline const char *stats_event_name(StatsEvent e) noexcept {
+    static const char *const NAMES[STATS_EVENTS] = {
+        "lookups", "inserts", "removes", "comparisons", "steps",
+        "single_rotations", "double_rotations", "allocations", "deallocations",
+    };
+    return e < STATS_EVENTS ? NAMES[e] : "unknown";
+}
+
+// Default: counts nothing, every call inlines away.
+struct NoStats {
+    static void count(StatsEvent, std::uint64_t = 1) noexcept {}
+};
+
+// Event counts at one moment. Take one before and one after a run; their
+// difference is what the run did.
+struct StatsSnapshot {
+    std::uint64_t counts_[STATS_EVENTS];
+
+    StatsSnapshot() noexcept : counts_() {}
+
+    std::uint64_t operator[](StatsEvent e) const noexcept {
+        return counts_[e];
+    }
+
+    std::uint64_t operations() const noexcept {
+        return counts_[LOOKUPS] + counts_[INSERTS] + counts_[REMOVES];
+    }
+
+    // Average count of e per lookup, insert or remove.
+    double per_operation(StatsEvent e) const noexcept {
+        return operations() ? static_cast<double>(counts_[e]) / operations() : 0;
+    }
+
+    StatsSnapshot &operator+=(const StatsSnapshot &other) noexcept {
+        for (std::size_t i = 0; i < STATS_EVENTS; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        return *this;
+    }
+
+    StatsSnapshot operator-(const StatsSnapshot &other) const noexcept {
+        StatsSnapshot result;
+        for (std::size_t i = 0; i < STATS_EVENTS; ++i) {
+            result.counts_[i] = counts_[i] - other.counts_[i];
+        }
+        return result;
+    }
+};
+
+inline std::ostream &operator<<(std::ostream &os, const StatsSnapshot &s) {
+    for (std::size_t i = 0; i < STATS_EVENTS; ++i) {
+        os << (i ? " " : "") << stats_event_name(static_cast<StatsEvent>(i)) << '=' << s.counts_[i];
+    }
+    return os;
+}
+
+// Counts every event, per thread: each thread bumps counters of its own,
+// which no other thread writes, so counting is a load and a store without
+// any lock prefix or shared cache line. snapshot() adds up the counters of
+// all threads, those that have finished included, and may run any time
+// on any thread.
+//
+// The counters belong to the policy type, shared by every tree that uses
+// it; a Tag of their own keeps the counts of different trees apart.
+template <typename Tag = void>
+class CountingStats {
+  public:
+    static void count(StatsEvent e, std::uint64_t n = 1) noexcept {
+        auto &counter = local().counts_[e];
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    // Everything counted so far, by every thread.
+    static StatsSnapshot snapshot() {
+        auto &r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex_);
+        auto result = r.finished_;
+        for (auto counters = r.head_; counters; counters = counters->next_) {
+            result += counters->load();
+        }
+        return result;
+    }
+
+    // What the calling thread counted so far.
+    static StatsSnapshot thread_snapshot() {
+        return local().load();
+    }
+
+  private:
+    struct Counters;
+
+    struct Registry {
+        std::mutex mutex_;
+        Counters *head_ = nullptr;
+        StatsSnapshot finished_;
+    };
+
+    struct Counters {
+        std::atomic<std::uint64_t> counts_[STATS_EVENTS];
+        Counters *prev_;
+        Counters *next_;
+
+        Counters() : prev_(nullptr) {
+            for (auto &counter : counts_) {
+                counter.store(0, std::memory_order_relaxed);
+            }
+
+            auto &r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex_);
+            next_ = r.head_;
+            if (next_) {
+                next_->prev_ = this;
+            }
+            r.head_ = this;
+        }
+
+        // a finished thread's counts stay in the totals
+        ~Counters() {
+            auto &r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex_);
+            r.finished_ += load();
+            (prev_ ? prev_->next_ : r.head_) = next_;
+            if (next_) {
+                next_->prev_ = prev_;
+            }
+        }
+
+        StatsSnapshot load() const noexcept {
+            StatsSnapshot result;
+            for (std::size_t i = 0; i < STATS_EVENTS; ++i) {
+                result.counts_[i] = counts_[i].load(std::memory_order_relaxed);
+            }
+            return result;
+        }
+    };
+
+    // never destroyed: threads may still finish after static destruction
+    static Registry &registry() {
+        static auto r = new Registry;
+        return *r;
+    }
+
+    static Counters &local() {
+        thread_local Counters counters;
+        return counters;
+    }
+};
+
+}
+
+#endif // TREE_STATS_H_